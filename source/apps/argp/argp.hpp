@@ -112,11 +112,14 @@ struct params_t : public argparse::Args
     string_t &dbpath                     = kwarg("db,database", "path to processed database files (*.peps)").set_default(workdir.value_or(getcurrpath()));
 
     // dataset will be uploaded at the working directory in SGCI
-    string_t &dataset                    = kwarg("dat, dataset", "path to MS/MS dataset (*.ms2)").set_default(workdir.value_or(getcurrpath()));
+    string_t &dataset                    = kwarg("dat, dataset", "path to MS/MS dataset (*.ms2, *.mgf, *.mzML)").set_default(workdir.value_or(getcurrpath()));
 
     // path to a new workspace or make one at currdir)
     string_t &workspace                  = kwarg("w,workspace", "path to the output workspace").set_default(workdir.value_or(getcurrpath()) + "/hicops_workspace_" + getcurrtimeanddate());
 
+    // path to the persistent database index cache (disabled if empty)
+    string_t &idxcache                   = kwarg("ic,idxcache", "path to store and memory map the database index from (disabled if empty)").set_default(string_t(""));
+
     // maximum threads to use per HiCOPS instance
     int &threads                         = kwarg("t,threads", "maximum number of threads per HiCOPS instance").set_default(std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
 
@@ -147,7 +150,7 @@ struct params_t : public argparse::Args
     // min shared peaks for PSM candidacy
     int &min_shp                         = kwarg("shp,min_shp", "minimum shared peaks for PSM candidacy").set_default(4);
 
-    int &topmatches                      = kwarg("top,topmatches", "number of top PSMs to print in the output (inactive option)").set_default(1);
+    int &topmatches                      = kwarg("top,topmatches", "number of top PSMs to report per spectrum (top PSM only in distributed mode)").set_default(1);
 
     // min PSMs for expect modeling
     int &hits                            = kwarg("hits,min_hits", "minimum candidate PSMs for e-value modeling").set_default(4);
@@ -175,9 +178,27 @@ struct params_t : public argparse::Args
     // DistPolicy_t requires magic_enum submodule.
     DistPolicy_t &lbe_policy             = kwarg("policy", "LBE Distribution policy (cyclic, chunk, zigzag)").set_default(DistPolicy_t::cyclic);
 
+    // PSM output format
+    OutFormat_t &outfmt                  = kwarg("of,outfmt", "PSM output format (tsv, psmb: binary columnar, convert with psmconv)").set_default(OutFormat_t::tsv);
+
     // scratch pad memory in MB
     int &bufferMBs                       = kwarg("buff,spad_mem", "buffer (scratch pad) RAM memory in MB (recommended: 2048MB+)").set_default(2048);
 
+    // spectra per tile in the chunk-major search traversal
+    int &qtile                           = kwarg("qtile", "spectra per tile to search against one index chunk at a time (0: one spectrum at a time)").set_default(0);
+
+    // candidate window (number of peptides) above which the scorecard is scanned sparsely
+    int &spwindow                        = kwarg("spwindow", "candidate window above which only the touched scorecard entries are scanned and reset (0: always dense)").set_default(65536);
+
+    // query batches read ahead asynchronously
+    int &prefetch                        = kwarg("pf,prefetch", "MS/MS batches to keep in flight with asynchronous .pbin reads (0: use the scheduled I/O threads)").set_default(4);
+
+    // memory for the partial results exchanged in distributed mode
+    int &partmem                         = kwarg("pm,partial_mem", "RAM in MB to keep the received partial results in (spilled to the workspace beyond it, 0: always spill)").set_default(4096);
+
+    // encoding of the partial results exchanged in distributed mode
+    PartCodec_t &partcodec               = kwarg("pc,partial_codec", "Encoding of the exchanged partial result histograms (raw, lossless)").set_default(PartCodec_t::lossless);
+
     // this should be an optional parameter
     std::optional<std::vector<std::string>> &mods
                                          = kwarg("m,mods", "list of variable post-translational modifications (PTMs)").multi_argument();
@@ -197,6 +218,9 @@ struct params_t : public argparse::Args
     // match ion when doing fragment ion matching
     bool &matchcharge                    = flag("matchz", "matching ion charges during fragment-ion search");
 
+    // search each fragment-ion bin separately
+    bool &nofmerge                       = flag("nofmerge", "search each fragment-ion bin separately instead of the merged tolerance range (only used for dM <= 25 Da)");
+
     // do not show database search progress marks
     bool &progress                       = flag("noprogress", "do not display progress marks");
 
@@ -220,6 +244,7 @@ void getParams(gParams &params)
     params.dbpath = parser.dbpath;
     params.datapath = parser.dataset;
     params.workspace = parser.workspace;
+    params.idxcache = parser.idxcache;
 
     // set the fullgIndex if not disabled
     params.gpuindex = !parser.nogpuindex;
@@ -233,8 +258,14 @@ void getParams(gParams &params)
 #if __GNUC__ > 9 || (__GNUC__ == 9 && (__GNUC_MINOR__ >= 1))
     // COMPILER VERSION GCC 9.1.0+ required for std::filesystem calls
     std::filesystem::create_directory(parser.workspace);
+
+    if (!parser.idxcache.empty())
+        std::filesystem::create_directory(parser.idxcache);
 #else
     mkdir(parser.workspace.c_str(), 0777);
+
+    if (!parser.idxcache.empty())
+        mkdir(parser.idxcache.c_str(), 0777);
 #endif // __GNUC__ > 9
 
 #endif // !ARGP_ONLY
@@ -282,6 +313,10 @@ void getParams(gParams &params)
         params.dM = parser.deltaM;
         sanitize_dM(params.dM);
 
+        // search the fragment tolerance window as one range (narrow
+        // precursor windows only, wider ones gain nothing from it)
+        params.fmerge = !parser.nofmerge && params.dM <= FMERGE_MAXDM;
+
         // Get the min mass
         params.min_mass = parser.minprecmass;
 
@@ -289,7 +324,7 @@ void getParams(gParams &params)
         params.max_mass = parser.maxprecmass;
 
         // Get the top matches to report
-        params.topmatches = parser.topmatches;
+        params.topmatches = std::max(1, parser.topmatches);
 
         // Get the max expect score to report
         params.expect_max = parser.maxexpect;
@@ -309,9 +344,27 @@ void getParams(gParams &params)
         // Get the scorecard + scratch memory in MBs
         params.spadmem = MBYTES(parser.bufferMBs);
 
+        // Get the spectra per search tile
+        params.qtile = std::max(0, parser.qtile);
+
+        // Get the sparse scorecard window
+        params.spwindow = std::max(0, parser.spwindow);
+
+        // Get the query batches to read ahead
+        params.prefetch = std::max(0, parser.prefetch);
+
+        // Get the memory for the partial results (MBs)
+        params.partmem = std::max(0, parser.partmem);
+
+        // Get the encoding of the partial results
+        params.partcodec = parser.partcodec;
+
         // Get the LBE distribution policy
         params.policy = parser.lbe_policy;
 
+        // Get the PSM output format
+        params.outfmt = parser.outfmt;
+
         // Get number of mods per peptide
         params.vModInfo.vmods_per_pep = parser.nmods;
         sanitize_nmods(params.vModInfo.vmods_per_pep);
@@ -416,6 +469,9 @@ void printParser()
     // get workspace path
     printVar(parser.workspace);
 
+    // get index cache path
+    printVar(parser.idxcache);
+
     // get max number of threads
     printVar(parser.threads);
 
@@ -467,9 +523,27 @@ void printParser()
     // Get the scorecard + scratch memory in MBs
     printVar(parser.bufferMBs);
 
+    // Get the spectra per search tile
+    printVar(parser.qtile);
+
+    // Get the sparse scorecard window
+    printVar(parser.spwindow);
+
+    // Get the query batches to read ahead
+    printVar(parser.prefetch);
+
+    // Get the memory for the partial results (MBs)
+    printVar(parser.partmem);
+
+    // Get the encoding of the partial results
+    printVar(parser.partcodec);
+
     // Get the LBE distribution policy
     printVar(parser.lbe_policy);
 
+    // Get the PSM output format
+    printVar(parser.outfmt);
+
     // Get number of mods per peptide
     printVar(parser.nmods);
 
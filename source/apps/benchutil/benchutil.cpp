@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include "benchutil.hpp"
+#include "lbe.h"
+#include "dslim.h"
+#include "utils.h"
+#include "mods.h"
+
+extern gParams params;
+
+VOID BENCH_Defaults()
+{
+    params.threads = 1;
+    params.maxprepthds = 1;
+    params.min_len = 6;
+    params.max_len = 40;
+    params.maxz = 3;
+    params.res = 0.01;
+    params.scale = 100;
+    params.min_mass = 500;
+    params.max_mass = 5000;
+    params.dM = 10;
+    params.dF = 0.02 * params.scale;
+    params.base_int = 1000 * YAXISMULTIPLIER;
+    params.min_int = params.base_int * 0.01 + 0.5;
+    params.spadmem = MBYTES(2048u);
+    params.topmatches = 1;
+    params.vModInfo.vmods_per_pep = 0;
+    params.vModInfo.num_vars = 0;
+    params.modconditions = "0";
+    params.setindexAndCache(true, true);
+    params.toggleGPU(false);
+}
+
+status_t BENCH_BuildIndex(const string_t &dbpath, std::vector<Index> &indices)
+{
+    status_t status = UTILS_InitializeModInfo(&params.vModInfo);
+
+    if (status == SLM_SUCCESS)
+        status = MODS_Initialize();
+
+    indices.resize(params.max_len - params.min_len + 1);
+
+    for (uint_t peplen = params.min_len; peplen <= params.max_len && status == SLM_SUCCESS; peplen++)
+    {
+        Index *index = indices.data() + peplen - params.min_len;
+        string_t dbfile = dbpath + "/" + std::to_string(peplen) + ".peps";
+
+        index->pepIndex.peplen = peplen;
+
+        status = LBE_CountPeps(dbfile, index, peplen);
+
+        if (status == SLM_SUCCESS)
+            status = LBE_CreatePartitions(index);
+
+        if (status == SLM_SUCCESS)
+            status = LBE_Initialize(index);
+
+        if (status == SLM_SUCCESS)
+            status = LBE_Distribute(index);
+
+        if (status == SLM_SUCCESS)
+            status = DSLIM_Construct(index);
+    }
+
+    return status;
+}
+
+VOID BENCH_AllocScorecard(BYICount &sc, const std::vector<Index> &indices)
+{
+    uint_t scsize = 0;
+
+    for (auto &index : indices)
+        scsize = std::max({scsize, index.lcltotCnt, index.chunksize});
+
+    sc.bc = new ushort_t[scsize]();
+    sc.yc = new ushort_t[scsize]();
+    sc.ibc = new uint_t[scsize]();
+    sc.iyc = new uint_t[scsize]();
+}
+
+VOID BENCH_FreeScorecard(BYICount &sc)
+{
+    delete[] sc.bc;
+    delete[] sc.yc;
+    delete[] sc.ibc;
+    delete[] sc.iyc;
+
+    sc.bc = sc.yc = NULL;
+    sc.ibc = sc.iyc = NULL;
+}
+
+BOOL BENCH_Window(const Index &index, float_t pmass, int_t &minlimit, int_t &maxlimit)
+{
+    float_t *mass = index.pepMass;
+
+    minlimit = std::lower_bound(mass, mass + index.lcltotCnt, (float_t) (pmass - params.dM)) - mass;
+    maxlimit = std::upper_bound(mass, mass + index.lcltotCnt, (float_t) (pmass + params.dM)) - mass - 1;
+
+    return maxlimit >= minlimit;
+}
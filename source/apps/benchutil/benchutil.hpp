@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include "common.hpp"
+#include "slm_dsts.h"
+
+//
+// Setup shared by the index benchmark tools (matchbench): the hicops
+// defaults, the index of a database and the scorecard
+//
+
+/* FUNCTION: BENCH_Defaults
+ *
+ * DESCRIPTION: Set the hicops defaults (dM 10, dF 0.02,
+ *              lengths 6-40, no mods) for a single thread
+ *              reading the MS2 files directly
+ *
+ * INPUT: none
+ *
+ * OUTPUT: none
+ */
+VOID BENCH_Defaults();
+
+/* FUNCTION: BENCH_BuildIndex
+ *
+ * DESCRIPTION: Build the index of each peptide length
+ *              (as the hicops app does without a cache)
+ *
+ * INPUT:
+ * @dbpath : Path to the *.peps files
+ * @indices: The index of each peptide length
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t BENCH_BuildIndex(const string_t &dbpath, std::vector<Index> &indices);
+
+/* FUNCTION: BENCH_AllocScorecard
+ *
+ * DESCRIPTION: Allocate a zeroed scorecard for the largest
+ *              index (or chunk) of the indices
+ *
+ * INPUT:
+ * @sc     : The scorecard
+ * @indices: The indices
+ *
+ * OUTPUT: none
+ */
+VOID BENCH_AllocScorecard(BYICount &sc, const std::vector<Index> &indices);
+
+/* FUNCTION: BENCH_FreeScorecard
+ *
+ * DESCRIPTION: Free the scorecard
+ *
+ * INPUT:
+ * @sc: The scorecard
+ *
+ * OUTPUT: none
+ */
+VOID BENCH_FreeScorecard(BYICount &sc);
+
+/* FUNCTION: BENCH_Window
+ *
+ * DESCRIPTION: The candidate peptides of a precursor mass
+ *              within +-dM (as DSLIM_BinarySearch)
+ *
+ * INPUT:
+ * @index   : The index
+ * @pmass   : Precursor mass
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
+ *
+ * OUTPUT:
+ * @found: Any candidates
+ */
+BOOL BENCH_Window(const Index &index, float_t pmass, int_t &minlimit, int_t &maxlimit);
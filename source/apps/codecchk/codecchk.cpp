@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "common.hpp"
+#include "slm_dsts.h"
+#include "expeRT.h"
+
+//
+// Accuracy check of the partial result codecs (--partial_codec). The
+// partial histograms of fixed synthetic spectra, split across a few
+// nodes, are encoded and reconstructed with each codec and modeled
+// as in DSLIM_DistScoreManager. The lossless e-values must equal the
+// raw ones. Exits with ERR_INVLD_SIZE if they do not.
+//
+// usage: codecchk [spectra = 4000]
+//
+
+/* Required by hicops-core */
+gParams params;
+std::vector<string_t> queryfiles;
+
+/* Simulated nodes per spectrum */
+static const int_t NODES = 4;
+
+/* FUNCTION: synthesize
+ *
+ * DESCRIPTION: Fill the partial histogram of a spectrum on a
+ *              node: a gamma shaped score distribution of mostly
+ *              small, sometimes large (> 65500, scaled) candidate
+ *              counts and, for some spectra, a high scoring match
+ *
+ * INPUT:
+ * @gen : Random number generator (fixed seed)
+ * @yy  : Histogram to fill (expeRT::SIZE)
+ * @top : Hyperscore of the match, 0 if none
+ * @pack: The packed result to fill (N and max)
+ *
+ * OUTPUT: none
+ */
+static VOID synthesize(std::mt19937 &gen, double_t *yy, double_t top, partRes &pack)
+{
+    pack = 0;
+
+    std::gamma_distribution<double_t> scores(6.0, 0.6);
+    std::fill(yy, yy + expeRT::SIZE, 0);
+
+    /* some nodes have no candidates */
+    if (gen() % 10 == 0)
+        return;
+
+    int_t N = (gen() % 4 == 0) ? 2000 + gen() % 100000 : 20 + gen() % 400;
+    double_t max = 0;
+
+    for (int_t k = 0; k < N; k++)
+    {
+        double_t score = std::min(scores(gen), 11.0);
+
+        yy[(int_t) (score * 10 + 0.5)]++;
+        max = std::max(max, score);
+    }
+
+    if (top > max)
+    {
+        yy[(int_t) (top * 10 + 0.5)]++;
+        max = top;
+        N++;
+    }
+
+    pack.N = N;
+    pack.max = max;
+}
+
+/* FUNCTION: evalues
+ *
+ * DESCRIPTION: Reconstruct the partials of each spectrum from
+ *              all nodes and model its e-value (as in
+ *              DSLIM_DistScoreManager)
+ *
+ * INPUT:
+ * @ebs  : Partial results of each node
+ * @bsize: Number of spectra
+ *
+ * OUTPUT:
+ * @evals: The e-values (expect_max if not reported)
+ */
+static std::vector<double_t> evalues(ebuffer **ebs, int_t bsize)
+{
+    expeRT ert;
+    std::vector<double_t> evals(bsize, params.expect_max);
+
+    for (int_t spec = 0; spec < bsize; spec++)
+    {
+        int_t cpsms = 0;
+        float_t maxhypscore = -1;
+
+        for (int_t node = 0; node < NODES; node++)
+        {
+            partRes *sResult = ebs[node]->packs + spec;
+
+            if (sResult->N < 1)
+                continue;
+
+            cpsms += sResult->N;
+            ert.Reconstruct(ebs[node], spec, sResult);
+            maxhypscore = std::max(maxhypscore, sResult->max);
+        }
+
+        if (maxhypscore > 0 && cpsms >= (int_t) params.min_cpsm)
+        {
+            double_t e_x = params.expect_max;
+            int_t int_maxhypscore = (maxhypscore * 10 + 0.5);
+#ifdef TAILFIT
+            ert.ModelTailFit(e_x, int_maxhypscore);
+#else
+            ert.ModelSurvivalFunction(e_x, int_maxhypscore);
+#endif /* TAILFIT */
+
+            evals[spec] = std::min(e_x, params.expect_max);
+        }
+        else
+            ert.ResetPartialVectors();
+    }
+
+    return evals;
+}
+
+status_t main(int_t argc, char_t* argv[])
+{
+    int_t bsize = (argc > 1) ? std::atoi(argv[1]) : 4000;
+
+    if (bsize < 1 || bsize > QCHUNK)
+    {
+        std::fprintf(stderr, "usage: %s [spectra <= %d]\n", argv[0], QCHUNK);
+        return ERR_INVLD_PARAM;
+    }
+
+    const PartCodec_t codecs[] = {PartCodec_t::raw, PartCodec_t::lossless};
+    const char_t *names[] = {"raw", "lossless"};
+    const int_t ncodecs = 2;
+
+    ebuffer *ebs[ncodecs][NODES];
+    std::vector<double_t> yy(expeRT::SIZE);
+
+    std::mt19937 gen(2022);
+    std::uniform_real_distribution<double_t> tops(7.0, 11.5);
+
+    /* The same partials in each codec */
+    for (int_t node = 0; node < NODES; node++)
+        for (int_t c = 0; c < ncodecs; c++)
+            ebs[c][node] = new ebuffer;
+
+    for (int_t spec = 0; spec < bsize; spec++)
+    {
+        /* a match on one of the nodes for a third of the spectra */
+        int_t match = (gen() % 3 == 0) ? gen() % NODES : -1;
+        double_t top = tops(gen);
+
+        for (int_t node = 0; node < NODES; node++)
+        {
+            partRes &pack = ebs[0][node]->packs[spec];
+
+            synthesize(gen, yy.data(), (node == match) ? top : 0, pack);
+
+            if (pack.N > 0)
+            {
+                auto minmax = expeRT::StoreIResults(yy.data(), spec, pack.N, ebs[0][node]);
+                pack.min = minmax[0];
+                pack.max2 = minmax[1];
+                pack.qID = spec;
+            }
+        }
+    }
+
+    ull_t bytes[ncodecs] = {0, 0};
+
+    for (int_t node = 0; node < NODES; node++)
+    {
+        ebs[0][node]->currptr = bsize * Xsamples * sizeof(ushort_t);
+        bytes[0] += ebs[0][node]->currptr;
+
+        for (int_t c = 1; c < ncodecs; c++)
+        {
+            ebuffer *ebuff = ebs[c][node];
+
+            std::memcpy((VOID *) ebuff->packs, ebs[0][node]->packs, bsize * sizeof(partRes));
+            std::memcpy(ebuff->ibuff, ebs[0][node]->ibuff, ebs[0][node]->currptr);
+            ebuff->currptr = ebs[0][node]->currptr;
+
+            expeRT::Encode(ebuff, bsize, codecs[c]);
+            bytes[c] += ebuff->currptr;
+        }
+    }
+
+    std::vector<double_t> evals[ncodecs];
+
+    for (int_t c = 0; c < ncodecs; c++)
+        evals[c] = evalues(ebs[c], bsize);
+
+    status_t status = SLM_SUCCESS;
+
+    std::printf("spectra: %d, nodes: %d, expect_max: %g\n\n", bsize, NODES, params.expect_max);
+    std::printf("%10s %12s %8s %10s %10s %8s\n", "codec", "bytes", "ratio", "reported", "max", "flips");
+
+    for (int_t c = 0; c < ncodecs; c++)
+    {
+        double_t max = 0;
+        int_t reported = 0;
+        int_t flips = 0;
+
+        for (int_t spec = 0; spec < bsize; spec++)
+        {
+            bool_t rep0 = evals[0][spec] < params.expect_max;
+            bool_t rep = evals[c][spec] < params.expect_max;
+
+            reported += rep;
+            flips += (rep != rep0);
+
+            if (rep && rep0)
+                max = std::max(max, std::fabs(evals[c][spec] - evals[0][spec]) / evals[0][spec]);
+        }
+
+        std::printf("%10s %12llu %7.2fx %10d %9.4f%% %8d\n", names[c], bytes[c],
+                    (double_t) bytes[0] / bytes[c], reported, max * 100, flips);
+
+        /* lossless must reproduce the raw e-values exactly */
+        if (max != 0 || flips != 0)
+        {
+            std::fprintf(stderr, "error: %s e-values differ from raw\n", names[c]);
+            status = ERR_INVLD_SIZE;
+        }
+    }
+
+    for (int_t node = 0; node < NODES; node++)
+        for (int_t c = 0; c < ncodecs; c++)
+            delete ebs[c][node];
+
+    return status;
+}
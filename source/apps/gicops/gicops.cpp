@@ -119,10 +119,9 @@ status_t main(int_t argc, char_t* argv[])
         while ((pdir = readdir(dir)) != NULL)
         {
             string_t cfile(pdir->d_name);
-            cfile = cfile.substr(cfile.find_last_of("."));
 
-            /* Add the matching files */
-            if (cfile.find(params.dataext) != std::string::npos)
+            /* Add the MS2, MGF and mzML files */
+            if (hcp::ms2::getformat(cfile) != hcp::ms2::format_t::UNKNOWN)
                 queryfiles.push_back(params.datapath + '/' + pdir->d_name);
         }
     }
@@ -175,23 +174,30 @@ status_t main(int_t argc, char_t* argv[])
         // set the peptide length in the pepIndex
         slm_index[peplen-minlen].pepIndex.peplen = peplen;
 
-        MARK_START(lbe_cnt);
+        // map the index from the index cache if available and valid
+        bool_t cached = !params.idxcache.empty() &&
+                        DSLIM_LoadIndex(dbfile, (slm_index + peplen - minlen)) == SLM_SUCCESS;
 
-        // Count the number of ">" entries in FASTA
-        status = LBE_CountPeps(dbfile, (slm_index + peplen-minlen), peplen);
+        if (!cached)
+        {
+            MARK_START(lbe_cnt);
 
-        MARK_END(lbe_cnt);
+            // Count the number of ">" entries in FASTA
+            status = LBE_CountPeps(dbfile, (slm_index + peplen-minlen), peplen);
 
-        // Compute Duration
-        elapsed_seconds = ELAPSED_SECONDS(lbe_cnt);
+            MARK_END(lbe_cnt);
 
-        if (params.myid == 0)
-        {
-            std::cout << "DONE: Peptide Counting:\tstatus: " << status << std::endl << std::endl;
-            PRINT_ELAPSED(elapsed_seconds);
+            // Compute Duration
+            elapsed_seconds = ELAPSED_SECONDS(lbe_cnt);
+
+            if (params.myid == 0)
+            {
+                std::cout << "DONE: Peptide Counting:\tstatus: " << status << std::endl << std::endl;
+                PRINT_ELAPSED(elapsed_seconds);
+            }
         }
 
-        if (status == SLM_SUCCESS)
+        if (status == SLM_SUCCESS && !cached)
         {
             MARK_START(parts);
 
@@ -210,7 +216,7 @@ status_t main(int_t argc, char_t* argv[])
         }
 
         /* Initialize internal structures */
-        if (status == SLM_SUCCESS)
+        if (status == SLM_SUCCESS && !cached)
         {
             MARK_START(lbe_init);
 
@@ -230,7 +236,7 @@ status_t main(int_t argc, char_t* argv[])
         }
 
         /* Distribution Algorithm */
-        if (status == SLM_SUCCESS)
+        if (status == SLM_SUCCESS && !cached)
         {
             MARK_START(lbe_dist);
 
@@ -250,7 +256,7 @@ status_t main(int_t argc, char_t* argv[])
         }
 
         /* DSLIM-Transform */
-        if (status == SLM_SUCCESS)
+        if (status == SLM_SUCCESS && !cached)
         {
             MARK_START(dslim);
 
@@ -268,6 +274,26 @@ status_t main(int_t argc, char_t* argv[])
                 PRINT_ELAPSED(elapsed_seconds);
             }
         }
+
+        /* Store the index for later runs to map */
+        if (status == SLM_SUCCESS && !cached && !params.idxcache.empty())
+        {
+            MARK_START(dslim_store);
+
+            /* Failure to store is not fatal */
+            status_t store_status = DSLIM_StoreIndex(dbfile, (slm_index + peplen - minlen));
+
+            MARK_END(dslim_store);
+
+            /* Compute Duration */
+            elapsed_seconds = ELAPSED_SECONDS(dslim_store);
+
+            if (params.myid == 0)
+            {
+                std::cout << "DONE: Index Caching:\tstatus: " << store_status << std::endl << std::endl;
+                PRINT_ELAPSED(elapsed_seconds);
+            }
+        }
     }
 
     // we don't need the allocated memory anymore
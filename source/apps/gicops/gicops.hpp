@@ -20,6 +20,8 @@
 #pragma once
 
 #include "lbe.h"
+#include "dslim_cache.h"
+#include "ms2parse.hpp"
 #include "hicops_instr.hpp"
 #include "argparse/argparse.hpp"
 
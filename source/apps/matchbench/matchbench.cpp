@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "common.hpp"
+#include "msquery.hpp"
+#include "dslim_match.h"
+#include "benchutil.hpp"
+
+//
+// Microbenchmark of the fragment-ion matching kernel (DSLIM_MatchIons)
+// on a real index: the tolerance window searched as one range
+// (fmerge, enabled by default for dM <= FMERGE_MAXDM) against the
+// per-bin lower_bound/upper_bound search (--nofmerge). The index is built from the database (*.peps)
+// with the default settings and every spectrum of the MS2 file is
+// matched against its precursor mass window in each index. Only the
+// kernel calls are timed (best of the passes); both searches must
+// produce the same scorecards.
+//
+// usage: matchbench <database> <file.ms2> [passes = 1]
+// e.g.   matchbench samples/sample_db samples/sample_data/14Sep18_Olson_S01.ms2
+//
+
+/* Required by hicops-core */
+gParams params;
+std::vector<string_t> queryfiles;
+
+/* The scorecard and the index */
+static BYICount sc;
+static std::vector<Index> indices;
+
+/* FUNCTION: match
+ *
+ * DESCRIPTION: Match a spectrum against the candidates of
+ *              an index and fold the scorecard into a checksum
+ *
+ * INPUT:
+ * @index   : The index
+ * @ss      : Query spectra batch
+ * @q       : Query spectrum number in the batch
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
+ * @checksum: Scorecard checksum to update
+ *
+ * OUTPUT:
+ * @elapsed: Seconds spent in the kernel
+ */
+template <class ionenc_t>
+static double_t match(Index *index, Queries<spectype_t> *ss, int_t q, int_t minlimit, int_t maxlimit, ull_t &checksum)
+{
+    ionenc_t enc(index->pepIndex.peplen, params.maxz);
+    uint_t ntouched = 0;
+
+    auto *QAPtr = ss->moz + ss->idx[q];
+    auto *iPtr = ss->intensity + ss->idx[q];
+    uint_t qspeclen = ss->idx[q + 1] - ss->idx[q];
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint_t chno = 0; chno < index->nChunks; chno++)
+    {
+        uint_t npeps = ((chno == index->nChunks - 1) && (index->nChunks > 1)) ? index->lastchunksize : index->chunksize;
+
+        DSLIM_MatchIons<ionenc_t, false>(enc, index->ionIndex + chno, npeps, QAPtr, iPtr, qspeclen, minlimit, maxlimit,
+                                         ss->charges[q], &sc, ntouched);
+    }
+
+    std::chrono::duration<double_t> elapsed = std::chrono::steady_clock::now() - start;
+
+    /* Fold and reset the candidates' entries */
+    for (int_t it = minlimit; it <= maxlimit; it++)
+    {
+        checksum = checksum * 31 + sc.bc[it] + (sc.yc[it] << 8) + ((ull_t) sc.ibc[it] << 16) + ((ull_t) sc.iyc[it] << 40);
+        sc.bc[it] = sc.yc[it] = 0;
+        sc.ibc[it] = sc.iyc[it] = 0;
+    }
+
+    return elapsed.count();
+}
+
+/* FUNCTION: run
+ *
+ * DESCRIPTION: Match all spectra against all indices
+ *
+ * INPUT:
+ * @batches : Query spectra
+ * @checksum: Scorecard checksum
+ *
+ * OUTPUT:
+ * @elapsed: Seconds spent in the kernel
+ */
+static double_t run(std::vector<Queries<spectype_t> *> &batches, ull_t &checksum)
+{
+    double_t elapsed = 0;
+    checksum = 0;
+
+    for (auto ss : batches)
+    {
+        for (int_t q = 0; q < ss->numSpecs; q++)
+        {
+            for (auto &index : indices)
+            {
+                int_t minlimit = 0;
+                int_t maxlimit = 0;
+
+                if (!BENCH_Window(index, ss->precurse[q], minlimit, maxlimit))
+                    continue;
+
+                if (index.ionenc == IonEnc_t::shiftmask)
+                    elapsed += match<hcp::dslim::shiftenc>(&index, ss, q, minlimit, maxlimit, checksum);
+                else
+                    elapsed += match<hcp::dslim::divenc>(&index, ss, q, minlimit, maxlimit, checksum);
+            }
+        }
+    }
+
+    return elapsed;
+}
+
+status_t main(int_t argc, char_t* argv[])
+{
+    int_t passes = (argc > 3) ? std::atoi(argv[3]) : 1;
+
+    if (argc < 3 || passes < 1)
+    {
+        std::fprintf(stderr, "usage: %s <database> <file.ms2> [passes]\n", argv[0]);
+        return ERR_INVLD_PARAM;
+    }
+
+    BENCH_Defaults();
+
+    status_t status = BENCH_BuildIndex(argv[1], indices);
+
+    /* Read all the spectra */
+    std::vector<Queries<spectype_t> *> batches;
+    string_t ms2file(argv[2]);
+    MSQuery query;
+
+    if (status == SLM_SUCCESS)
+        status = query.initialize(&ms2file, 0);
+
+    for (int_t rem = 1; status == SLM_SUCCESS && rem > 0;)
+    {
+        Queries<spectype_t> *ss = new Queries<spectype_t>;
+        ss->init();
+
+        status = query.extractbatch<spectype_t>(QCHUNK, ss, rem);
+        batches.push_back(ss);
+    }
+
+    if (status != SLM_SUCCESS)
+    {
+        std::fprintf(stderr, "error: failed to read %s or %s: %d\n", argv[1], argv[2], status);
+        return status;
+    }
+
+    ull_t npeps = 0;
+    int_t nspecs = 0;
+
+    for (auto &index : indices)
+        npeps += index.lcltotCnt;
+
+    for (auto ss : batches)
+        nspecs += ss->numSpecs;
+
+    BENCH_AllocScorecard(sc, indices);
+
+    std::printf("peptides: %llu (lengths %u-%u), spectra: %d, passes: %d\n\n", npeps, params.min_len, params.max_len, nspecs, passes);
+    std::printf("%8s %8s %14s %14s %10s\n", "dM (Da)", "dF (Da)", "per-bin (s)", "fmerge (s)", "speedup");
+
+    for (double_t dM : {10.0, 500.0})
+    {
+        for (double_t dF : {0.01, 0.02, 0.05, 0.1})
+        {
+            params.dM = dM;
+            params.dF = dF * params.scale;
+
+            double_t best[2] = {1e30, 1e30};
+            ull_t checksums[2] = {0, 0};
+
+            for (int_t pass = 0; pass < passes; pass++)
+            {
+                for (int_t fmerge = 0; fmerge < 2; fmerge++)
+                {
+                    params.fmerge = fmerge;
+                    best[fmerge] = std::min(best[fmerge], run(batches, checksums[fmerge]));
+                }
+            }
+
+            if (checksums[0] != checksums[1])
+            {
+                std::fprintf(stderr, "error: scorecards differ at dM: %g, dF: %g\n", dM, dF);
+                status = ERR_INVLD_SIZE;
+            }
+
+            std::printf("%8g %8g %14.4f %14.4f %9.2fx\n", dM, dF, best[0], best[1], best[0] / best[1]);
+        }
+    }
+
+    for (auto ss : batches)
+        delete ss;
+
+    BENCH_FreeScorecard(sc);
+
+    return status;
+}
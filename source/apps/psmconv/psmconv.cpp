@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+#include "psmfile.hpp"
+
+//
+// Convert the binary columnar PSM files (.psmb) written with
+// -outfmt=psmb to the tab separated (the -outfmt=tsv output) or
+// the pepXML format. Each input is converted to <input>.tsv or
+// <input>.pep.xml unless -o merges all inputs into one file.
+//
+// usage: psmconv [-f tsv|pepxml] [-o output] files.psmb ...
+//
+
+using namespace hcp::psm;
+
+/* Output line buffer */
+#define LINE_SIZE                         KBYTES(4)
+
+//
+// a PSM row of a .psmb file
+//
+struct psmrow
+{
+    const reader *rd;
+    ull_t         blk;
+    uint_t        row;
+    uint_t        specid;
+    ushort_t      rank;
+    std::string_view file;
+};
+
+/* FUNCTION: escape
+ *
+ * DESCRIPTION: Escape a string for an XML attribute
+ *
+ * INPUT:
+ * @str: The string
+ *
+ * OUTPUT:
+ * @esc: The escaped string
+ */
+static string_t escape(std::string_view str)
+{
+    string_t esc;
+
+    for (auto c : str)
+    {
+        switch (c)
+        {
+            case '&': esc += "&amp;"; break;
+            case '<': esc += "&lt;"; break;
+            case '>': esc += "&gt;"; break;
+            case '"': esc += "&quot;"; break;
+            default: esc += c;
+        }
+    }
+
+    return esc;
+}
+
+/* FUNCTION: basename
+ *
+ * DESCRIPTION: File name without the directory and extension
+ *
+ * INPUT:
+ * @path: The file path
+ *
+ * OUTPUT:
+ * @name: The base name
+ */
+static std::string_view basename(std::string_view path)
+{
+    auto slash = path.find_last_of('/');
+
+    if (slash != std::string_view::npos)
+        path.remove_prefix(slash + 1);
+
+    auto dot = path.find_last_of('.');
+
+    if (dot != std::string_view::npos && dot > 0)
+        path.remove_suffix(path.size() - dot);
+
+    return path;
+}
+
+/* FUNCTION: writeTSV
+ *
+ * DESCRIPTION: Write the PSMs of a .psmb file in the
+ *              -outfmt=tsv format (in the file order)
+ *
+ * INPUT:
+ * @rd : The .psmb file
+ * @out: The output stream
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID writeTSV(const reader &rd, std::ofstream &out)
+{
+    std::vector<char_t> line(LINE_SIZE);
+
+    for (ull_t b = 0; b < rd.numblocks(); b++)
+    {
+        auto specids = rd.column<uint_t>(b, SPECID);
+        auto fileids = rd.column<ushort_t>(b, FILEID);
+        auto charges = rd.column<uchar_t>(b, CHARGE);
+        auto pmasses = rd.column<float_t>(b, PMASS);
+        auto rtimes = rd.column<float_t>(b, RTIME);
+        auto pepids = rd.column<uint_t>(b, PEPID);
+        auto shared = rd.column<ushort_t>(b, SHARED);
+        auto total = rd.column<ushort_t>(b, TOTAL);
+        auto hyperscores = rd.column<float_t>(b, HYPERSCORE);
+        auto evalues = rd.column<double_t>(b, EVALUE);
+        auto nhits = rd.column<uint_t>(b, NHITS);
+        auto ranks = rd.column<ushort_t>(b, RANK);
+
+        for (uint_t r = 0; r < rd.rows(b); r++)
+        {
+            auto file = rd.file(fileids[r]);
+            auto pep = rd.peptide(pepids[r]);
+            float_t mass = rd.mass(pepids[r]);
+
+            // long file names or peptides
+            if (file.size() + pep.size() + KBYTES(1) > line.size())
+                line.resize(file.size() + pep.size() + KBYTES(1));
+
+            char_t *ptr = line.data();
+            char_t *end = ptr + line.size();
+
+            ptr = put(ptr, end, file.data(), file.size());
+            *ptr++ = '\t';
+            ptr = put(ptr, end, specids[r] + 1);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, pmasses[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, (int_t) charges[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, rtimes[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, pep.data(), pep.size());
+            *ptr++ = '\t';
+            ptr = put(ptr, end, shared[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, total[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, mass);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, (float_t) (pmasses[r] - mass));
+            *ptr++ = '\t';
+            *ptr++ = '\t';
+            ptr = put(ptr, end, hyperscores[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, evalues[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, nhits[r]);
+            *ptr++ = '\t';
+            ptr = put(ptr, end, (uint_t) ranks[r]);
+            *ptr++ = '\n';
+
+            out.write(line.data(), ptr - line.data());
+        }
+    }
+}
+
+/* FUNCTION: writePepXML
+ *
+ * DESCRIPTION: Write the PSMs of .psmb files in the pepXML
+ *              format: a run summary per query file with
+ *              the PSMs of each spectrum in rank order
+ *
+ * INPUT:
+ * @rds : The .psmb files
+ * @out : The output stream
+ * @name: The output file name
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID writePepXML(const std::vector<const reader *> &rds, std::ofstream &out, const string_t &name)
+{
+    std::vector<psmrow> rows;
+
+    for (auto rd : rds)
+    {
+        for (ull_t b = 0; b < rd->numblocks(); b++)
+        {
+            auto specids = rd->column<uint_t>(b, SPECID);
+            auto fileids = rd->column<ushort_t>(b, FILEID);
+            auto ranks = rd->column<ushort_t>(b, RANK);
+
+            for (uint_t r = 0; r < rd->rows(b); r++)
+                rows.push_back({rd, b, r, specids[r], ranks[r], rd->file(fileids[r])});
+        }
+    }
+
+    // group by query file and spectrum
+    std::sort(rows.begin(), rows.end(), [](const psmrow &a, const psmrow &b)
+    {
+        if (a.file != b.file)
+            return a.file < b.file;
+        if (a.specid != b.specid)
+            return a.specid < b.specid;
+
+        return a.rank < b.rank;
+    });
+
+    char_t date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<msms_pipeline_analysis date=\"" << date << "\" xmlns=\"http://regis-web.systemsbiology.net/pepXML\" summary_xml=\""
+        << escape(name) << "\">\n";
+
+    char_t num[64];
+    auto fmt = [&num](auto val) { return string_t(num, put(num, num + sizeof(num), val)); };
+
+    // e-values are mostly below the fixed point precision
+    auto sci = [&num](double_t val) { return string_t(num, std::snprintf(num, sizeof(num), "%.6e", val)); };
+
+    uint_t index = 1;
+
+    for (size_t i = 0; i < rows.size();)
+    {
+        auto file = rows[i].file;
+        auto base = escape(basename(file));
+
+        out << " <msms_run_summary base_name=\"" << base << "\" raw_data_type=\"raw\" raw_data=\"" << escape(file) << "\">\n"
+            << "  <search_summary base_name=\"" << base << "\" search_engine=\"HiCOPS\" precursor_mass_type=\"monoisotopic\""
+            << " fragment_mass_type=\"monoisotopic\" search_id=\"1\"/>\n";
+
+        for (; i < rows.size() && rows[i].file == file;)
+        {
+            auto &psm = rows[i];
+            auto rd = psm.rd;
+            auto r = psm.row;
+
+            auto scan = psm.specid + 1;
+            int_t charge = rd->column<uchar_t>(psm.blk, CHARGE)[r];
+            // the precursor is [M+H]+ and the retention time in minutes
+            float_t pmass = rd->column<float_t>(psm.blk, PMASS)[r] - PROTON;
+            float_t rtime = rd->column<float_t>(psm.blk, RTIME)[r] * 60;
+
+            out << "  <spectrum_query spectrum=\"" << base << '.' << scan << '.' << scan << '.' << charge
+                << "\" start_scan=\"" << scan << "\" end_scan=\"" << scan << "\" precursor_neutral_mass=\"" << fmt(pmass)
+                << "\" assumed_charge=\"" << charge << "\" index=\"" << index++ << "\" retention_time_sec=\"" << fmt(rtime) << "\">\n"
+                << "   <search_result>\n";
+
+            // the PSMs of this spectrum
+            for (; i < rows.size() && rows[i].file == file && rows[i].specid == psm.specid; i++)
+            {
+                auto &hit = rows[i];
+                auto b = hit.blk;
+                auto h = hit.row;
+                auto pepid = hit.rd->column<uint_t>(b, PEPID)[h];
+                float_t mass = hit.rd->mass(pepid);
+
+                out << "    <search_hit hit_rank=\"" << hit.rank << "\" peptide=\"" << hit.rd->peptide(pepid)
+                    << "\" protein=\"\" num_tot_proteins=\"0\" num_matched_ions=\"" << hit.rd->column<ushort_t>(b, SHARED)[h]
+                    << "\" tot_num_ions=\"" << hit.rd->column<ushort_t>(b, TOTAL)[h] << "\" calc_neutral_pep_mass=\"" << fmt(mass)
+                    << "\" massdiff=\"" << fmt(pmass - mass) << "\">\n"
+                    << "     <search_score name=\"hyperscore\" value=\"" << fmt(hit.rd->column<float_t>(b, HYPERSCORE)[h]) << "\"/>\n"
+                    << "     <search_score name=\"expect\" value=\"" << sci(hit.rd->column<double_t>(b, EVALUE)[h]) << "\"/>\n"
+                    << "    </search_hit>\n";
+            }
+
+            out << "   </search_result>\n"
+                << "  </spectrum_query>\n";
+        }
+
+        out << " </msms_run_summary>\n";
+    }
+
+    out << "</msms_pipeline_analysis>\n";
+}
+
+/* FUNCTION: writeHeader
+ *
+ * DESCRIPTION: Write the -outfmt=tsv header line
+ *
+ * INPUT:
+ * @out: The output stream
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID writeHeader(std::ofstream &out)
+{
+    out << "file\t" << "scan_num\t" << "prec_mass\t" << "charge\t"
+        << "retention_time\t" << "peptide\t" << "matched_ions\t"
+        << "total_ions\t" << "calc_pep_mass\t" << "mass_diff\t"
+        << "mod_info\t" << "hyperscore\t" << "expectscore\t"
+        << "num_hits\t" << "rank" << '\n';
+}
+
+status_t main(int_t argc, char_t* argv[])
+{
+    string_t format = "tsv";
+    string_t output;
+    std::vector<string_t> inputs;
+
+    for (int_t i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "-f") && i + 1 < argc)
+            format = argv[++i];
+        else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+            output = argv[++i];
+        else
+            inputs.push_back(argv[i]);
+    }
+
+    if (inputs.empty() || (format != "tsv" && format != "pepxml"))
+    {
+        std::fprintf(stderr, "usage: %s [-f tsv|pepxml] [-o output] files.psmb ...\n", argv[0]);
+        return ERR_INVLD_PARAM;
+    }
+
+    bool_t tsv = (format == "tsv");
+    string_t ext = tsv ? ".tsv" : ".pep.xml";
+
+    std::vector<std::unique_ptr<reader>> rds;
+
+    for (auto &input : inputs)
+    {
+        rds.emplace_back(new reader);
+
+        if (!rds.back()->open(input))
+        {
+            std::fprintf(stderr, "error: %s is not a valid .psmb file\n", input.c_str());
+            return ERR_FILE_NOT_FOUND;
+        }
+    }
+
+    std::ofstream out;
+
+    // merge all inputs into the output
+    if (!output.empty())
+    {
+        out.open(output, std::ios::out | std::ios::binary);
+
+        if (!out.is_open())
+        {
+            std::fprintf(stderr, "error: can not open %s\n", output.c_str());
+            return ERR_FILE_NOT_FOUND;
+        }
+
+        if (tsv)
+        {
+            writeHeader(out);
+
+            for (auto &rd : rds)
+                writeTSV(*rd, out);
+        }
+        else
+        {
+            std::vector<const reader *> all;
+
+            for (auto &rd : rds)
+                all.push_back(rd.get());
+
+            writePepXML(all, out, output);
+        }
+
+        return SLM_SUCCESS;
+    }
+
+    // convert each input
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        string_t name = inputs[i];
+
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".psmb") == 0)
+            name.resize(name.size() - 5);
+
+        name += ext;
+
+        out.open(name, std::ios::out | std::ios::binary);
+
+        if (!out.is_open())
+        {
+            std::fprintf(stderr, "error: can not open %s\n", name.c_str());
+            return ERR_FILE_NOT_FOUND;
+        }
+
+        if (tsv)
+        {
+            writeHeader(out);
+            writeTSV(*rds[i], out);
+        }
+        else
+            writePepXML({rds[i].get()}, out, name);
+
+        out.close();
+    }
+
+    return SLM_SUCCESS;
+}
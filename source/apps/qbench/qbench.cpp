@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "lwqueue.h"
+#include "lfqueue.h"
+
+//
+// Contention microbenchmark of the batch buffer queue backends: the
+// semaphore queue (lwqueue) and the lock-free ring (lfqueue). Every
+// pair of 1, 2, 4, ... maxthreads producers and consumers moves the
+// same number of items through a queue of the given capacity (rounded
+// up to a power of two) using the non-blocking push/pop (yielding when
+// full or empty).
+//
+// usage: qbench [items = 1048576] [capacity = 20] [maxthreads = 128]
+//
+
+/* FUNCTION: run
+ *
+ * DESCRIPTION: Move items through a queue with
+ *              the given producers and consumers
+ *
+ * INPUT:
+ * @q        : The queue
+ * @items    : Number of items to move
+ * @producers: Number of producer threads
+ * @consumers: Number of consumer threads
+ *
+ * OUTPUT:
+ * @mops: Million items per second (negative if items were lost)
+ */
+template <class Q>
+static double_t run(Q &q, ull_t items, int_t producers, int_t consumers)
+{
+    std::atomic<ull_t> popped(0);
+    std::atomic<ull_t> sum(0);
+    std::atomic<bool_t> go(false);
+
+    std::vector<std::thread> threads;
+
+    for (int_t p = 0; p < producers; p++)
+    {
+        threads.push_back(std::thread([&, p]()
+        {
+            while (!go)
+                sched_yield();
+
+            // items p, p + producers, ... (1 based)
+            for (ull_t i = p + 1; i <= items; i += producers)
+                while (q.push((ull_t *) i) == ISFULL)
+                    sched_yield();
+        }));
+    }
+
+    for (int_t c = 0; c < consumers; c++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            ull_t *item = nullptr;
+            ull_t lsum = 0;
+
+            while (!go)
+                sched_yield();
+
+            while (popped.load(std::memory_order_relaxed) < items)
+            {
+                if (q.pop(item) == SLM_SUCCESS)
+                {
+                    lsum += (ull_t) item;
+                    popped++;
+                }
+                else
+                    sched_yield();
+            }
+
+            sum += lsum;
+        }));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    go = true;
+
+    for (auto &th : threads)
+        th.join();
+
+    std::chrono::duration<double_t> elapsed = std::chrono::steady_clock::now() - start;
+
+    // every item popped exactly once
+    if (sum != items * (items + 1) / 2)
+        return -1;
+
+    return (items / 1e6) / elapsed.count();
+}
+
+status_t main(int_t argc, char_t* argv[])
+{
+    ull_t items = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : (1 << 20);
+    int_t capacity = (argc > 2) ? std::atoi(argv[2]) : 20;
+    int_t maxthreads = (argc > 3) ? std::atoi(argv[3]) : 128;
+
+    if (items < 1 || capacity < 1 || maxthreads < 1)
+    {
+        std::fprintf(stderr, "usage: %s [items] [capacity] [maxthreads]\n", argv[0]);
+        return ERR_INVLD_PARAM;
+    }
+
+    /* lfqueue rounds the capacity up to a power of two, use the same for both */
+    int_t ring = 2;
+
+    while (ring < capacity)
+        ring <<= 1;
+
+    capacity = ring;
+
+    std::printf("items: %llu, capacity: %d, hardware threads: %u\n\n", items, capacity, std::thread::hardware_concurrency());
+    std::printf("%10s %10s %16s %16s %10s\n", "producers", "consumers", "lwqueue (Mop/s)", "lfqueue (Mop/s)", "speedup");
+
+    status_t status = SLM_SUCCESS;
+
+    for (int_t producers = 1; producers <= maxthreads; producers *= 2)
+    {
+        for (int_t consumers = 1; consumers <= maxthreads; consumers *= 2)
+        {
+            lwqueue<ull_t *> semq(capacity, true);
+            lfqueue<ull_t *> lfq(capacity);
+
+            double_t semrate = run(semq, items, producers, consumers);
+            double_t lfrate = run(lfq, items, producers, consumers);
+
+            if (semrate < 0 || lfrate < 0)
+            {
+                std::fprintf(stderr, "error: items lost with %d producers and %d consumers\n", producers, consumers);
+                status = ERR_INVLD_SIZE;
+            }
+
+            std::printf("%10d %10d %16.3f %16.3f %9.2fx\n", producers, consumers, semrate, lfrate, lfrate / semrate);
+        }
+    }
+
+    return status;
+}
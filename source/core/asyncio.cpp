@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include "asyncio.hpp"
+
+#if defined (USE_IOURING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif // USE_IOURING
+
+/* Threads doing the reads if io_uring is not available */
+#define ASYNCIO_MAXTHREADS              4
+
+/* Largest single read request */
+#define ASYNCIO_MAXREAD                 (1u << 30)
+
+namespace hcp
+{
+namespace io
+{
+
+asyncreader::asyncreader(uint_t depth) : inflight(0), ringfd(-1), sqring(nullptr), cqring(nullptr), sqes(nullptr),
+                                         sqringsz(0), cqringsz(0), sqessz(0), tosubmit(0), exitSignal(false)
+{
+    depth = std::max(depth, 1u);
+
+    slots.resize(depth);
+    freeslots.resize(depth);
+    std::iota(freeslots.rbegin(), freeslots.rend(), 0);
+
+#if defined (USE_IOURING)
+    // io_uring may be unavailable (old kernels, seccomp)
+    if (!setupring(depth))
+        closering();
+#endif // USE_IOURING
+
+    if (ringfd < 0)
+    {
+        auto nthreads = std::min(depth, (uint_t) ASYNCIO_MAXTHREADS);
+
+        for (uint_t t = 0; t < nthreads; t++)
+            pool.push_back(std::thread(&asyncreader::worker, this));
+    }
+}
+
+asyncreader::~asyncreader()
+{
+    if (ringfd >= 0)
+        closering();
+    else
+    {
+        {
+            std::unique_lock<std::mutex> lock(poollock);
+            exitSignal = true;
+        }
+
+        todocv.notify_all();
+
+        for (auto &th : pool)
+            th.join();
+
+        pool.clear();
+    }
+}
+
+/*
+ * FUNCTION: setupring
+ *
+ * DESCRIPTION: Create an io_uring with depth entries and map
+ *              its submission and completion rings
+ *
+ * INPUT:
+ * @depth: Number of ring entries
+ *
+ * OUTPUT:
+ * @ok: true if the ring supports the read operation
+ */
+bool_t asyncreader::setupring(uint_t depth)
+{
+#if defined (USE_IOURING)
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    ringfd = syscall(__NR_io_uring_setup, depth, &p);
+
+    if (ringfd < 0)
+        return false;
+
+    // IORING_OP_READ needs Linux 5.6+
+    const int_t nops = IORING_OP_READ + 1;
+    std::vector<char_t> pbuf(sizeof(struct io_uring_probe) + nops * sizeof(struct io_uring_probe_op), 0);
+    auto probe = (struct io_uring_probe *) pbuf.data();
+
+    if (syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_PROBE, probe, nops) < 0 ||
+        probe->last_op < IORING_OP_READ || !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED))
+        return false;
+
+    sqringsz = p.sq_off.array + p.sq_entries * sizeof(uint_t);
+    cqringsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    bool_t single = p.features & IORING_FEAT_SINGLE_MMAP;
+
+    if (single)
+        sqringsz = cqringsz = std::max(sqringsz, cqringsz);
+
+    sqring = mmap(NULL, sqringsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+
+    if (sqring == MAP_FAILED)
+    {
+        sqring = nullptr;
+        return false;
+    }
+
+    if (single)
+        cqring = sqring;
+    else
+    {
+        cqring = mmap(NULL, cqringsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+
+        if (cqring == MAP_FAILED)
+        {
+            cqring = nullptr;
+            return false;
+        }
+    }
+
+    sqessz = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqessz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED)
+    {
+        sqes = nullptr;
+        return false;
+    }
+
+    char_t *sq = (char_t *) sqring;
+    char_t *cq = (char_t *) cqring;
+
+    sqhead  = (uint_t *) (sq + p.sq_off.head);
+    sqtail  = (uint_t *) (sq + p.sq_off.tail);
+    sqmask  = (uint_t *) (sq + p.sq_off.ring_mask);
+    sqarray = (uint_t *) (sq + p.sq_off.array);
+    cqhead  = (uint_t *) (cq + p.cq_off.head);
+    cqtail  = (uint_t *) (cq + p.cq_off.tail);
+    cqmask  = (uint_t *) (cq + p.cq_off.ring_mask);
+    cqes    = cq + p.cq_off.cqes;
+
+    return true;
+#else
+    UNUSED_PARAM(depth);
+    return false;
+#endif // USE_IOURING
+}
+
+VOID asyncreader::closering()
+{
+#if defined (USE_IOURING)
+    if (sqes != nullptr)
+        munmap(sqes, sqessz);
+
+    if (cqring != nullptr && cqring != sqring)
+        munmap(cqring, cqringsz);
+
+    if (sqring != nullptr)
+        munmap(sqring, sqringsz);
+
+    if (ringfd >= 0)
+        close(ringfd);
+#endif // USE_IOURING
+
+    sqes = sqring = cqring = nullptr;
+    ringfd = -1;
+}
+
+bool_t asyncreader::submit(int_t fd, VOID *buf, size_t len, ull_t off, ull_t tag)
+{
+    if (freeslots.empty())
+        return false;
+
+    int_t slot = freeslots.back();
+    freeslots.pop_back();
+
+    slots[slot] = request{fd, (char_t *) buf, len, off, 0, tag};
+    inflight++;
+
+    enqueue(slot);
+
+    return true;
+}
+
+//
+// queue the remaining part of a slot's read
+//
+VOID asyncreader::enqueue(int_t slot)
+{
+#if defined (USE_IOURING)
+    if (ringfd >= 0)
+    {
+        auto &r = slots[slot];
+
+        // single producer: only this thread writes the tail
+        uint_t tail = *sqtail;
+        uint_t idx = tail & *sqmask;
+
+        auto sqe = &((struct io_uring_sqe *) sqes)[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode    = IORING_OP_READ;
+        sqe->fd        = r.fd;
+        sqe->addr      = (ull_t) (r.buf + r.done);
+        sqe->len       = std::min(r.len - r.done, (size_t) ASYNCIO_MAXREAD);
+        sqe->off       = r.off + r.done;
+        sqe->user_data = slot;
+
+        sqarray[idx] = idx;
+        __atomic_store_n(sqtail, tail + 1, __ATOMIC_RELEASE);
+        tosubmit++;
+
+        int_t ret = syscall(__NR_io_uring_enter, ringfd, tosubmit, 0, 0, NULL, 0);
+
+        // unsubmitted entries are retried while reaping
+        if (ret > 0)
+            tosubmit -= ret;
+
+        return;
+    }
+#endif // USE_IOURING
+
+    {
+        std::unique_lock<std::mutex> lock(poollock);
+        todo.push_back(slot);
+    }
+
+    todocv.notify_one();
+}
+
+//
+// wait for the next completion (of a full or partial read)
+//
+bool_t asyncreader::reap(int_t &slot, ssize_t &res)
+{
+#if defined (USE_IOURING)
+    if (ringfd >= 0)
+    {
+        for (;;)
+        {
+            uint_t head = *cqhead;
+
+            if (head != __atomic_load_n(cqtail, __ATOMIC_ACQUIRE))
+            {
+                auto cqe = &((struct io_uring_cqe *) cqes)[head & *cqmask];
+
+                slot = cqe->user_data;
+                res = cqe->res;
+
+                __atomic_store_n(cqhead, head + 1, __ATOMIC_RELEASE);
+
+                return true;
+            }
+
+            int_t ret = syscall(__NR_io_uring_enter, ringfd, tosubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+            if (ret >= 0)
+                tosubmit -= ret;
+            else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                return false;
+        }
+    }
+#endif // USE_IOURING
+
+    std::unique_lock<std::mutex> lock(poollock);
+    donecv.wait(lock, [this] { return !completed.empty(); });
+
+    slot = completed.front().first;
+    res = completed.front().second;
+    completed.pop_front();
+
+    return true;
+}
+
+bool_t asyncreader::wait(ull_t &tag, ssize_t &res)
+{
+    while (inflight > 0)
+    {
+        int_t slot;
+
+        if (!reap(slot, res))
+            return false;
+
+        auto &r = slots[slot];
+
+        if (res > 0)
+        {
+            r.done += res;
+
+            // short read: read the rest
+            if (r.done < r.len)
+            {
+                enqueue(slot);
+                continue;
+            }
+
+            res = r.len;
+        }
+        // end of file before len bytes
+        else if (res == 0)
+            res = (r.done == r.len) ? (ssize_t) r.len : -EIO;
+
+        tag = r.tag;
+
+        inflight--;
+        freeslots.push_back(slot);
+
+        return true;
+    }
+
+    return false;
+}
+
+//
+// thread pool worker: blocking preads
+//
+VOID asyncreader::worker()
+{
+    for (;;)
+    {
+        int_t slot;
+
+        {
+            std::unique_lock<std::mutex> lock(poollock);
+            todocv.wait(lock, [this] { return exitSignal || !todo.empty(); });
+
+            if (todo.empty())
+                return;
+
+            slot = todo.front();
+            todo.pop_front();
+        }
+
+        // the slot is not touched by the submitter until completed
+        auto &r = slots[slot];
+        ssize_t res;
+
+        do
+        {
+            res = pread(r.fd, r.buf + r.done, r.len - r.done, r.off + r.done);
+        } while (res < 0 && errno == EINTR);
+
+        if (res < 0)
+            res = -errno;
+
+        {
+            std::unique_lock<std::mutex> lock(poollock);
+            completed.push_back(std::make_pair(slot, res));
+        }
+
+        donecv.notify_one();
+    }
+}
+
+} // namespace io
+} // namespace hcp
@@ -64,8 +64,9 @@ namespace s2
 //
 void preprocess(MSQuery *query, string_t &filename, int fileindex)
 {
-    // Read and preprocess the input MS2 data.
-    if (params.filetype == gParams::FileType_t::PBIN)
+    // Read and preprocess the input MS2 data. MGF and mzML
+    // files are preprocessed on the CPU
+    if (params.filetype == gParams::FileType_t::PBIN && hcp::ms2::getformat(filename) == hcp::ms2::format_t::MS2)
     {
         // local variables
         int maxlen = 0;
@@ -435,9 +436,6 @@ std::array<int, 2> readAndPreprocess(string_t &filename)
     int_t specsize = 0;
     int_t m_idx = 0;
 
-    char_t *Zsave;
-    char_t *Isave;
-
     // host data vectors
     spectype_t * mzs = nullptr;
     spectype_t *intns = nullptr;
@@ -459,21 +457,18 @@ std::array<int, 2> readAndPreprocess(string_t &filename)
     float *prec_mz = rtimes + BATCHSIZE;
     int *z = new int[BATCHSIZE];
 
-    /* Get a new ifstream object and open file */
-    ifstream *qqfile = new ifstream(filename);
+    /* Open the file for block reads */
+    hcp::ms2::linereader qqfile(filename);
 
     /* Check if file opened */
-    if (qqfile->is_open())
+    if (qqfile.is_open())
     {
-        string_t line;
+        std::string_view line;
         bool isFirst = true;
 
         /* While we still have lines in MS2 file */
-        while (!qqfile->eof())
+        while (qqfile.getline(line))
         {
-            /* Read one line */
-            getline(*qqfile, line);
-
             if (line.empty() || line[0] == 'H' || line[0] == 'D')
             {
                 continue;
@@ -514,78 +509,40 @@ std::array<int, 2> readAndPreprocess(string_t &filename)
             }
             else if (line[0] == 'Z')
             {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Zsave);
-                mh = strtok_r(NULL, " \t", &Zsave);
-                string_t val = "1";
-
-                if (mh != NULL)
-                    val = string_t(mh);
+                hcp::ms2::token(line);
 
-                z[count] = MAX(1, std::atoi(val.c_str()));
+                int_t charge = hcp::ms2::tonum<int_t>(hcp::ms2::token(line), 1);
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &Zsave);
-
-                if (mh != NULL)
-                    val = string_t(mh);
-
-                prec_mz[count] = std::atof(val.c_str());
+                z[count] = MAX(1, charge);
+                prec_mz[count] = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
             }
             else if (line[0] == 'I')
             {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
+                hcp::ms2::token(line);
 
-                if (mh != NULL)
+                if (hcp::ms2::token(line) == "RTime")
                 {
-                    val = string_t(mh);
-                }
-
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
-
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
-
-                    rtimes[count] = MAX(0.0, std::atof(val.c_str()));
+                    double_t rtime = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.0);
+                    rtimes[count] = MAX(0.0, rtime);
                 }
             }
             /* MS/MS data: [m/z] [int] */
             else
             {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
-
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &Zsave);
-                char_t *intn1 = strtok_r(NULL, " ", &Zsave);
-                string_t mz = "0.01";
-                string_t intn = "0.01";
-
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
-
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
+                /* Split line into two DOUBLEs */
+                double_t mz = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+                double_t intn = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
 
                 // integrize the values if spectype_t is int
                 if constexpr (std::is_same<int, spectype_t>::value)
                 {
-                    mzs[m_idx] = std::atof(mz.c_str()) * params.scale;
-                    intns[m_idx] = std::atof(intn.c_str()) * YAXISMULTIPLIER;
+                    mzs[m_idx] = mz * params.scale;
+                    intns[m_idx] = intn * YAXISMULTIPLIER;
                 }
                 else
                 {
-                    mzs[m_idx] = std::atof(mz.c_str());
-                    intns[m_idx] = std::atof(intn.c_str());
+                    mzs[m_idx] = mz;
+                    intns[m_idx] = intn;
                 }
 
                 // increment the spectrum size & m_idx (cumulative spectrum size)
@@ -608,14 +565,9 @@ std::array<int, 2> readAndPreprocess(string_t &filename)
         hcp::gpu::cuda::s2::ArraySort(intns, mzs, lens, m_idx, count, largestspec_loc, m_intns, m_mzs);
 
         // flush the last batch to the binary file
-        MSQuery::flushBinaryFile(&filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count, true);
+        MSQuery::flushBinaryFile(&filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count, true, largestspec);
 
         // no need to reset count and m_idx here
-
-        /* Close the file */
-        qqfile->close();
-
-        delete qqfile;
     }
     else
         std::cout << "Error: Unable to open file: " << filename << std::endl;
@@ -816,28 +816,43 @@ __host__ void processResults(double *h_data, float *h_hyp, int *h_cpsms, double
 status_t DSLIM_Score::GPUCombineResults()
 {
     status_t status = SLM_SUCCESS;
-    string_t fn;
 
     /* Each node sent its sample */
     const int_t nSamples = params.nodes;
-    auto startSpec= 0;
     ifstream *fhs = NULL;
     ebuffer  *iBuffs = NULL;
 
+    /* Partial results of the batch from each node */
+    std::vector<ebuffer *> sBuffs(nSamples, nullptr);
+
     if (this->myRXsize > 0)
     {
         fhs = new ifstream[nSamples];
         iBuffs = new ebuffer[nSamples];
     }
 
-    auto vbatch = params.myid;
+    /* Offsets of my batches in TxValues */
+    std::vector<int_t> startSpecs(this->nBatches + 1, 0);
+
+    for (auto batchNum = 0; batchNum < this->nBatches; batchNum++)
+        startSpecs[batchNum + 1] = startSpecs[batchNum] + sizeArray[batchNum];
 
-    for (auto batchNum = 0; batchNum < this->nBatches; batchNum++, vbatch += nSamples)
+    /* Combine the batches as their partials land */
+    for (auto done = 0; done < this->nBatches; done++)
     {
 #if defined (PROGRESS)
         if (params.myid == 0)
-            std::cout << "\rDONE:\t\t" << (batchNum * 100) /this->nBatches << "%";
+            std::cout << "\rDONE:\t\t" << (done * 100) /this->nBatches << "%";
 #endif // PROGRESS
+        auto batchNum = NextBatch(done);
+
+        if (batchNum < 0 || batchNum >= this->nBatches)
+        {
+            status = ERR_INVLD_SIZE;
+            break;
+        }
+
+        auto startSpec = startSpecs[batchNum];
 
         auto bSize = sizeArray[batchNum];
 
@@ -852,29 +867,9 @@ status_t DSLIM_Score::GPUCombineResults()
         hcp::gpu::cuda::error_check(hcp::gpu::cuda::host_pinned_allocate(h_hyp, bSize));
         hcp::gpu::cuda::error_check(hcp::gpu::cuda::host_pinned_allocate(h_evalues, bSize));
 
-        // read data from .dat files
+        // get the partial results (in memory or spilled to .dat files)
         for (int_t saa = 0; saa < nSamples; saa++)
-        {
-            fn = params.workspace + "/" + std::to_string(vbatch) + "_"
-                    + std::to_string(saa) + ".dat";
-
-            fhs[saa].open(fn, ios::in | ios::binary);
-
-            if (fhs[saa].is_open())
-            {
-                fhs[saa].read((char_t *)iBuffs[saa].packs, bSize * sizeof(partRes));
-                fhs[saa].read(iBuffs[saa].ibuff, bSize * Xsamples * sizeof(ushort_t));
-
-                if (fhs[saa].fail())
-                {
-                    status = ERR_FILE_NOT_FOUND;
-                    std::cout << "FATAL: File Read Failed" << std::endl;
-                    exit(status);
-                }
-            }
-
-            fn.clear();
-        }
+            sBuffs[saa] = ReadPartials(batchNum, saa, iBuffs + saa, fhs[saa]);
 
 #ifdef USE_OMP
 #pragma omp parallel for schedule (dynamic, 4) num_threads(params.threads)
@@ -901,7 +896,7 @@ status_t DSLIM_Score::GPUCombineResults()
             for (int_t sno = 0; sno < nSamples; sno++)
             {
                 /* Pointer to Result sample */
-                partRes *sResult = iBuffs[sno].packs + spec;
+                partRes *sResult = sBuffs[sno]->packs + spec;
 
                 if (*sResult == 0)
                     continue;
@@ -913,8 +908,8 @@ status_t DSLIM_Score::GPUCombineResults()
                 if (sResult->N >= 1)
                 {
                     /* Reconstruct the partial histogram */
-                    // expPtr->Reconstruct(&iBuffs[sno], spec, sResult);
-                    expPtr->Reconstruct(&iBuffs[sno], spec, sResult, &h_data[spec * expeRT::SIZE]);
+                    // expPtr->Reconstruct(sBuffs[sno], spec, sResult);
+                    expPtr->Reconstruct(sBuffs[sno], spec, sResult, &h_data[spec * expeRT::SIZE]);
 
                     /* Record the maxhypscore and its key */
                     if (sResult->max > 0 && sResult->max > h_cpsms[spec])
@@ -950,7 +945,7 @@ status_t DSLIM_Score::GPUCombineResults()
                 /* If the scores are good enough */
                 if (e_x < params.expect_max)
                 {
-                    partRes *ssResult = iBuffs[h_keys[spec]].packs + spec;
+                    partRes *ssResult = sBuffs[h_keys[spec]]->packs + spec;
 
                     psm->eValue = e_x * 1e6;
                     psm->specID = ssResult-> qID;
@@ -985,23 +980,9 @@ status_t DSLIM_Score::GPUCombineResults()
             }
         }
 
-        /* Update the counters */
-        startSpec += sizeArray[batchNum];
-
-        /* Remove the files when no longer needed */
+        /* Release the partials (remove the files) when no longer needed */
         for (int_t saa = 0; saa < nSamples; saa++)
-        {
-            fn = params.workspace + "/" + std::to_string(vbatch) + "_" + std::to_string(saa)
-                    + ".dat";
-
-            if (fhs[saa].is_open())
-            {
-                fhs[saa].close();
-                std::remove((const char_t *) fn.c_str());
-            }
-
-            fn.clear();
-        }
+            ReleasePartials(batchNum, saa, fhs[saa]);
     }
 
     if (this->myRXsize > 0)
@@ -18,6 +18,8 @@
  */
 
 #include "dslim.h"
+#include "dslim_cache.h"
+#include "ionenc.h"
 #include "cuda/superstep1/kernel.hpp"
 #include "cuda/superstep3/kernel.hpp"
 
@@ -25,12 +27,18 @@
 using namespace std;
 
 /* Global Variables */
-uint_t          *SpecArr = NULL; /* Spectra Array     */
+uint_t          *BinOffs = NULL; /* Per-thread bin offsets */
 BYICount      *Score   = NULL;
 uint_t reduce = 0;
 
 extern gParams params;
 
+/* Static function Prototypes */
+static inline VOID DSLIM_GenerateIons(Index *index, uint_t pepID, uint_t *Spectrum, uint_t speclen);
+static inline VOID DSLIM_InitializeResults(Results *res);
+
+template <class ionenc_t>
+static status_t DSLIM_ScatterIons(uint_t threads, Index *index, uint_t chunk_number, const ionenc_t &enc);
 
 /* FUNCTION: DSLIM_Construct
  *
@@ -47,26 +55,23 @@ status_t DSLIM_Construct(Index *index)
 {
     status_t status = SLM_SUCCESS;
 
-
     uint_t threads = params.threads;
-    uint_t maxz = params.maxz;
-    uint_t peplen_1 = index->pepIndex.peplen - 1;
 
-    double_t maxmass = params.max_mass;
-    uint_t scale = params.scale;
+    // the GPU kernels decode the ion IDs by division
+    index->ionenc = (params.useGPU)? IonEnc_t::divide : IonEnc_t::shiftmask;
 
-    // allocate memory to temporarily store the fragment ion data
-    if (status == SLM_SUCCESS && SpecArr == NULL
+    // allocate memory to store the per-thread bin offsets
+    if (status == SLM_SUCCESS && BinOffs == NULL
 #if defined (USE_GPU)
     && !params.useGPU
 #endif
 )
     {
-        /* Spectra Array (SA) */
-        SpecArr = new uint_t[MAX_IONS];
+        /* Bin Offsets: threads x (maxmass * scale) */
+        BinOffs = new uint_t[(ull_t) threads * params.max_mass * params.scale];
 
-        /* Check if Spectra Array has been allocated */
-        if (SpecArr == NULL)
+        /* Check if Bin Offsets have been allocated */
+        if (BinOffs == NULL)
             status = ERR_BAD_MEM_ALLOC;
     }
 
@@ -90,7 +95,7 @@ status_t DSLIM_Construct(Index *index)
                 else
 #endif // defined(USE_GPU)
                 {
-                    /* Construct each DSLIM chunk in Parallel */
+                    /* Count the ions per bin and construct DSLIM.bA */
                     status = DSLIM_ConstructChunk(threads, index, chno);
 
                     /* Apply SLM-Transform on the chunk */
@@ -101,54 +106,63 @@ status_t DSLIM_Construct(Index *index)
         }
     }
 
+    /* Construct the precursor mass directory */
+    if (status == SLM_SUCCESS)
+        status = DSLIM_ConstructMassDir(index);
+
+    return status;
+}
+
+status_t DSLIM_ConstructMassDir(Index *index)
+{
+    status_t status = SLM_SUCCESS;
+    const uint_t npeps = index->lcltotCnt;
+
+    /* Nothing to do for an empty index */
+    if (npeps == 0)
+        return status;
 
-    // construct bA on the CPU
-    if (status == SLM_SUCCESS && !params.useGPU)
+    index->pepMass = new float_t[npeps];
+
+    if (index->pepMass == NULL)
+        status = ERR_BAD_MEM_ALLOC;
+
+    if (status == SLM_SUCCESS)
     {
-        const uint_t speclen = peplen_1 * maxz * iSERIES;
+        float_t *mass = index->pepMass;
 
-        /* Construct DSLIM.bA */
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#pragma omp parallel for num_threads(params.threads) schedule(static)
 #endif /* USE_OMP */
-        for (uint_t chunk_number = 0; chunk_number < index->nChunks; chunk_number++)
-        {
-            uint_t *bAPtr = index->ionIndex[chunk_number].bA;
+        for (uint_t i = 0; i < npeps; i++)
+            mass[i] = index->pepEntries[i].Mass;
 
-            /* Get size of the chunk */
-            uint_t csize = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1)) ?
-                           index->lastchunksize                                 :
-                           index->chunksize;
+        /* One entry per integer Dalton + the end */
+        int_t lo = (int_t) std::floor(mass[0]);
+        int_t hi = (int_t) std::floor(mass[npeps - 1]);
+        uint_t dirsize = hi - lo + 2;
 
-            uint_t count = bAPtr[0];
+        index->massLo = lo;
+        index->massDir = new uint_t[dirsize];
 
-            /* Initialize first and last bA entries */
-            bAPtr[0] = 0;
+        if (index->massDir == NULL)
+            status = ERR_BAD_MEM_ALLOC;
 
-            for (uint_t li = 1; li <= (uint_t)(maxmass * scale); li++)
-            {
-                uint_t tmpcount = bAPtr[li];
-                bAPtr[li] = bAPtr[li - 1] + count;
-                count = tmpcount;
-            }
+        if (status == SLM_SUCCESS)
+        {
+            /* First peptide with mass >= lo + d */
+            uint_t pep = 0;
 
-            /* Check if all correctly done */
-            if (bAPtr[(int_t)(maxmass * scale)] != (csize * speclen))
+            for (uint_t d = 0; d < dirsize; d++)
             {
-                status = ERR_INVLD_SIZE;
-            }
+                while (pep < npeps && mass[pep] < (float_t)(lo + (int_t) d))
+                    pep++;
 
-            assert (bAPtr[(int_t)(maxmass * scale)] == (csize * speclen));
+                index->massDir[d] = pep;
+            }
         }
     }
 
-    // stablize the iA data
-    if (status == SLM_SUCCESS && !params.useGPU)
-    {
-        for (uint_t chunk_number = 0; chunk_number < index->nChunks; chunk_number++)
-            status = DSLIM_Optimize(index, chunk_number);
-    }
-
     return status;
 }
 
@@ -218,9 +232,74 @@ status_t DSLIM_AllocateMemory(Index *index)
     return status;
 }
 
+/*
+ * FUNCTION: DSLIM_GenerateIons
+ *
+ * DESCRIPTION: Generate the (bin) fragment ions of a peptide.
+ *              Ions of illegal peptides are all placed in bin 0.
+ *
+ * INPUT:
+ * @index   : The SLM Index
+ * @pepID   : Peptide ID in the index
+ * @Spectrum: Array to fill the ions in
+ * @speclen : Number of ions per peptide
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_GenerateIons(Index *index, uint_t pepID, uint_t *Spectrum, uint_t speclen)
+{
+    const uint_t peplen = index->pepIndex.peplen;
+    const uint_t maxbin = params.max_mass * params.scale;
+
+    /* Extract from pepEntries */
+    pepEntry *entry = index->pepEntries + pepID;
+
+    char_t *seq = &index->pepIndex.seqs[entry->seqID * peplen];
+
+    float_t pepMass = 0.0;
+
+    /* Check if pepID belongs to peps or mods */
+    if (entry->sites.modNum == 0)
+    {
+        /* Generate the Theoretical Spectrum */
+        pepMass = UTILS_GenerateSpectrum(seq, peplen, Spectrum);
+    }
+    else
+    {
+        /* Generate the Mod. Theoretical Spectrum */
+        pepMass = UTILS_GenerateModSpectrum(seq, peplen, Spectrum, entry->sites);
+    }
+
+    /* If a legal peptide */
+    if (pepMass >= params.min_mass && pepMass <= params.max_mass)
+    {
+        /* Clamp the ions to the last bin */
+        for (uint_t ion = 0; ion < speclen; ion++)
+        {
+            if (Spectrum[ion] >= maxbin)
+                Spectrum[ion] = maxbin - 1;
+        }
+    }
+
+    /* Illegal peptide, fill in the container with zeros */
+    else
+    {
+        /* Fill zeros for illegal peptides
+         * FIXME: Should not be filled into the chunk
+         *  and be removed from peptide index as well
+         */
+        std::memset(Spectrum, 0x0, sizeof(uint_t) * speclen);
+    }
+}
+
 /*
  * FUNCTION: DSLIM_ConstructChunk
  *
+ * DESCRIPTION: Count the ions per bin in each thread's
+ *              slice of peptides and construct DSLIM.bA.
+ *              The per-thread bin offsets for the SLM
+ *              transform are left in BinOffs
+ *
  * INPUT:
  * @threads:      Number of parallel threads
  * @chunk_number: Chunk Index
@@ -231,140 +310,109 @@ status_t DSLIM_AllocateMemory(Index *index)
 status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
 {
     status_t status = SLM_SUCCESS;
-    const uint_t peplen_1 = index->pepIndex.peplen - 1;
-    const uint_t peplen   = index->pepIndex.peplen;
-    const uint_t speclen  = params.maxz * iSERIES * peplen_1;
+    const uint_t speclen  = params.maxz * iSERIES * (index->pepIndex.peplen - 1);
+    const uint_t nbins    = params.max_mass * params.scale;
 
-    const double_t minmass = params.min_mass;
-    const double_t maxmass = params.max_mass;
-    const uint_t scale = params.scale;
+    uint_t *bA = index->ionIndex[chunk_number].bA;
 
     /* Check if this chunk is the last chunk */
     bool lastChunk = (chunk_number == (index->nChunks - 1))? true: false;
 
-    uint_t *BAPtrs[threads];
-    uint_t *bA = new uint_t[(int_t)(threads * scale * maxmass)];
+    uint_t start_idx = chunk_number * index->chunksize;
+    uint_t interval = index->chunksize;
 
+    /* Check for last chunk */
+    if (lastChunk == true && index->nChunks > 1)
+        interval = index->lastchunksize;
+
+    /* Count the ions in each thread's contiguous slice of peptides */
 #ifdef USE_OMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif /* USE_OMP */
+    for (uint_t thd = 0; thd < threads; thd++)
+    {
+        uint_t *counts = BinOffs + (ull_t) thd * nbins;
 
-    for (uint_t i = 0; i < threads; i++)
-        BAPtrs[i] = bA + (int_t)(i * scale * maxmass);
+        uint_t beg = start_idx + (uint_t)(((ull_t) interval * thd) / threads);
+        uint_t end = start_idx + (uint_t)(((ull_t) interval * (thd + 1)) / threads);
 
-        /* Clear the bAPtrs and SAPtrs */
-#pragma omp parallel for num_threads(threads) schedule (static)
-    for (uint_t i = 0; i < threads; i++)
-        std::memset(BAPtrs[i], 0x0, (scale * maxmass * sizeof(uint_t)));
-#else
+        /* Temporary Array needed for Theoretical Spectra */
+        uint_t *Spectrum = new uint_t[speclen];
 
-    std::memset(index->ionIndex[chunk_number].bA, 0x0, (((params.scale * params.max_mass) + 1) * sizeof(uint_t)));
+        std::memset(counts, 0x0, nbins * sizeof(uint_t));
 
-#endif /* USE_OMP */
+        for (uint_t k = beg; k < end; k++)
+        {
+            DSLIM_GenerateIons(index, k, Spectrum, speclen);
 
-    if (status == SLM_SUCCESS)
-    {
-        uint_t start_idx = chunk_number * index->chunksize;
-        uint_t interval = index->chunksize;
+            for (uint_t ion = 0; ion < speclen; ion++)
+                counts[Spectrum[ion]]++;
+        }
 
-        /* Check for last chunk */
-        if (lastChunk == true && index->nChunks > 1)
-            interval = index->lastchunksize;
+        delete[] Spectrum;
+    }
 
+    /* Bin sizes */
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#pragma omp parallel for num_threads(threads) schedule (static)
 #endif /* USE_OMP */
-        for (uint_t k = start_idx; k < (start_idx + interval); k++)
-        {
-            /* Filling point */
-            uint_t nfilled = (k - start_idx) * speclen;
-
-            /* Temporary Array needed for Theoretical Spectra */
-            uint_t* Spectrum = new uint_t[speclen];
+    for (uint_t bin = 0; bin < nbins; bin++)
+    {
+        uint_t count = 0;
 
-#ifdef USE_OMP
-            uint_t *bAPtr  = BAPtrs[omp_get_thread_num()];
-#else
-            uint_t *bAPtr = index->ionIndex[chunk_number].bA;
-#endif /* OPENMP */
+        for (uint_t thd = 0; thd < threads; thd++)
+            count += BinOffs[(ull_t) thd * nbins + bin];
 
-            /* Extract peptide Information */
-            float_t pepMass = 0.0;
-            char_t *seq = NULL;
-            uint_t pepID = k;
+        bA[bin] = count;
+    }
 
-            /* Extract from pepEntries */
-            pepEntry *entry = index->pepEntries + pepID;
+    /* Construct DSLIM.bA as exclusive prefix sum */
+    uint_t count = 0;
 
-            seq = &index->pepIndex.seqs[entry->seqID * peplen];
+    for (uint_t bin = 0; bin < nbins; bin++)
+    {
+        uint_t tmpcount = bA[bin];
+        bA[bin] = count;
+        count += tmpcount;
+    }
 
-            /* Check if pepID belongs to peps or mods */
-            if (entry->sites.modNum == 0)
-            {
-                /* Generate the Theoretical Spectrum */
-                pepMass = UTILS_GenerateSpectrum(seq, peplen, Spectrum);
-            }
-            else
-            {
-                /* Generate the Mod. Theoretical Spectrum */
-                pepMass = UTILS_GenerateModSpectrum(seq, (uint_t) peplen, Spectrum, entry->sites);
-            }
+    bA[nbins] = count;
 
-            /* If a legal peptide */
-            if (pepMass >= minmass && pepMass <= maxmass)
-            {
-                /* Fill the ions */
-                for (uint_t ion = 0; ion < speclen; ion++)
-                {
-                    /* Check if legal ion */
-                    if (Spectrum[ion] >= (maxmass * scale))
-                    {
-                        Spectrum[ion] = (maxmass * scale) - 1;
-                        //assert (Spectrum[ion] < (maxmass * scale));
-                    }
-
-                    SpecArr[nfilled + ion] = Spectrum[ion]; // Fill in the ion
-                    bAPtr[Spectrum[ion]]++; // Update the bA counter
-                }
-            }
+    /* Check if all correctly done */
+    if (bA[nbins] != (interval * speclen))
+        status = ERR_INVLD_SIZE;
 
-            /* Illegal peptide, fill in the container with zeros */
-            else
-            {
-                /* Fill zeros for illegal peptides
-                 * FIXME: Should not be filled into the chunk
-                 *  and be removed from peptide index as well
-                 */
-                std::memset(&SpecArr[nfilled], 0x0, sizeof(uint_t) * speclen);
-                bAPtr[0] += speclen; // Update the BA counter
-            }
-        }
+    assert (bA[nbins] == (interval * speclen));
 
+    /* Per-thread write offsets in each bin such that lower
+     * peptide slices are placed first in every bin */
+    if (status == SLM_SUCCESS)
+    {
 #ifdef USE_OMP
 #pragma omp parallel for num_threads(threads) schedule (static)
-        for (uint_t i = 0; i < (uint_t)(maxmass * scale); i++)
+#endif /* USE_OMP */
+        for (uint_t bin = 0; bin < nbins; bin++)
         {
-            /* Initialize to zero */
-            index->ionIndex[chunk_number].bA[i] = 0;
-
-            for (uint_t j = 0; j < threads; j++)
-                index->ionIndex[chunk_number].bA[i] += BAPtrs[j][i];
+            uint_t offset = bA[bin];
 
+            for (uint_t thd = 0; thd < threads; thd++)
+            {
+                uint_t tmpcount = BinOffs[(ull_t) thd * nbins + bin];
+                BinOffs[(ull_t) thd * nbins + bin] = offset;
+                offset += tmpcount;
+            }
         }
-#endif /* USE_OMP */
-
     }
 
-#ifdef USE_OMP
-    delete[] bA;
-    bA = NULL;
-#endif /* OPENMP */
-
     return status;
 }
 
 /*
  * FUNCTION: DSLIM_SLMTransform
  *
- * DESCRIPTION: Constructs SLIM Transform
+ * DESCRIPTION: Constructs SLIM Transform by scattering the
+ *              ion IDs directly into their (stable) DSLIM.iA
+ *              slots using the offsets from DSLIM_ConstructChunk
  *
  * INPUT:
  * @threads     : Number of parallel threads
@@ -374,33 +422,94 @@ status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
  * @status: Status of execution
  */
 status_t DSLIM_SLMTransform(uint_t threads, Index *index, uint_t chunk_number)
+{
+    const uint_t peplen = index->pepIndex.peplen;
+
+    if (index->ionenc == IonEnc_t::shiftmask)
+        return DSLIM_ScatterIons(threads, index, chunk_number, hcp::dslim::shiftenc(peplen, params.maxz));
+    else
+        return DSLIM_ScatterIons(threads, index, chunk_number, hcp::dslim::divenc(peplen, params.maxz));
+}
+
+/*
+ * FUNCTION: DSLIM_ScatterIons
+ *
+ * DESCRIPTION: Scatter the encoded ion IDs into DSLIM.iA
+ *
+ * INPUT:
+ * @threads     : Number of parallel threads
+ * @chunk_number: Chunk Index
+ * @enc         : Ion ID encoding
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+template <class ionenc_t>
+static status_t DSLIM_ScatterIons(uint_t threads, Index *index, uint_t chunk_number, const ionenc_t &enc)
 {
     status_t status = SLM_SUCCESS;
 
+    const uint_t speclen = (index->pepIndex.peplen - 1) * params.maxz * iSERIES;
+    const uint_t nbins   = params.max_mass * params.scale;
+
     /* Check if this chunk is the last chunk */
-    uint_t size = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1))?
-                   index->lastchunksize : index->chunksize;
+    uint_t interval = ((chunk_number == index->nChunks - 1) && (index->nChunks > 1))?
+                       index->lastchunksize : index->chunksize;
 
-    uint_t speclen = (index->pepIndex.peplen - 1) * params.maxz * iSERIES;
+    uint_t start_idx = chunk_number * index->chunksize;
     uint_t *iAPtr = index->ionIndex[chunk_number].iA;
-    uint_t iAsize = size * speclen;
 
+    /* Same slices as in DSLIM_ConstructChunk */
 #ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(static)
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
 #endif /* USE_OMP */
-    for (uint_t k = 0; k < iAsize; k++)
-        iAPtr[k] = k;
+    for (uint_t thd = 0; thd < threads; thd++)
+    {
+        uint_t *offsets = BinOffs + (ull_t) thd * nbins;
 
-#ifdef USE_OMP
-    /* Parallel Key Value Sort */
-    KeyVal_Parallel<uint_t>(SpecArr, iAPtr, iAsize, threads);
-#else
-    KeyVal_Serial<uint_t>(SpecArr, iAPtr, iAsize);
-#endif /* USE_OMP */
+        uint_t beg = start_idx + (uint_t)(((ull_t) interval * thd) / threads);
+        uint_t end = start_idx + (uint_t)(((ull_t) interval * (thd + 1)) / threads);
+
+        /* Temporary Array needed for Theoretical Spectra */
+        uint_t *Spectrum = new uint_t[speclen];
+
+        for (uint_t k = beg; k < end; k++)
+        {
+            DSLIM_GenerateIons(index, k, Spectrum, speclen);
+
+            /* The encoding is increasing in ion slots so
+             * every bin stays sorted in ascending order */
+            for (uint_t ion = 0; ion < speclen; ion++)
+                iAPtr[offsets[Spectrum[ion]]++] = enc.encode(k - start_idx, ion);
+        }
+
+        delete[] Spectrum;
+    }
 
     return status;
 }
 
+/*
+ * FUNCTION: DSLIM_InitializeResults
+ *
+ * DESCRIPTION: Allocate the histogram and the top PSM heap
+ *
+ * INPUT:
+ * @res: Results to initialize
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_InitializeResults(Results *res)
+{
+    /* Initialize the histogram */
+    res->survival = new double_t[1 + (MAX_HYPERSCORE * 10) + 1]; // +2 for accumulation
+
+    std::memset(res->survival, 0x0, sizeof (double_t) * (2 + MAX_HYPERSCORE * 10));
+
+    /* Keep the top PSMs to report (at least 1) */
+    res->topK.init(params.topmatches);
+}
+
 status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs)
 {
     status_t status = SLM_SUCCESS;
@@ -428,20 +537,32 @@ status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs)
 #endif /* USE_OMP */
         for (uint_t thd = 0; thd < params.threads; thd++)
         {
-            Score[thd].byc = new BYC[sAize];
-            memset(Score[thd].byc, 0x0, sizeof(BYC) * sAize);
-
-            /* Initialize the histogram */
-            Score[thd].res.survival = new double_t[1 + (MAX_HYPERSCORE * 10) + 1]; // +2 for accumulation
-
-            /* Evaluate to the nearest power of 2 */
-            uint_t num = (params.topmatches == 0)? 1: params.topmatches;
-            num = (uint_t)(floor(log2(num) + 0.999));
-
-            std::memset(Score[thd].res.survival, 0x0, sizeof (double_t) * (2 + MAX_HYPERSCORE * 10));
+            /* Counts and intensities in separate arrays */
+            Score[thd].bc = new ushort_t[sAize];
+            Score[thd].yc = new ushort_t[sAize];
+            Score[thd].ibc = new uint_t[sAize];
+            Score[thd].iyc = new uint_t[sAize];
+
+            memset(Score[thd].bc, 0x0, sizeof(ushort_t) * sAize);
+            memset(Score[thd].yc, 0x0, sizeof(ushort_t) * sAize);
+            memset(Score[thd].ibc, 0x0, sizeof(uint_t) * sAize);
+            memset(Score[thd].iyc, 0x0, sizeof(uint_t) * sAize);
+
+            /* List of touched scorecard entries (sparse mode) */
+            if (params.spwindow)
+                Score[thd].touched = new uint_t[sAize];
+
+            /* Initialize the results */
+            DSLIM_InitializeResults(&Score[thd].res);
+
+            /* Results for each spectrum in a tile */
+            if (params.qtile > 1)
+            {
+                Score[thd].tres = new Results[params.qtile];
 
-            /* Initialize the heap with size = pow(2, num) - 1 */
-            Score[thd].res.topK.init((1 << num) - 1);
+                for (uint_t tq = 0; tq < params.qtile; tq++)
+                    DSLIM_InitializeResults(Score[thd].tres + tq);
+            }
         }
     }
     else
@@ -458,51 +579,6 @@ status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs)
     return status;
 }
 
-/*
- * FUNCTION: DSLIM_Optimize
- *
- * DESCRIPTION: Optimization of the index
- *
- * INPUT:
- * @threads     : Number of parallel threads
- * @index       : The SLM Index
- * @chunk_number: Chunk Index
- *
- * OUTPUT:
- * @status: Status of execution
- */
-status_t DSLIM_Optimize(Index *index, uint_t chunk_number)
-{
-    status_t status = SLM_SUCCESS;
-
-    uint_t *iAPtr = index->ionIndex[chunk_number].iA;
-    uint_t *bAPtr = index->ionIndex[chunk_number].bA;
-
-#ifdef USE_OMP
-    uint_t interval = 50 *params.scale;
-    uint_t threads = params.threads;
-#endif /* USE_OMP */
-
-#ifdef USE_OMP
-#pragma omp parallel for num_threads(threads) schedule(dynamic, interval)
-#endif /* USE_OMP */
-    /* Stablize the entries in iAPtr */
-    for (uint_t kk = 0; kk < (params.max_mass * params.scale); kk++)
-    {
-        uint_t offset = bAPtr[kk];
-        uint_t size = bAPtr[kk + 1] - offset;
-
-        if (size > 1)
-        {
-            /* Stablize the KeyVal Sort */
-            UTILS_Sort<uint_t>((iAPtr + offset), size, false);
-        }
-
-    }
-
-    return status;
-}
-
 /*
  * FUNCTION: DSLIM_Analyze
  *
@@ -678,8 +754,9 @@ status_t DSLIM_Deinitialize(Index *index)
 
 status_t DSLIM_DeallocateIonIndex(Index *index)
 {
-    /* Deallocate all the DSLIM chunks */
-    for (uint_t chno = 0; chno < index->nChunks; chno++)
+    /* Deallocate all the DSLIM chunks (unless
+     * memory mapped from the index cache) */
+    for (uint_t chno = 0; chno < index->nChunks && index->idxmap == NULL; chno++)
     {
         spmat_t curr_chunk = index->ionIndex[chno];
 
@@ -714,6 +791,10 @@ status_t DSLIM_DeallocateIonIndex(Index *index)
 
 status_t DSLIM_DeallocatePepIndex(Index *index)
 {
+    /* Unmap the index if loaded from the index cache */
+    if (index->idxmap != NULL)
+        DSLIM_UnmapIndex(index);
+
     if (index->pepEntries != NULL)
     {
         delete[] index->pepEntries;
@@ -726,6 +807,19 @@ status_t DSLIM_DeallocatePepIndex(Index *index)
         index->pepIndex.seqs = NULL;
     }
 
+    /* The mass directory is never memory mapped */
+    if (index->pepMass != NULL)
+    {
+        delete[] index->pepMass;
+        index->pepMass = NULL;
+    }
+
+    if (index->massDir != NULL)
+    {
+        delete[] index->massDir;
+        index->massDir = NULL;
+    }
+
     /* Reset peptide Index Variables */
     index->pepCount = 0;
     index->modCount = 0;
@@ -754,11 +848,11 @@ status_t DSLIM_DeallocateSpecArr()
     else
 #endif // defined(USE_GPU)
     {
-        // free SpecArr on CPU
-        if (SpecArr != nullptr)
+        // free the bin offsets on CPU
+        if (BinOffs != nullptr)
         {
-            delete[] SpecArr;
-            SpecArr= nullptr;
+            delete[] BinOffs;
+            BinOffs = nullptr;
         }
     }
 
@@ -784,14 +878,39 @@ status_t DSLIM_DeallocateSC()
     {
         for (uint_t thd = 0; thd < params.threads; thd++)
         {
-            if (Score[thd].byc)
-                delete[] Score[thd].byc;
+            if (Score[thd].bc)
+                delete[] Score[thd].bc;
+
+            if (Score[thd].yc)
+                delete[] Score[thd].yc;
+
+            if (Score[thd].ibc)
+                delete[] Score[thd].ibc;
+
+            if (Score[thd].iyc)
+                delete[] Score[thd].iyc;
 
             if (Score[thd].res.survival)
                 delete[] Score[thd].res.survival;
 
-            Score[thd].byc = NULL;
+            if (Score[thd].tres)
+            {
+                for (uint_t tq = 0; tq < params.qtile; tq++)
+                    delete[] Score[thd].tres[tq].survival;
+
+                delete[] Score[thd].tres;
+            }
+
+            if (Score[thd].touched)
+                delete[] Score[thd].touched;
+
+            Score[thd].bc = NULL;
+            Score[thd].yc = NULL;
+            Score[thd].ibc = NULL;
+            Score[thd].iyc = NULL;
+            Score[thd].touched = NULL;
             Score[thd].res.survival = NULL;
+            Score[thd].tres = NULL;
         }
 
         delete[] Score;
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sstream>
+#include "dslim_cache.h"
+#include "lbe.h"
+
+using namespace std;
+
+extern gParams params;
+
+/* Static function Prototypes */
+static status_t DSLIM_IndexHeader(string_t &dbfile, uint_t peplen, IndexHeader &hdr);
+static ull_t    DSLIM_IndexLayout(const IndexHeader &hdr, vector<ull_t> &offsets);
+static string_t DSLIM_IndexFileName(const IndexHeader &hdr);
+
+/* 64-bit FNV-1a hash */
+static inline VOID DSLIM_HashBytes(ull_t &hash, const VOID *data, size_t len)
+{
+    const uchar_t *bytes = (const uchar_t *) data;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+template <typename T>
+static inline VOID DSLIM_HashVal(ull_t &hash, const T &val)
+{
+    DSLIM_HashBytes(hash, &val, sizeof(T));
+}
+
+static inline ull_t DSLIM_Align(ull_t offset)
+{
+    return (offset + IDXCACHE_ALIGN - 1) & ~((ull_t) IDXCACHE_ALIGN - 1);
+}
+
+/*
+ * FUNCTION: DSLIM_IndexHeader
+ *
+ * DESCRIPTION: Fill the expected index header (key and
+ *              settings) for the database file
+ *
+ * INPUT:
+ * @dbfile: Path to the database (.peps) file
+ * @peplen: Peptide length
+ * @hdr   : Header to fill
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static status_t DSLIM_IndexHeader(string_t &dbfile, uint_t peplen, IndexHeader &hdr)
+{
+    status_t status = SLM_SUCCESS;
+    struct stat st;
+
+    std::memset(&hdr, 0x0, sizeof(IndexHeader));
+
+    if (stat(dbfile.c_str(), &st) != 0)
+        status = ERR_FILE_NOT_FOUND;
+
+    if (status == SLM_SUCCESS)
+    {
+        std::strncpy(hdr.magic, IDXCACHE_MAGIC, sizeof(hdr.magic));
+        hdr.version  = IDXCACHE_VERSION;
+        hdr.hdrsize  = sizeof(IndexHeader);
+
+        hdr.dbsize   = (ull_t) st.st_size;
+        hdr.dbmtime  = (ull_t) st.st_mtim.tv_sec * 1000000000ULL + (ull_t) st.st_mtim.tv_nsec;
+
+        hdr.peplen   = peplen;
+        hdr.maxz     = params.maxz;
+        hdr.scale    = params.scale;
+        hdr.min_mass = params.min_mass;
+        hdr.max_mass = params.max_mass;
+        hdr.nodes    = params.nodes;
+        hdr.myid     = params.myid;
+        hdr.policy   = (uint_t) params.policy;
+        hdr.iseries  = iSERIES;
+        hdr.maxions  = MAX_IONS;
+        hdr.ionenc   = (uint_t) ((params.useGPU)? IonEnc_t::divide : IonEnc_t::shiftmask);
+
+        /* Hash all settings that change the index contents */
+        ull_t key = 0xcbf29ce484222325ULL;
+
+        DSLIM_HashBytes(key, &hdr, sizeof(IndexHeader));
+        DSLIM_HashBytes(key, params.modconditions.c_str(), params.modconditions.length());
+
+        DSLIM_HashVal(key, params.vModInfo.vmods_per_pep);
+        DSLIM_HashVal(key, params.vModInfo.num_vars);
+
+        for (uint_t i = 0; i < params.vModInfo.num_vars; i++)
+        {
+            DSLIM_HashBytes(key, params.vModInfo.vmods[i].residues, sizeof(params.vModInfo.vmods[i].residues));
+            DSLIM_HashVal(key, params.vModInfo.vmods[i].modMass);
+            DSLIM_HashVal(key, params.vModInfo.vmods[i].aa_per_peptide);
+        }
+
+        /* Layout of stored structures */
+        DSLIM_HashVal(key, sizeof(pepEntry));
+        DSLIM_HashVal(key, sizeof(AA));
+
+        hdr.key = key;
+    }
+
+    return status;
+}
+
+/*
+ * FUNCTION: DSLIM_IndexLayout
+ *
+ * DESCRIPTION: Compute the section offsets in the index file
+ *
+ * INPUT:
+ * @hdr    : Index header with index sizes
+ * @offsets: Offsets of seqs, pepEntries, {bA, iA} x nChunks
+ *
+ * OUTPUT:
+ * @size: Total file size in bytes
+ */
+static ull_t DSLIM_IndexLayout(const IndexHeader &hdr, vector<ull_t> &offsets)
+{
+    const ull_t speclen = (hdr.peplen - 1) * hdr.maxz * hdr.iseries;
+    const ull_t bAsize = ((ull_t) hdr.max_mass * hdr.scale) + 1;
+
+    ull_t offset = DSLIM_Align(sizeof(IndexHeader));
+
+    offsets.clear();
+
+    /* Peptide sequences */
+    offsets.push_back(offset);
+    offset = DSLIM_Align(offset + (ull_t) hdr.AAs * sizeof(AA));
+
+    /* Peptide entries */
+    offsets.push_back(offset);
+    offset = DSLIM_Align(offset + (ull_t) hdr.lcltotCnt * sizeof(pepEntry));
+
+    /* Ion index chunks */
+    for (uint_t chno = 0; chno < hdr.nChunks; chno++)
+    {
+        ull_t csize = ((chno == hdr.nChunks - 1) && (hdr.nChunks > 1)) ?
+                      hdr.lastchunksize : hdr.chunksize;
+
+        offsets.push_back(offset);
+        offset = DSLIM_Align(offset + bAsize * sizeof(uint_t));
+
+        offsets.push_back(offset);
+        offset = DSLIM_Align(offset + csize * speclen * sizeof(uint_t));
+    }
+
+    return offset;
+}
+
+static string_t DSLIM_IndexFileName(const IndexHeader &hdr)
+{
+    std::stringstream fname;
+
+    fname << params.idxcache << "/" << hdr.peplen << "_"
+          << std::hex << std::setw(16) << std::setfill('0') << hdr.key << ".hidx";
+
+    return fname.str();
+}
+
+status_t DSLIM_LoadIndex(string_t &dbfile, Index *index)
+{
+    status_t status = SLM_SUCCESS;
+    IndexHeader expected;
+    vector<ull_t> offsets;
+    struct stat st;
+    int_t fd = -1;
+    VOID *base = MAP_FAILED;
+
+    /* Index cache not enabled or index
+     * constructed on the GPU device */
+    if (params.idxcache.empty() || params.useGPU)
+        return ERR_INVLD_PARAM;
+
+    status = DSLIM_IndexHeader(dbfile, index->pepIndex.peplen, expected);
+
+    string_t fname = DSLIM_IndexFileName(expected);
+
+    if (status == SLM_SUCCESS)
+    {
+        fd = open(fname.c_str(), O_RDONLY);
+
+        if (fd < 0 || fstat(fd, &st) != 0 || (ull_t) st.st_size < sizeof(IndexHeader))
+            status = ERR_FILE_NOT_FOUND;
+    }
+
+    if (status == SLM_SUCCESS)
+    {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (base == MAP_FAILED)
+            status = ERR_FILE_ERROR;
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    if (fd >= 0)
+        close(fd);
+
+    const IndexHeader *hdr = (const IndexHeader *) base;
+
+    /* Validate the header against the current settings */
+    if (status == SLM_SUCCESS)
+    {
+        if (std::memcmp(hdr->magic, expected.magic, sizeof(hdr->magic)) != 0 ||
+            hdr->version  != expected.version  || hdr->hdrsize  != expected.hdrsize  ||
+            hdr->key      != expected.key      || hdr->dbsize   != expected.dbsize   ||
+            hdr->dbmtime  != expected.dbmtime  || hdr->peplen   != expected.peplen   ||
+            hdr->maxz     != expected.maxz     || hdr->scale    != expected.scale    ||
+            hdr->min_mass != expected.min_mass || hdr->max_mass != expected.max_mass ||
+            hdr->nodes    != expected.nodes    || hdr->myid     != expected.myid     ||
+            hdr->policy   != expected.policy   || hdr->iseries  != expected.iseries  ||
+            hdr->maxions  != expected.maxions  || hdr->ionenc   != expected.ionenc   ||
+            hdr->filesize != (ull_t) st.st_size)
+        {
+            status = ERR_INVLD_INDEX;
+        }
+    }
+
+    /* Validate the section sizes */
+    if (status == SLM_SUCCESS && DSLIM_IndexLayout(*hdr, offsets) != hdr->filesize)
+        status = ERR_INVLD_SIZE;
+
+    /* The chunking depends on threads and scratch pad memory,
+     * so re-distribute and check if the stored chunks still apply */
+    if (status == SLM_SUCCESS)
+    {
+        Index dist;
+        dist.pepIndex.peplen = hdr->peplen;
+        dist.lcltotCnt = hdr->lcltotCnt;
+
+        status = LBE_Distribute(&dist);
+
+        if (status == SLM_SUCCESS && (dist.nChunks != hdr->nChunks     ||
+                                      dist.chunksize != hdr->chunksize ||
+                                      dist.lastchunksize != hdr->lastchunksize))
+        {
+            status = ERR_INVLD_SIZE;
+        }
+    }
+
+    /* Populate the index from the mapped sections */
+    if (status == SLM_SUCCESS)
+    {
+        index->ionIndex = new spmat_t[hdr->nChunks];
+
+        if (index->ionIndex == NULL)
+            status = ERR_BAD_MEM_ALLOC;
+    }
+
+    if (status == SLM_SUCCESS)
+    {
+        char_t *bytes = (char_t *) base;
+
+        index->pepCount      = hdr->pepCount;
+        index->modCount      = hdr->modCount;
+        index->totalCount    = hdr->totalCount;
+        index->lclpepCnt     = hdr->lclpepCnt;
+        index->lclmodCnt     = hdr->lclmodCnt;
+        index->lcltotCnt     = hdr->lcltotCnt;
+        index->nChunks       = hdr->nChunks;
+        index->chunksize     = hdr->chunksize;
+        index->lastchunksize = hdr->lastchunksize;
+
+        index->ionenc        = (IonEnc_t) hdr->ionenc;
+
+        index->pepIndex.AAs  = hdr->AAs;
+        index->pepIndex.seqs = (AA *) (bytes + offsets[0]);
+        index->pepEntries    = (pepEntry *) (bytes + offsets[1]);
+
+        for (uint_t chno = 0; chno < hdr->nChunks; chno++)
+        {
+            index->ionIndex[chno].bA = (uint_t *) (bytes + offsets[2 + 2 * chno]);
+            index->ionIndex[chno].iA = (uint_t *) (bytes + offsets[3 + 2 * chno]);
+        }
+
+        index->idxmap = base;
+        index->idxmapsize = st.st_size;
+
+        /* Start reading ahead in the background */
+        madvise(base, st.st_size, MADV_WILLNEED);
+
+        /* The mass directory is cheap to rebuild */
+        status = DSLIM_ConstructMassDir(index);
+
+        if (params.myid == 0)
+            std::cout << "Mapped Index          =\t\t" << fname << std::endl << std::endl;
+    }
+    else if (base != MAP_FAILED)
+    {
+        munmap(base, st.st_size);
+    }
+
+    return status;
+}
+
+status_t DSLIM_StoreIndex(string_t &dbfile, Index *index)
+{
+    status_t status = SLM_SUCCESS;
+    IndexHeader hdr;
+    vector<ull_t> offsets;
+
+    /* Index cache not enabled, already stored
+     * or index constructed on the GPU device */
+    if (params.idxcache.empty() || params.useGPU || index->idxmap != NULL)
+        return ERR_INVLD_PARAM;
+
+    status = DSLIM_IndexHeader(dbfile, index->pepIndex.peplen, hdr);
+
+    if (status == SLM_SUCCESS)
+    {
+        hdr.pepCount      = index->pepCount;
+        hdr.modCount      = index->modCount;
+        hdr.totalCount    = index->totalCount;
+        hdr.lclpepCnt     = index->lclpepCnt;
+        hdr.lclmodCnt     = index->lclmodCnt;
+        hdr.lcltotCnt     = index->lcltotCnt;
+        hdr.nChunks       = index->nChunks;
+        hdr.chunksize     = index->chunksize;
+        hdr.lastchunksize = index->lastchunksize;
+        hdr.AAs           = index->pepIndex.AAs;
+
+        hdr.filesize = DSLIM_IndexLayout(hdr, offsets);
+    }
+
+    const string_t fname = DSLIM_IndexFileName(hdr);
+
+    /* Write to a temporary file and rename so that
+     * concurrent readers never see a partial index */
+    const string_t tmpname = fname + ".tmp." + std::to_string(getpid());
+
+    if (status == SLM_SUCCESS)
+    {
+        const ull_t speclen = (hdr.peplen - 1) * hdr.maxz * hdr.iseries;
+        const ull_t bAsize = ((ull_t) hdr.max_mass * hdr.scale) + 1;
+        const char_t zeros[IDXCACHE_ALIGN] = {};
+
+        std::ofstream fh(tmpname, ios::out | ios::binary | ios::trunc);
+
+        auto writeSection = [&](ull_t offset, const VOID *data, ull_t bytes)
+        {
+            ull_t pos = fh.tellp();
+
+            if (offset > pos)
+                fh.write(zeros, offset - pos);
+
+            fh.write((const char_t *) data, bytes);
+        };
+
+        if (fh.is_open())
+        {
+            writeSection(0, &hdr, sizeof(IndexHeader));
+            writeSection(offsets[0], index->pepIndex.seqs, (ull_t) hdr.AAs * sizeof(AA));
+            writeSection(offsets[1], index->pepEntries, (ull_t) hdr.lcltotCnt * sizeof(pepEntry));
+
+            for (uint_t chno = 0; chno < hdr.nChunks; chno++)
+            {
+                ull_t csize = ((chno == hdr.nChunks - 1) && (hdr.nChunks > 1)) ?
+                              hdr.lastchunksize : hdr.chunksize;
+
+                writeSection(offsets[2 + 2 * chno], index->ionIndex[chno].bA, bAsize * sizeof(uint_t));
+                writeSection(offsets[3 + 2 * chno], index->ionIndex[chno].iA, csize * speclen * sizeof(uint_t));
+            }
+
+            writeSection(hdr.filesize, NULL, 0);
+
+            if (fh.fail())
+                status = ERR_FILE_ERROR;
+
+            fh.close();
+        }
+        else
+        {
+            status = ERR_FILE_ERROR;
+        }
+    }
+
+    if (status == SLM_SUCCESS)
+    {
+        if (std::rename(tmpname.c_str(), fname.c_str()) != 0)
+            status = ERR_FILE_ERROR;
+    }
+
+    if (status != SLM_SUCCESS)
+    {
+        std::remove(tmpname.c_str());
+        std::cerr << "WARNING: Could not store the index to: " << fname << std::endl;
+    }
+
+    return status;
+}
+
+status_t DSLIM_UnmapIndex(Index *index)
+{
+    status_t status = SLM_SUCCESS;
+
+    if (index->idxmap != NULL)
+    {
+        if (munmap(index->idxmap, index->idxmapsize) != 0)
+            status = ERR_INVLD_MEMORY;
+
+        index->idxmap = NULL;
+        index->idxmapsize = 0;
+
+        /* All pointers were into the mapping */
+        index->pepIndex.seqs = NULL;
+        index->pepEntries = NULL;
+    }
+
+    return status;
+}
@@ -17,6 +17,8 @@
  *
  */
 
+#include <fstream>
+#include <memory>
 #include "dslim_comm.h"
 
 #ifdef USE_MPI
@@ -24,6 +26,69 @@
 /* Global params */
 extern gParams params;
 
+/*
+ * FUNCTION: DSLIM_PartialsType
+ *
+ * DESCRIPTION: Datatype of a partial result message: the header,
+ *              packs and (encoded) histograms of an ebuffer (at
+ *              absolute addresses, use with MPI_BOTTOM)
+ *
+ * INPUT:
+ * @hdr  : The message header
+ * @ebuff: The ebuffer
+ *
+ * OUTPUT:
+ * @dtype: The committed datatype
+ */
+static MPI_Datatype DSLIM_PartialsType(partHeader *hdr, ebuffer *ebuff)
+{
+    MPI_Datatype dtype;
+
+    int_t lens[3] = {(int_t) sizeof(partHeader), (int_t) (hdr->bsize * sizeof(partRes)), hdr->nbytes};
+    MPI_Aint displs[3];
+
+    MPI_Get_address(hdr, displs + 0);
+    MPI_Get_address(ebuff->packs, displs + 1);
+    MPI_Get_address(ebuff->ibuff, displs + 2);
+
+    MPI_Type_create_hindexed(3, lens, displs, MPI_BYTE, &dtype);
+    MPI_Type_commit(&dtype);
+
+    return dtype;
+}
+
+/*
+ * FUNCTION: DSLIM_ShrinkPartials
+ *
+ * DESCRIPTION: Reallocate the packs and (encoded) histograms
+ *              of an ebuffer to their used size
+ *
+ * INPUT:
+ * @ebuff: The ebuffer
+ * @bsize: Number of spectra in the batch
+ *
+ * OUTPUT: none
+ */
+static VOID DSLIM_ShrinkPartials(ebuffer *ebuff, int_t bsize)
+{
+    partRes *packs = new partRes[bsize];
+    char_t  *ibuff = new char_t[ebuff->currptr];
+
+    std::copy(ebuff->packs, ebuff->packs + bsize, packs);
+    std::memcpy(ibuff, ebuff->ibuff, ebuff->currptr);
+
+    delete[] ebuff->packs;
+    delete[] ebuff->ibuff;
+
+    ebuff->packs = packs;
+    ebuff->ibuff = ibuff;
+}
+
+string_t DSLIM_PartialsFile(int_t batchNum, int_t rank)
+{
+    return params.workspace + "/" + std::to_string(batchNum) + "_" + std::to_string(rank) + ".dat";
+}
+
 DSLIM_Comm::DSLIM_Comm()
 {
     nBatches = RXBUFFERSIZE / (QCHUNK * sizeof(partRes));
@@ -33,6 +98,12 @@ DSLIM_Comm::DSLIM_Comm()
 
     nBatches = 0;
     myRXsize = 0;
+
+    maxBatches = 0;
+    partials = NULL;
+    pmemory = 0;
+    arrivals = NULL;
+    readyQ = NULL;
 }
 
 DSLIM_Comm::DSLIM_Comm(int_t tbatches)
@@ -51,17 +122,48 @@ DSLIM_Comm::DSLIM_Comm(int_t tbatches)
         sizeArray = new int_t[nBatches];
     }
 
+    maxBatches = nBatches;
+
+    /* Slots for the partial results of my batches */
+    partials = new ebuffer *[maxBatches * nodes];
+
+    for (int_t kk = 0; kk < maxBatches * (int_t) nodes; kk++)
+        partials[kk] = NULL;
+
+    pmemory = 0;
+
+    arrivals = new std::atomic<int_t>[maxBatches];
+
+    for (int_t kk = 0; kk < maxBatches; kk++)
+        arrivals[kk] = 0;
+
+    readyQ = new mpmcqueue<int_t>(std::max(maxBatches, 1), true);
+
     nBatches = 0;
     myRXsize = 0;
+
+    /* Receive the partial results while searching */
+    rx_thd = std::thread(&DSLIM_Comm::RXPartials, this);
 }
 
 DSLIM_Comm::~DSLIM_Comm()
 {
+    /* Borrowed by DSLIM_Score */
     fileArray = NULL;
     sizeArray = NULL;
+    partials = NULL;
+
+    Wait4Partials();
+
+    delete[] arrivals;
+    arrivals = NULL;
+
+    delete readyQ;
+    readyQ = NULL;
 
     nBatches = 0;
     myRXsize = 0;
+    maxBatches = 0;
 }
 
 status_t DSLIM_Comm::AddBatch(int_t batchNum, int_t batchSize, int_t fileID)
@@ -82,4 +184,221 @@ status_t DSLIM_Comm::AddBatch(int_t batchNum, int_t batchSize, int_t fileID)
     return SLM_SUCCESS;
 }
 
+/*
+ * FUNCTION: AddPartials
+ *
+ * DESCRIPTION: Send the partial results of a searched batch
+ *              to the node that combines it (or keep them if
+ *              it is mine). Takes the ownership of ebuff
+ *
+ * INPUT:
+ * @ebuff: Partial results of a batch
+ *
+ * OUTPUT:
+ * @status: status of execution
+ */
+status_t DSLIM_Comm::AddPartials(ebuffer *ebuff)
+{
+    status_t status = SLM_SUCCESS;
+
+    int_t owner = ebuff->batchNum % params.nodes;
+    int_t bsize = ebuff->currptr / (Xsamples * sizeof(ushort_t));
+
+    /* Encode the histograms before they are sent or kept */
+    expeRT::Encode(ebuff, bsize, params.partcodec);
+
+    if (owner == (int_t) params.myid)
+    {
+        DSLIM_ShrinkPartials(ebuff, bsize);
+        return StorePartials(ebuff, params.myid, bsize);
+    }
+
+    partHeader hdr = {ebuff->batchNum, bsize, ebuff->codec, ebuff->currptr};
+
+    MPI_Datatype dtype = DSLIM_PartialsType(&hdr, ebuff);
+
+    /* Blocks until ebuff can be released */
+    status = MPI_Send(MPI_BOTTOM, 1, dtype, owner, PARTIALS_TAG, MPI_COMM_WORLD);
+
+    MPI_Type_free(&dtype);
+
+    delete ebuff;
+
+    return status;
+}
+
+/*
+ * FUNCTION: StorePartials
+ *
+ * DESCRIPTION: Keep the partial results of my batch from a
+ *              node in memory, or spill them to the workspace
+ *              if they do not fit in params.partmem
+ *
+ * INPUT:
+ * @ebuff: Partial results of a batch
+ * @rank : The node that searched them
+ * @bsize: Number of spectra in the batch
+ *
+ * OUTPUT:
+ * @status: status of execution
+ */
+status_t DSLIM_Comm::StorePartials(ebuffer *ebuff, int_t rank, int_t bsize)
+{
+    status_t status = SLM_SUCCESS;
+
+    int_t position = ebuff->batchNum / (int_t) params.nodes;
+
+    if (position >= maxBatches)
+    {
+        delete ebuff;
+        return ERR_INVLD_SIZE;
+    }
+
+    /* Memory held by the ebuffer (exactly sized) */
+    ull_t bytes = bsize * sizeof(partRes) + ebuff->currptr;
+
+    if (pmemory.fetch_add(bytes) + bytes <= (ull_t) MBYTES((ull_t) params.partmem))
+        partials[position * params.nodes + rank] = ebuff;
+    else
+    {
+        pmemory -= bytes;
+
+        /* Out of memory: spill to the workspace */
+        partHeader hdr = {ebuff->batchNum, bsize, ebuff->codec, ebuff->currptr};
+
+        std::ofstream fh(DSLIM_PartialsFile(ebuff->batchNum, rank), std::ios::out | std::ios::binary);
+
+        fh.write((char_t *) &hdr, sizeof(partHeader));
+        fh.write((char_t *) ebuff->packs, bsize * sizeof(partRes));
+        fh.write(ebuff->ibuff, ebuff->currptr * sizeof(char_t));
+        fh.close();
+
+        if (fh.fail())
+            status = ERR_FILE_NOT_FOUND;
+
+        delete ebuff;
+    }
+
+    /* The batch can be combined once all nodes' partials landed */
+    if (++arrivals[position] == (int_t) params.nodes)
+        readyQ->push(position);
+
+    return status;
+}
+
+/*
+ * FUNCTION: RXPartials
+ *
+ * DESCRIPTION: Receive the partial results of my batches from
+ *              all other nodes (thread entry)
+ *
+ * INPUT: none
+ *
+ * OUTPUT: none
+ */
+VOID DSLIM_Comm::RXPartials()
+{
+    int_t expected = maxBatches * (params.nodes - 1);
+
+    for (int_t rx = 0; rx < expected;)
+    {
+        int_t flag = 0;
+        MPI_Message msg;
+        MPI_Status stat;
+
+        /* Back off instead of spinning a search core in MPI_Mprobe */
+        MPI_Improbe(MPI_ANY_SOURCE, PARTIALS_TAG, MPI_COMM_WORLD, &flag, &msg, &stat);
+
+        if (!flag)
+        {
+            usleep(PARTIALS_WAITUS);
+            continue;
+        }
+
+        int_t count = 0;
+        MPI_Get_count(&stat, MPI_BYTE, &count);
+
+        /* The sizes are in the header: receive the message whole */
+        std::unique_ptr<char_t[]> message(new char_t[count]);
+
+        MPI_Mrecv(message.get(), count, MPI_BYTE, &msg, MPI_STATUS_IGNORE);
+
+        rx++;
+
+        partHeader hdr;
+        std::memcpy(&hdr, message.get(), std::min((size_t) count, sizeof(partHeader)));
+
+        if (count < (int_t) sizeof(partHeader) || hdr.bsize < 0 || hdr.nbytes < 0 ||
+            count != (int_t) (sizeof(partHeader) + hdr.bsize * sizeof(partRes)) + hdr.nbytes)
+        {
+            /* Its batch would never complete: fail like ReadPartials */
+            std::cout << "FATAL: Malformed partial results from: " << stat.MPI_SOURCE << " @: " << params.myid << std::endl;
+            exit(ERR_INVLD_SIZE);
+        }
+
+        ebuffer *ebuff = new ebuffer(hdr.bsize, hdr.nbytes);
+
+        std::memcpy((VOID *) ebuff->packs, message.get() + sizeof(partHeader), hdr.bsize * sizeof(partRes));
+        std::memcpy(ebuff->ibuff, message.get() + sizeof(partHeader) + hdr.bsize * sizeof(partRes), hdr.nbytes);
+
+        ebuff->batchNum = hdr.batchNum;
+        ebuff->codec = (PartCodec_t) hdr.codec;
+
+        int_t batchNum = ebuff->batchNum;
+
+        status_t status = StorePartials(ebuff, stat.MPI_SOURCE, hdr.bsize);
+
+        if (status != SLM_SUCCESS)
+        {
+            std::cout << "FATAL: Failed to store the partial results of batch: " << batchNum << " @: " << params.myid << std::endl;
+            exit(status);
+        }
+    }
+}
+
+/*
+ * FUNCTION: Wait4Batch
+ *
+ * DESCRIPTION: Wait until the partial results of one of my
+ *              batches have landed from all nodes. Each batch
+ *              is returned once, in the order they complete
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @position: The batch (batchNum / nodes), -1 if none left
+ */
+int_t DSLIM_Comm::Wait4Batch()
+{
+    int_t position = -1;
+
+    if (!readyQ->popWait(position))
+        return -1;
+
+    return position;
+}
+
+/*
+ * FUNCTION: Wait4Partials
+ *
+ * DESCRIPTION: Wait until the partial results of all my
+ *              batches have been received
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @status: status of execution
+ */
+status_t DSLIM_Comm::Wait4Partials()
+{
+    if (rx_thd.joinable())
+        rx_thd.join();
+
+    /* All batches are in the ready queue by now */
+    if (readyQ != NULL)
+        readyQ->close();
+
+    return SLM_SUCCESS;
+}
+
 #endif /* USE_MPI */
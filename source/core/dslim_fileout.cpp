@@ -17,8 +17,12 @@
  *
  */
 
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "dslim_fileout.h"
+#include "lfqueue.h"
+#include "psmfile.hpp"
 
 /* Global parameters */
 extern gParams params;
@@ -29,12 +33,99 @@ BOOL FilesInit = false;
 /* Data structures for the output file */
 std::ofstream *tsvs = NULL; /* The output files */
 
+/* A block of formatted PSMs (text) or PSM
+ * rows (psmb columns) for output file fid */
+typedef struct _fbuffer
+{
+    uint_t   fid;
+    size_t   len;
+    char_t  *data;
+    Index   *index;
+} fbuffer;
+
+/* State of a .psmb file (touched by the writer only) */
+typedef struct _psmbfile
+{
+    ull_t                              offset;
+    std::vector<ull_t>                 blocks;
+    std::unordered_map<ull_t, uint_t>  dict;      /* (idxoffset, psid) -> PEPID */
+    string_t                           peps;
+    std::vector<ull_t>                 pepoffs;
+    std::vector<float_t>               masses;
+} psmbfile;
+
+static fbuffer              *fbuffs   = NULL;    /* All output buffers */
+static fbuffer             **currbuff = NULL;    /* Buffer being filled by each thread */
+static mpmcqueue<fbuffer *> *freeQ    = NULL;    /* Empty buffers */
+static mpmcqueue<fbuffer *> *writeQ   = NULL;    /* Full buffers to write */
+static std::thread           fwriter;            /* The background writer */
+static psmbfile             *psmbs    = NULL;    /* The .psmb files */
+static size_t                buffsize = 0;       /* Size of the output buffers */
+
+/* The in-memory psmb columns are PSMB_BLOCKROWS long. The
+ * idxoffset of each row follows the last column */
+static size_t                coloffs[hcp::psm::NCOLS + 1];
+
 static string_t    DFile_Datetime();
+static VOID        DFile_Writer_Thread_Entry();
+static VOID        DFile_WriteBlock(fbuffer *);
+static VOID        DFile_CloseBinary(uint_t);
+
+/*
+ * FUNCTION: DFile_Handoff, DFile_Reserve
+ *
+ * DESCRIPTION: Hand the thread's output buffer to the writer
+ *              and replace it by an empty one. Reserve does so
+ *              only if a line (of need bytes) would not fit
+ *
+ * INPUT:
+ * @thno: Thread number (output file)
+ * @need: Maximum length of the line
+ *
+ * OUTPUT:
+ * @buff: The thread's output buffer
+ */
+static inline fbuffer *DFile_Handoff(uint_t thno)
+{
+    fbuffer *buff = currbuff[thno];
+
+    /* Never full: holds all buffers */
+    writeQ->push(buff);
+
+    /* Only waits if the writer is FOUT_NBUFFS buffers behind */
+    while (freeQ->pop(buff) != SLM_SUCCESS)
+        freeQ->waitPush();
+
+    buff->fid = thno;
+    buff->len = 0;
+
+    currbuff[thno] = buff;
+
+    return buff;
+}
+
+static inline fbuffer *DFile_Reserve(uint_t thno, size_t need)
+{
+    fbuffer *buff = currbuff[thno];
+
+    if (buffsize - buff->len >= need)
+        return buff;
+
+    return DFile_Handoff(thno);
+}
+
+/* Column c of a psmb buffer */
+template <typename T>
+static inline T *DFile_Column(fbuffer *buff, int_t c)
+{
+    return (T *) (buff->data + coloffs[c]);
+}
 
 /*
  * FUNCTION: DFile_InitFile
  *
- * DESCRIPTION:
+ * DESCRIPTION: Open the output files, allocate the output
+ *              buffers and start the background writer
  *
  * INPUT:
  * none
@@ -54,6 +145,8 @@ status_t DFile_InitFiles()
 
         string_t common = params.workspace + '/' + DFile_Datetime();
 
+        bool_t binary = (params.outfmt == OutFormat_t::psmb);
+
         if (tsvs != NULL)
         {
             status = SLM_SUCCESS;
@@ -62,6 +155,22 @@ status_t DFile_InitFiles()
 
             for (uint_t f = 0; f < params.threads; f++)
             {
+                if (binary)
+                {
+                    string_t filename = common + "_" + std::to_string(f) + ".psmb";
+                    tsvs[f].open(filename, std::ios::out | std::ios::binary);
+
+                    hcp::psm::header hdr;
+
+                    std::memcpy(hdr.magic, PSMB_MAGIC, sizeof(hdr.magic));
+                    hdr.version = PSMB_VERSION;
+                    hdr.ncols = hcp::psm::NCOLS;
+
+                    tsvs[f].write((char_t *) &hdr, sizeof(hdr));
+
+                    continue;
+                }
+
                 string_t filename = common + "_" + std::to_string(f) + ".tsv";
                 tsvs[f].open(filename);
 
@@ -69,16 +178,97 @@ status_t DFile_InitFiles()
                         << "retention_time\t" << "peptide\t" << "matched_ions\t" 
                         << "total_ions\t" << "calc_pep_mass\t" << "mass_diff\t" 
                         << "mod_info\t" << "hyperscore\t" << "expectscore\t" 
-                        << "num_hits" << std::endl;
+                        << "num_hits\t" << "rank" << '\n';
+            }
+
+            buffsize = FOUT_BUFSIZE;
+
+            if (binary)
+            {
+                psmbs = new psmbfile[params.threads];
+
+                for (uint_t f = 0; f < params.threads; f++)
+                    psmbs[f].offset = sizeof(hcp::psm::header);
+
+                /* Lay out the columns */
+                coloffs[0] = 0;
+
+                for (int_t c = 0; c < hcp::psm::NCOLS; c++)
+                    coloffs[c + 1] = coloffs[c] + hcp::psm::pad8(hcp::psm::colwidth[c] * PSMB_BLOCKROWS);
+
+                buffsize = coloffs[hcp::psm::NCOLS] + PSMB_BLOCKROWS * sizeof(ushort_t);
             }
+
+            /* One buffer being filled plus FOUT_NBUFFS
+             * in flight (or free) for each thread */
+            uint_t nbuffs = params.threads * (FOUT_NBUFFS + 1);
+
+            fbuffs = new fbuffer[nbuffs];
+            currbuff = new fbuffer*[params.threads];
+            freeQ = new mpmcqueue<fbuffer *>(nbuffs, true);
+            writeQ = new mpmcqueue<fbuffer *>(nbuffs, true);
+
+            for (uint_t b = 0; b < nbuffs; b++)
+            {
+                fbuffs[b].fid = 0;
+                fbuffs[b].len = 0;
+                fbuffs[b].data = new char_t[buffsize];
+                fbuffs[b].index = NULL;
+
+                if (b < params.threads)
+                {
+                    fbuffs[b].fid = b;
+                    currbuff[b] = &fbuffs[b];
+                }
+                else
+                    freeQ->push(&fbuffs[b]);
+            }
+
+            fwriter = std::thread(DFile_Writer_Thread_Entry);
         }
     }
 
     return status;
 }
 
+/*
+ * FUNCTION: DFile_DeinitFiles
+ *
+ * DESCRIPTION: Flush the partially filled buffers, stop
+ *              the background writer and close the files
+ *
+ * INPUT:
+ * none
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
 status_t DFile_DeinitFiles()
 {
+    if (FilesInit == false)
+        return SLM_SUCCESS;
+
+    /* Flush: the search threads are done */
+    for (uint_t i = 0; i < params.threads; i++)
+    {
+        if (currbuff[i]->len > 0)
+            writeQ->push(currbuff[i]);
+    }
+
+    /* The writer exits once the queue drains */
+    writeQ->close();
+    fwriter.join();
+
+    /* Write the footers of the .psmb files */
+    if (psmbs != NULL)
+    {
+        for (uint_t i = 0; i < params.threads; i++)
+            DFile_CloseBinary(i);
+
+        delete[] psmbs;
+        psmbs = NULL;
+    }
+
     for (uint_t i = 0; i < params.threads; i++)
         tsvs[i].close();
 
@@ -86,67 +276,303 @@ status_t DFile_DeinitFiles()
 
     tsvs = NULL;
 
+    for (uint_t b = 0; b < params.threads * (FOUT_NBUFFS + 1); b++)
+        delete[] fbuffs[b].data;
+
+    delete[] fbuffs;
+    delete[] currbuff;
+    delete freeQ;
+    delete writeQ;
+
+    fbuffs = NULL;
+    currbuff = NULL;
+    freeQ = NULL;
+    writeQ = NULL;
+
     FilesInit = false;
 
     return SLM_SUCCESS;
 }
 
+/*
+ * FUNCTION: DFile_Writer_Thread_Entry
+ *
+ * DESCRIPTION: Write the full buffers to their files
+ *              and return them to the free queue
+ *
+ * INPUT:
+ * none
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID DFile_Writer_Thread_Entry()
+{
+    fbuffer *buff = NULL;
+
+    while (writeQ->popWait(buff))
+    {
+        if (psmbs != NULL)
+            DFile_WriteBlock(buff);
+        else
+            tsvs[buff->fid].write(buff->data, buff->len);
+
+        buff->len = 0;
+        freeQ->push(buff);
+    }
+
+    for (uint_t i = 0; i < params.threads; i++)
+        tsvs[i].flush();
+}
+
+/*
+ * FUNCTION: DFile_WriteBlock
+ *
+ * DESCRIPTION: Write a buffer of PSM rows as a .psmb block.
+ *              The peptides are replaced by their codes in
+ *              the file's peptide dictionary
+ *
+ * INPUT:
+ * @buff: buffer of PSM rows
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID DFile_WriteBlock(fbuffer *buff)
+{
+    using namespace hcp::psm;
+
+    auto &file = psmbs[buff->fid];
+    auto &fh = tsvs[buff->fid];
+
+    uint_t nrows = buff->len;
+
+    uint_t *pepids = DFile_Column<uint_t>(buff, PEPID);
+    ushort_t *idxoffs = (ushort_t *) (buff->data + coloffs[NCOLS]);
+
+    for (uint_t r = 0; r < nrows; r++)
+    {
+        ull_t key = ((ull_t) idxoffs[r] << 32) | pepids[r];
+
+        auto entry = file.dict.find(key);
+
+        if (entry == file.dict.end())
+        {
+            Index *lclindex = buff->index + idxoffs[r];
+            int_t peplen = lclindex->pepIndex.peplen;
+            const char_t *pepseq = lclindex->pepIndex.seqs + (lclindex->pepEntries[pepids[r]].seqID * peplen);
+
+            if (file.pepoffs.empty())
+                file.pepoffs.push_back(0);
+
+            file.peps.append(pepseq, strnlen(pepseq, peplen));
+            file.pepoffs.push_back(file.peps.size());
+            file.masses.push_back(lclindex->pepEntries[pepids[r]].Mass);
+
+            entry = file.dict.emplace(key, file.masses.size() - 1).first;
+        }
+
+        pepids[r] = entry->second;
+    }
+
+    block blk = {nrows, 0};
+    const char_t zeros[8] = {0};
+
+    file.blocks.push_back(file.offset);
+
+    fh.write((char_t *) &blk, sizeof(blk));
+    file.offset += sizeof(blk);
+
+    for (int_t c = 0; c < NCOLS; c++)
+    {
+        size_t len = colwidth[c] * nrows;
+
+        fh.write(buff->data + coloffs[c], len);
+        fh.write(zeros, pad8(len) - len);
+
+        file.offset += pad8(len);
+    }
+}
+
+/*
+ * FUNCTION: DFile_CloseBinary
+ *
+ * DESCRIPTION: Write the footer (block offsets, query file
+ *              names and peptide dictionary) and trailer of
+ *              a .psmb file
+ *
+ * INPUT:
+ * @fid: output file
+ *
+ * OUTPUT:
+ * none
+ */
+static VOID DFile_CloseBinary(uint_t fid)
+{
+    using namespace hcp::psm;
+
+    auto &file = psmbs[fid];
+    auto &fh = tsvs[fid];
+
+    const char_t zeros[8] = {0};
+
+    trailer trl;
+
+    trl.footer = file.offset;
+    trl.nblocks = file.blocks.size();
+    std::memcpy(trl.magic, PSMB_MAGIC, sizeof(trl.magic));
+
+    fh.write((char_t *) file.blocks.data(), file.blocks.size() * sizeof(ull_t));
+
+    /* Query file names */
+    ull_t nfiles = queryfiles.size();
+    std::vector<ull_t> fileoffs(1, 0);
+
+    for (auto &qfile : queryfiles)
+        fileoffs.push_back(fileoffs.back() + qfile.size());
+
+    fh.write((char_t *) &nfiles, sizeof(nfiles));
+    fh.write((char_t *) fileoffs.data(), fileoffs.size() * sizeof(ull_t));
+
+    for (auto &qfile : queryfiles)
+        fh.write(qfile.data(), qfile.size());
+
+    fh.write(zeros, pad8(fileoffs.back()) - fileoffs.back());
+
+    /* Peptide dictionary */
+    ull_t npeps = file.masses.size();
+
+    if (file.pepoffs.empty())
+        file.pepoffs.push_back(0);
+
+    fh.write((char_t *) &npeps, sizeof(npeps));
+    fh.write((char_t *) file.pepoffs.data(), file.pepoffs.size() * sizeof(ull_t));
+    fh.write(file.peps.data(), file.peps.size());
+    fh.write(zeros, pad8(file.peps.size()) - file.peps.size());
+    fh.write((char_t *) file.masses.data(), file.masses.size() * sizeof(float_t));
+
+    /* Keep the trailer 8 byte aligned */
+    size_t mlen = file.masses.size() * sizeof(float_t);
+    fh.write(zeros, pad8(mlen) - mlen);
+
+    fh.write((char_t *) &trl, sizeof(trl));
+}
+
 status_t DFile_PrintPartials(uint_t specid, Results *resPtr)
 {
     status_t status = SLM_SUCCESS;
     uint_t thno = omp_get_thread_num();
 
-    tsvs[thno]         << std::to_string(specid + 1);
-    tsvs[thno] << '\t' << std::to_string(resPtr->cpsms);
-    tsvs[thno] << '\t' << std::to_string(resPtr->mu);
-    tsvs[thno] << '\t' << std::to_string(resPtr->beta);
-    tsvs[thno] << '\t' << std::to_string(resPtr->minhypscore);
-    tsvs[thno] << '\t' << std::to_string(resPtr->nexthypscore);
+    /* Text output only */
+    if (params.outfmt != OutFormat_t::tsv)
+        return status;
+
+    fbuffer *buff = DFile_Reserve(thno, FOUT_MAXLINE);
+
+    char_t *ptr = buff->data + buff->len;
+    char_t *end = buff->data + buffsize;
 
-    tsvs[thno] << std::endl;
+    ptr = hcp::psm::put(ptr, end, specid + 1);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, resPtr->cpsms);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, resPtr->mu);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, resPtr->beta);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, resPtr->minhypscore);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, resPtr->nexthypscore);
+    *ptr++ = '\n';
+
+    buff->len = ptr - buff->data;
 
     return status;
 
 }
 
-status_t DFile_PrintScore(Index *index, uint_t specid, float_t pmass, hCell *psm, double_t e_x, uint_t npsms)
+status_t DFile_PrintScore(Index *index, uint_t specid, float_t pmass, hCell *psm, double_t e_x, uint_t npsms, uint_t rank)
 {
     uint_t thno = omp_get_thread_num();
 
+    /* Add a row to the psmb columns */
+    if (params.outfmt == OutFormat_t::psmb)
+    {
+        using namespace hcp::psm;
+
+        fbuffer *buff = currbuff[thno];
+
+        if (buff->len == PSMB_BLOCKROWS)
+            buff = DFile_Handoff(thno);
+
+        auto r = buff->len++;
+
+        buff->index = index;
+
+        DFile_Column<uint_t>(buff, SPECID)[r]       = specid;
+        DFile_Column<ushort_t>(buff, FILEID)[r]     = psm->fileIndex;
+        DFile_Column<uchar_t>(buff, CHARGE)[r]      = psm->pchg;
+        DFile_Column<float_t>(buff, PMASS)[r]       = pmass;
+        DFile_Column<float_t>(buff, RTIME)[r]       = psm->rtime;
+        DFile_Column<uint_t>(buff, PEPID)[r]        = psm->psid;
+        DFile_Column<ushort_t>(buff, SHARED)[r]     = psm->sharedions;
+        DFile_Column<ushort_t>(buff, TOTAL)[r]      = psm->totalions;
+        DFile_Column<float_t>(buff, HYPERSCORE)[r]  = psm->hyperscore;
+        DFile_Column<double_t>(buff, EVALUE)[r]     = e_x;
+        DFile_Column<uint_t>(buff, NHITS)[r]        = npsms;
+        DFile_Column<ushort_t>(buff, RANK)[r]       = rank;
+
+        /* Resolved to a PEPID by the writer */
+        ((ushort_t *) (buff->data + coloffs[NCOLS]))[r] = psm->idxoffset;
+
+        return SLM_SUCCESS;
+    }
+
     Index * lclindex = index + psm->idxoffset;
     int_t peplen = lclindex->pepIndex.peplen;
     int_t pepid = psm->psid;
 
-    /* The size is peplen + 1 to add the \0 character at the end */
-    char_t pepseq[peplen + 1];
-
-    /* Write the \0 character to the last position of pepseq buffer */
-    pepseq[peplen] = '\0';
-
-    /* Copy the rest of the string to the pepseq buffer */
-    strncpy((char_t *)&(pepseq[0]), lclindex->pepIndex.seqs +
-             (lclindex->pepEntries[psm->psid].seqID * peplen), peplen);
-
-    /* Make a string from the char [] */
-    string_t pep = pepseq;
-
-    /* Print the PSM info to the file */
-    tsvs[thno]         << queryfiles[psm->fileIndex];
-    tsvs[thno] << '\t' << std::to_string(specid + 1);
-    tsvs[thno] << '\t' << std::to_string(pmass);
-    tsvs[thno] << '\t' << std::to_string(psm->pchg);
-    tsvs[thno] << '\t' << std::to_string(psm->rtime);
-    tsvs[thno] << '\t' << pep;
-    tsvs[thno] << '\t' << std::to_string(psm->sharedions);
-    tsvs[thno] << '\t' << std::to_string(psm->totalions);
-    tsvs[thno] << '\t' << std::to_string(lclindex->pepEntries[pepid].Mass);
-    tsvs[thno] << '\t' << std::to_string((pmass - lclindex->pepEntries[pepid].Mass));
-    tsvs[thno] << '\t'; // TODO: print (mod_info) here
-    tsvs[thno] << '\t' << std::to_string(psm->hyperscore);
-    tsvs[thno] << '\t' << std::to_string(e_x);
-    tsvs[thno] << '\t' << std::to_string(npsms);
-
-    tsvs[thno] << std::endl;
+    /* The peptide sequence (not null terminated) */
+    const char_t *pepseq = lclindex->pepIndex.seqs + (lclindex->pepEntries[psm->psid].seqID * peplen);
+    const string_t &qfile = queryfiles[psm->fileIndex];
+
+    fbuffer *buff = DFile_Reserve(thno, qfile.size() + peplen + FOUT_MAXLINE);
+
+    char_t *ptr = buff->data + buff->len;
+    char_t *end = buff->data + buffsize;
+
+    /* Print the PSM info to the buffer */
+    ptr = hcp::psm::put(ptr, end, qfile.data(), qfile.size());
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, specid + 1);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, pmass);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, psm->pchg);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, psm->rtime);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, pepseq, strnlen(pepseq, peplen));
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, psm->sharedions);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, psm->totalions);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, lclindex->pepEntries[pepid].Mass);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, (pmass - lclindex->pepEntries[pepid].Mass));
+    *ptr++ = '\t'; // TODO: print (mod_info) here
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, psm->hyperscore);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, e_x);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, npsms);
+    *ptr++ = '\t';
+    ptr = hcp::psm::put(ptr, end, rank);
+    *ptr++ = '\n';
+
+    buff->len = ptr - buff->data;
 
     return SLM_SUCCESS;
 }
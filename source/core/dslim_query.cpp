@@ -17,17 +17,30 @@
  *
  */
 
+#include <fcntl.h>
 #include <thread>
+#include <map>
+#include <numeric>
+#include <cstring>
 #include <semaphore.h>
 #include <unistd.h>
+
+#if defined (__AVX2__) || defined (__AVX512BW__)
+#include <immintrin.h>
+#endif // __AVX2__ || __AVX512BW__
+
 #include "dslim_fileout.h"
 #include "msquery.hpp"
 #include "dslim.h"
 #include "lwqueue.h"
+#include "lfqueue.h"
 #include "lwbuff.h"
 #include "scheduler.h"
+#include "asyncio.hpp"
 #include "ms2prep.hpp"
 #include "hicops_instr.hpp"
+#include "ionenc.h"
+#include "dslim_match.h"
 
 #include "cuda/superstep3/kernel.hpp"
 
@@ -73,11 +86,9 @@ std::mutex gtimelock;
 
 #ifdef USE_MPI
 
-lock_t qfoutlock;
-lwqueue<ebuffer*> *qfout   = nullptr;
+mpmcqueue<ebuffer*> *qfout = nullptr;
 std::vector<std::thread> fouts;
 VOID DSLIM_FOut_Thread_Entry();
-std::atomic<bool> exitSignal(false);
 
 #endif // USE_MPI
 
@@ -86,22 +97,32 @@ lwqueue<MSQuery *> *ioQ = nullptr;
 lock_t ioQlock;
 std::atomic<bool> scheduler_init(false);
 
+/* Asynchronous .pbin batch loader (replaces the I/O threads) */
+std::thread prefetcher;
+VOID DSLIM_Prefetch_Thread_Entry();
+
 //
 // -------------------------- Static functions ----------------------------------
 //
 
 static BOOL   DSLIM_BinarySearch(Index *, float_t, int_t&, int_t&);
-static int_t  DSLIM_BinFindMin(pepEntry *entries, float_t pmass1, int_t min, int_t max);
-static int_t  DSLIM_BinFindMax(pepEntry *entries, float_t pmass2, int_t min, int_t max);
+static inline int_t DSLIM_MassFindMin(Index *, float_t);
+static inline int_t DSLIM_MassFindMax(Index *, float_t);
 static inline status_t DSLIM_Deinit_IO();
 
+template <class func_t>
+static inline VOID DSLIM_FilterCandidates(const ushort_t *, const ushort_t *, int_t, int_t, ushort_t, func_t &&);
+static inline VOID DSLIM_ScoreChunk(Queries<spectype_t> *, int_t, Index *, uint_t, uint_t, int_t, int_t, BYICount *, Results *);
+static inline status_t DSLIM_ResultSpectrum(Queries<spectype_t> *, int_t, Index *, int_t, int_t, Results *, ebuffer *);
+
 //
 // ------------------------------------------------------------------------------
 //
 
 /* FUNCTION: DSLIM_WaitFor_IO
  *
- * DESCRIPTION:
+ * DESCRIPTION: Block until a loaded batch is available
+ *              in the ready queue and get it
  *
  * INPUT:
  * @none
@@ -114,42 +135,30 @@ static inline status_t DSLIM_WaitFor_IO(Queries<spectype_t>* &, int_t &);
 
 static inline status_t DSLIM_WaitFor_IO(Queries<spectype_t> *&workPtr, int_t &batchsize)
 {
-    status_t status;
+    status_t status = SLM_SUCCESS;
 
     batchsize = 0;
+    workPtr = nullptr;
 
-    /* Wait for a I/O request */
-    status = qPtrs->lockr_();
-
-    /* Check for either a buffer or stopSignal */
-    while (qPtrs->isEmptyReadyQ())
-    {
-        /* If both conditions fail,
-         * the I/O threads still working */
-        status = qPtrs->unlockr_();
-
-        // safety from a rare race condition
-        if (!SchedHandle->getNumActivThds())
-            SchedHandle->dispatchThread();
-
-        sleep(0.1);
-
-        status = qPtrs->lockr_();
-    }
-
-    if (status == SLM_SUCCESS)
+    for (;;)
     {
-        /* Get the I/O ptr from the wait queue */
+        /* Get the I/O ptr from the ready queue */
         workPtr = qPtrs->getWorkPtr();
 
-        if (workPtr == nullptr)
-            status = ERR_INVLD_PTR;
-
-        status = qPtrs->unlockr_();
+        if (workPtr != nullptr)
+            break;
 
-        batchsize = workPtr->numSpecs;
+        /* Sleep until the I/O threads add a buffer */
+        if (!qPtrs->waitWork(IO_WAITMS))
+        {
+            // safety from a rare race condition
+            if (!SchedHandle->getNumActivThds())
+                SchedHandle->dispatchThread();
+        }
     }
 
+    batchsize = workPtr->numSpecs;
+
     return status;
 }
 
@@ -244,8 +253,7 @@ status_t DSLIM_Setup_Handles()
 #ifdef USE_MPI
     else if (params.nodes > 1)
     {
-        status = sem_init(&qfoutlock, 0, 1);
-        qfout = new lwqueue<ebuffer*> (nBatches);
+        qfout = new mpmcqueue<ebuffer*> (nBatches);
 
         // create two threads for fout
         for (int i = 0; i < 2; i++)
@@ -280,10 +288,14 @@ status_t DSLIM_Setup_Handles()
 
 #endif /* USE_MPI */
 
+    /* Read the .pbin batches asynchronously instead of
+     * dispatching I/O threads on the compute cores */
+    bool_t prefetch = params.prefetch > 0 && params.filetype == gParams::FileType_t::PBIN;
+
     /* Create a new Scheduler handle */
     if (status == SLM_SUCCESS)
     {
-        SchedHandle = new Scheduler;
+        SchedHandle = (prefetch) ? new Scheduler(0) : new Scheduler;
 
         /* Check for correct allocation */
         if (SchedHandle == nullptr)
@@ -292,6 +304,9 @@ status_t DSLIM_Setup_Handles()
             scheduler_init = true;
     }
 
+    if (status == SLM_SUCCESS && prefetch)
+        prefetcher = std::thread(DSLIM_Prefetch_Thread_Entry);
+
     return status;
 }
 
@@ -404,9 +419,7 @@ void GPU_DistributedSearch(Index *index)
         if (bid != (nBatches - 1))
         {
             /* Check the status of buffer queues */
-            qPtrs->lockr_();
             int_t dec = qPtrs->readyQStatus();
-            qPtrs->unlockr_();
 
             /* Run the Scheduler to manage thread between compute and I/O */
             SchedHandle->runManager(penalty, dec);
@@ -432,12 +445,8 @@ void GPU_DistributedSearch(Index *index)
         SpSpGEMMTime += ELAPSED_SECONDS(SpSpGEMM);
         std::cout << "gSearch Time: " << SpSpGEMMTime << std::endl;
 
-        status = qPtrs->lockw_();
-
         /* Request next I/O chunk */
         qPtrs->Replenish(gWorkPtr);
-
-        status = qPtrs->unlockw_();
     }
 
     MARK_END(gpu_search_time);
@@ -571,9 +580,7 @@ status_t DistributedSearch(Index *index)
         if (bid != (nBatches - 1))
         {
             /* Check the status of buffer queues */
-            qPtrs->lockr_();
             int_t dec = qPtrs->readyQStatus();
-            qPtrs->unlockr_();
 
             /* Run the Scheduler to manage thread between compute and I/O */
             SchedHandle->runManager(penalty, dec);
@@ -593,13 +600,9 @@ status_t DistributedSearch(Index *index)
             /* Query the chunk */
             status = DSLIM_QuerySpectrum(workPtr, index, (maxlen - minlen + 1), myspecId);
 
-        status = qPtrs->lockw_();
-
         /* Request next I/O chunk */
         qPtrs->Replenish(workPtr);
 
-        status = qPtrs->unlockw_();
-
         MARK_END(search_time);
 
         /* Compute Duration */
@@ -665,7 +668,7 @@ status_t DSLIM_Destroy_Handles(Index *index)
     if (params.nodes > 1)
     {
         // signal fout threads to exit
-        exitSignal = true;
+        qfout->close();
 
 #if defined (USE_TIMEMORY)
         wall_tuple_t comm_penalty("comm_ovhd");
@@ -719,14 +722,10 @@ status_t DSLIM_Destroy_Handles(Index *index)
         //
 
         // Carry forward the data to the distributed scoring module
+        // (it takes over CommHandle, still receiving the partials)
         status = DSLIM_CarryForward(index, CommHandle, ePtrs, CandidatePSMS, spectrumID);
 
-        /* Delete the instance of CommHandle */
-        if (CommHandle != nullptr)
-        {
-            delete CommHandle;
-            CommHandle = nullptr;
-        }
+        CommHandle = nullptr;
     }
 #endif /* USE_MPI */
 
@@ -734,6 +733,10 @@ status_t DSLIM_Destroy_Handles(Index *index)
     // Deinitialize
     //
 
+    /* All batches have been loaded by now */
+    if (prefetcher.joinable())
+        prefetcher.join();
+
     /* Delete the scheduler object */
     if (SchedHandle != nullptr)
     {
@@ -765,15 +768,11 @@ status_t DSLIM_QuerySpectrum(Queries<spectype_t> *ss, Index *index, uint_t idxch
 {
     status_t status = SLM_SUCCESS;
     int_t threads = (int_t) params.threads - (int_t) SchedHandle->getNumActivThds();
-    uint_t maxz = params.maxz;
-    uint_t dF = params.dF;
-    uint_t scale = params.scale;
-    double_t maxmass = params.max_mass;
     ebuffer *liBuff = nullptr;
     partRes *txArray = nullptr;
 
-    // static instance of the log(factorial(x)) array
-    static auto lgfact = hcp::utils::lgfact<hcp::utils::maxshp>();
+    /* Spectra per tile (chunk-major traversal) */
+    const int_t qtile = params.qtile;
 
     if (params.nodes > 1)
     {
@@ -812,285 +811,428 @@ status_t DSLIM_QuerySpectrum(Queries<spectype_t> *ss, Index *index, uint_t idxch
         }
 #endif /* DIAGNOSE */
 
-        /* Process all the queries in the chunk.
-         * Setting chunk size to 4 to avoid false sharing
-         */
+        if (qtile <= 1)
+        {
+            /* Process all the queries in the chunk.
+             * Setting chunk size to 4 to avoid false sharing
+             */
 #ifdef USE_OMP
 #pragma omp parallel for num_threads(threads) schedule(dynamic, 4)
 #endif /* USE_OMP */
-        for (int_t queries = 0; queries < ss->numSpecs; queries++)
-        {
-            /* Pointer to each query spectrum */
-            auto *QAPtr = ss->moz + ss->idx[queries];
-            float_t pmass = ss->precurse[queries];
-            auto    pchg  = ss->charges[queries];
-            auto    rtime = ss->rtimes[queries];
-            auto    *iPtr = ss->intensity + ss->idx[queries];
-            auto qspeclen = ss->idx[queries + 1] - ss->idx[queries];
-            auto thno = omp_get_thread_num();
-
-            BYC *bycPtr     = Score[thno].byc;
-            Results *resPtr = &Score[thno].res;
-            expeRT  *expPtr = ePtrs + thno;
-            ebuffer *inBuff = inBuff + thno;
+            for (int_t queries = 0; queries < ss->numSpecs; queries++)
+            {
+                auto thno = omp_get_thread_num();
+
+                BYICount *scPtr = Score + thno;
+                Results *resPtr = &Score[thno].res;
 
 #if defined (PROGRESS)
-            if (thno == 0 && params.myid == 0)
-                std::cout << "\rDONE:\t\t" << (queries * 100) /ss->numSpecs << "%";
+                if (thno == 0 && params.myid == 0)
+                    std::cout << "\rDONE:\t\t" << (queries * 100) /ss->numSpecs << "%";
 #endif // PROGRESS
 
-            for (uint_t ixx = 0; ixx < idxchunk; ixx++)
-            {
-                uint_t speclen = (index[ixx].pepIndex.peplen - 1) * maxz * iSERIES;
-                uint_t halfspeclen = speclen / 2;
-#ifdef MATCH_CHARGE
-                uint_t peplen_1 = index[ixx].pepIndex.peplen - 1;
-#endif // MATCH_CHARGE
-
-                for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
+                for (uint_t ixx = 0; ixx < idxchunk; ixx++)
                 {
-                    /* Query each chunk in parallel */
-                    uint_t *bAPtr = index[ixx].ionIndex[chno].bA;
-                    uint_t *iAPtr = index[ixx].ionIndex[chno].iA;
-
                     int_t minlimit = 0;
                     int_t maxlimit = 0;
 
                     BOOL val = DSLIM_BinarySearch(index + ixx, ss->precurse[queries], minlimit, maxlimit);
 
-                    // FIXME: remove me // std::cout << " qno = " << queries << " ixx = " << ixx << " chno = " << chno << " minlimit = " << minlimit << " maxlimit = " << maxlimit << std::endl;
-
                     /* Spectrum violates limits */
                     if (val == false || (maxlimit < minlimit))
                         continue;
 
-                    /* Query all fragments in each spectrum */
-                    for (uint_t k = 0; k < qspeclen; k++)
+                    for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
+                        DSLIM_ScoreChunk(ss, queries, index, ixx, chno, minlimit, maxlimit, scPtr, resPtr);
+                }
+
+                /* Model the e-values and print or transmit the result */
+                status = DSLIM_ResultSpectrum(ss, queries, index, currSpecID, thno, resPtr, liBuff);
+            }
+        }
+        else
+        {
+            /* Sort the queries by precursor mass so that neighboring
+             * spectra in a tile share the peptide range and bins */
+            std::vector<int_t> order(ss->numSpecs);
+            std::iota(order.begin(), order.end(), 0);
+
+            std::stable_sort(order.begin(), order.end(), [&](const int_t &a, const int_t &b)
+                             { return ss->precurse[a] < ss->precurse[b]; });
+
+            const int_t ntiles = (ss->numSpecs + qtile - 1) / qtile;
+
+            /* Process the tiles against one index chunk at a time */
+#ifdef USE_OMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#endif /* USE_OMP */
+            for (int_t tile = 0; tile < ntiles; tile++)
+            {
+                auto thno = omp_get_thread_num();
+
+                BYICount *scPtr = Score + thno;
+                Results *tres   = Score[thno].tres;
+
+                const int_t *tqueries = order.data() + tile * qtile;
+                const int_t tsize = std::min(qtile, ss->numSpecs - tile * qtile);
+
+                std::vector<int_t> minlimits(tsize);
+                std::vector<int_t> maxlimits(tsize);
+
+#if defined (PROGRESS)
+                if (thno == 0 && params.myid == 0)
+                    std::cout << "\rDONE:\t\t" << (tile * 100) / ntiles << "%";
+#endif // PROGRESS
+
+                for (uint_t ixx = 0; ixx < idxchunk; ixx++)
+                {
+                    /* Candidate peptide ranges of the tile */
+                    for (int_t tq = 0; tq < tsize; tq++)
                     {
-                        /* Do this to save mem boundedness */
-                        auto qion = QAPtr[k];
-                        uint_t intn = iPtr[k];
+                        BOOL val = DSLIM_BinarySearch(index + ixx, ss->precurse[tqueries[tq]], minlimits[tq], maxlimits[tq]);
+
+                        /* Spectrum violates limits */
+                        if (val == false)
+                            maxlimits[tq] = minlimits[tq] - 1;
+                    }
 
-                        /* Check for any zeros
-                         * Zero = Trivial query */
-                        if (qion > dF && qion < ((maxmass * scale) - 1 - dF))
+                    for (uint_t chno = 0; chno < index[ixx].nChunks; chno++)
+                    {
+                        for (int_t tq = 0; tq < tsize; tq++)
                         {
-                            for (auto bin = qion - dF; bin < qion + 1 + dF; bin++)
-                            {
-                                /* Locate iAPtr start and end */
-                                uint_t start = bAPtr[bin];
-                                uint_t end = bAPtr[bin + 1];
+                            if (maxlimits[tq] < minlimits[tq])
+                                continue;
 
-                                /* If no ions in the bin */
-                                if (end - start < 1)
-                                    continue;
+                            DSLIM_ScoreChunk(ss, tqueries[tq], index, ixx, chno, minlimits[tq], maxlimits[tq], scPtr, tres + tq);
+                        }
+                    }
+                }
 
-                                auto ptr = std::lower_bound(iAPtr + start, iAPtr + end, minlimit * speclen);
-                                int_t stt = start + std::distance(iAPtr + start, ptr);
+                /* Model the e-values and print or transmit the results */
+                for (int_t tq = 0; tq < tsize; tq++)
+                    status = DSLIM_ResultSpectrum(ss, tqueries[tq], index, currSpecID, thno, tres + tq, liBuff);
+            }
+        }
 
-                                ptr = std::upper_bound(iAPtr + stt, iAPtr + end, (((maxlimit + 1) * speclen) - 1));
-                                int_t ends = stt + std::distance(iAPtr + stt, ptr) - 1;
+#ifdef USE_MPI
+        if (params.nodes > 1)
+            liBuff->currptr = ss->numSpecs * Xsamples * sizeof(ushort_t);
+#endif // USE_MPI
+    }
 
-                                /* Loop through located iAions */
-                                for (auto ion = stt; ion <= ends; ion++)
-                                {
-                                    uint_t raw = iAPtr[ion];
+    // Add a thread
+#ifdef USE_MPI
+    if (params.nodes > 1)
+        AddliBuff(liBuff);
 
-                                    /* Calculate parent peptide ID */
-                                    int_t ppid = (raw / speclen);
+#endif // USE_MPI
 
-                                    /* Calculate the residue */
-                                    int_t residue = (raw % speclen);
+    return status;
+}
 
-                                    /* Either 0 or 1 */
-                                    int_t isY = residue / halfspeclen;
-                                    int_t isB = 1 - isY;
+/*
+ * FUNCTION: DSLIM_ScoreChunk
+ *
+ * DESCRIPTION: Score a query spectrum against the candidate
+ *              peptides in an index chunk and add the candidate
+ *              PSMs to the results. Wide candidate windows only
+ *              scan and reset the scorecard entries that were
+ *              touched by the query (sparse mode)
+ *
+ * INPUT:
+ * @ss      : Query spectra batch
+ * @queries : Query spectrum number in the batch
+ * @index   : The SLM Index
+ * @ixx     : Index number
+ * @chno    : Chunk number
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
+ * @scPtr   : The scorecard
+ * @resPtr  : Results of the query spectrum
+ *
+ * OUTPUT: none
+ */
+static inline VOID DSLIM_ScoreChunk(Queries<spectype_t> *ss, int_t queries, Index *index, uint_t ixx, uint_t chno,
+                                    int_t minlimit, int_t maxlimit, BYICount *scPtr, Results *resPtr)
+{
+    // static instance of the log(factorial(x)) array
+    static auto lgfact = hcp::utils::lgfact<hcp::utils::maxshp>();
 
-#ifdef MATCH_CHARGE
+    const uint_t maxz = params.maxz;
+    const uint_t peplen = index[ixx].pepIndex.peplen;
+    const uint_t speclen = (peplen - 1) * maxz * iSERIES;
 
-                                    // FIXME: Is this ichg computation and usage correct?
-                                    int_t ichg = (residue / peplen_1) % maxz;
-                                    ichg += 1;
+    /* Pointer to each query spectrum */
+    auto *QAPtr = ss->moz + ss->idx[queries];
+    auto    *iPtr = ss->intensity + ss->idx[queries];
+    auto qspeclen = ss->idx[queries + 1] - ss->idx[queries];
 
-                                    // Check if the matched ion's charge is less than or equal to the precursor charge
-                                    isY *= (ichg <= pchg);
-                                    isB *= (ichg <= pchg);
+    ushort_t *bc = scPtr->bc;
+    ushort_t *yc = scPtr->yc;
+    uint_t *ibc = scPtr->ibc;
+    uint_t *iyc = scPtr->iyc;
+    uint_t *touched = scPtr->touched;
+    uint_t ntouched = 0;
 
-#endif // MATCH_CHARGE
-                                    /* Get the map element */
-                                    BYC *elmnt = bycPtr + ppid;
+    /* Compute the chunksize to look further into */
+    int_t csize = maxlimit - minlimit + 1;
 
-                                    /* Update */
-                                    elmnt->bc += isB;
-                                    elmnt->ibc += intn * isB;
+    /* Track the touched entries if the window is wide */
+    const bool_t sparse = (params.spwindow > 0 && (uint_t)csize > params.spwindow);
 
-                                    elmnt->yc += isY;
-                                    elmnt->iyc += intn * isY;
-                                }
-                            }
-                        }
-                    }
+    spmat_t *chunk = index[ixx].ionIndex + chno;
 
-                    /* Compute the chunksize to look further into */
-                    int_t csize = maxlimit - minlimit + 1;
+    /* Number of peptides in the chunk */
+    uint_t npeps = ((chno == index[ixx].nChunks - 1) && (index[ixx].nChunks > 1))?
+                    index[ixx].lastchunksize : index[ixx].chunksize;
+    int_t pchg = ss->charges[queries];
 
-                    /* Look for candidate PSMs */
-                    for (int_t it = minlimit; it <= maxlimit; it++)
-                    {
-                        ushort_t bcc = bycPtr[it].bc;
-                        ushort_t ycc = bycPtr[it].yc;
-                        ushort_t shpk = bcc + ycc;
+    /* Query all fragments in each spectrum */
+    if (index[ixx].ionenc == IonEnc_t::shiftmask)
+    {
+        hcp::dslim::shiftenc enc(peplen, maxz);
 
-                        /* Filter by the min shared peaks */
-                        if (shpk >= params.min_shp)
-                        {
-                            /* Create a heap cell */
-                            hCell cell;
-
-                            // get the precomputed log(factorial(x))
-                            double_t h1 = lgfact[bcc] + lgfact[ycc];
-
-                            /* Fill in the information */
-                            cell.hyperscore = h1 + log10(1 + bycPtr[it].ibc) + log10(1 + bycPtr[it].iyc) - 4;
-
-                            /* hyperscore < 0 means either b- or y- ions were not matched */
-                            if (cell.hyperscore > 0)
-                            {
-                                if (cell.hyperscore >= MAX_HYPERSCORE)
-                                    cell.hyperscore = MAX_HYPERSCORE - 1;
-
-                                cell.idxoffset = ixx;
-                                cell.psid = it;
-                                cell.sharedions = shpk;
-                                cell.totalions = speclen;
-                                cell.pmass = pmass;
-                                cell.pchg = pchg;
-                                cell.rtime = rtime;
-                                cell.fileIndex = ss->fileNum;
-
-                                /* Insert the cell in the heap dst */
-                                resPtr->topK.insert(cell);
-
-                                /* Increase the N */
-                                resPtr->cpsms += 1;
-
-                                /* Update the histogram */
-                                resPtr->survival[(int_t) (cell.hyperscore * 10 + 0.5)] += 1;
-                            }
-                        }
-                    }
+        if (sparse)
+            DSLIM_MatchIons<hcp::dslim::shiftenc, true>(enc, chunk, npeps, QAPtr, iPtr, qspeclen, minlimit, maxlimit, pchg, scPtr, ntouched);
+        else
+            DSLIM_MatchIons<hcp::dslim::shiftenc, false>(enc, chunk, npeps, QAPtr, iPtr, qspeclen, minlimit, maxlimit, pchg, scPtr, ntouched);
+    }
+    else
+    {
+        hcp::dslim::divenc enc(peplen, maxz);
 
-                    /* Clear the scorecard */
-                    std::memset(bycPtr + minlimit, 0x0, sizeof(BYC) * csize);
-                }
+        if (sparse)
+            DSLIM_MatchIons<hcp::dslim::divenc, true>(enc, chunk, npeps, QAPtr, iPtr, qspeclen, minlimit, maxlimit, pchg, scPtr, ntouched);
+        else
+            DSLIM_MatchIons<hcp::dslim::divenc, false>(enc, chunk, npeps, QAPtr, iPtr, qspeclen, minlimit, maxlimit, pchg, scPtr, ntouched);
+    }
+
+    /* Score a candidate PSM */
+    auto candidate = [&](int_t it)
+    {
+        ushort_t bcc = bc[it];
+        ushort_t ycc = yc[it];
+        ushort_t shpk = bcc + ycc;
+
+        // get the precomputed log(factorial(x))
+        double_t h1 = lgfact[bcc] + lgfact[ycc];
+
+        /* Compute the hyperscore */
+        float_t hyperscore = h1 + log10(1 + ibc[it]) + log10(1 + iyc[it]) - 4;
+
+        /* hyperscore < 0 means either b- or y- ions were not matched */
+        if (hyperscore > 0)
+        {
+            if (hyperscore >= MAX_HYPERSCORE)
+                hyperscore = MAX_HYPERSCORE - 1;
+
+            /* Only fill in the cells that make it to the top-K */
+            hCell *cell = resPtr->topK.insert(hyperscore);
+
+            if (cell != nullptr)
+            {
+                cell->hyperscore = hyperscore;
+                cell->idxoffset = ixx;
+                cell->psid = it;
+                cell->sharedions = shpk;
+                cell->totalions = speclen;
+                cell->pmass = ss->precurse[queries];
+                cell->pchg = ss->charges[queries];
+                cell->rtime = ss->rtimes[queries];
+                cell->fileIndex = ss->fileNum;
             }
 
+            /* Increase the N */
+            resPtr->cpsms += 1;
+
+            /* Update the histogram */
+            resPtr->survival[(int_t) (hyperscore * 10 + 0.5)] += 1;
+        }
+    };
+
+    if (sparse)
+    {
+        /* Visit the touched entries in peptide order so that the
+         * candidates are inserted in the same order as dense mode */
+        std::sort(touched, touched + ntouched);
+
+        for (uint_t cc = 0; cc < ntouched; cc++)
+        {
+            int_t it = touched[cc];
+
+            /* Filter by the min shared peaks */
+            if ((ushort_t)(bc[it] + yc[it]) >= params.min_shp)
+                candidate(it);
+        }
+
+        /* Clear the scorecard */
+        for (uint_t cc = 0; cc < ntouched; cc++)
+        {
+            int_t it = touched[cc];
+
+            bc[it] = 0;
+            yc[it] = 0;
+            ibc[it] = 0;
+            iyc[it] = 0;
+        }
+    }
+    else
+    {
+        /* Filter by the min shared peaks */
+        DSLIM_FilterCandidates(bc, yc, minlimit, maxlimit, params.min_shp, candidate);
+
+        /* Clear the scorecard */
+        std::memset(bc + minlimit, 0x0, sizeof(ushort_t) * csize);
+        std::memset(yc + minlimit, 0x0, sizeof(ushort_t) * csize);
+        std::memset(ibc + minlimit, 0x0, sizeof(uint_t) * csize);
+        std::memset(iyc + minlimit, 0x0, sizeof(uint_t) * csize);
+    }
+}
+
+/*
+ * FUNCTION: DSLIM_ResultSpectrum
+ *
+ * DESCRIPTION: Model the expect score of the top PSM of a query
+ *              spectrum and print it (shared memory mode) or
+ *              store the partial results (distributed mode).
+ *              Resets the results afterwards.
+ *
+ * INPUT:
+ * @ss        : Query spectra batch
+ * @queries   : Query spectrum number in the batch
+ * @index     : The SLM Index
+ * @currSpecID: Global spectrum ID of the first query in batch
+ * @thno      : Thread number
+ * @resPtr    : Results of the query spectrum
+ * @liBuff    : Partial results buffer (distributed mode)
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+static inline status_t DSLIM_ResultSpectrum(Queries<spectype_t> *ss, int_t queries, Index *index, int_t currSpecID,
+                                            int_t thno, Results *resPtr, ebuffer *liBuff)
+{
+    status_t status = SLM_SUCCESS;
+
+    expeRT  *expPtr = ePtrs + thno;
+    float_t pmass = ss->precurse[queries];
+
 #ifdef USE_MPI
-            /* Distributed memory mode - Model partial Gumbel
-             * and transmit parameters to rx machine */
-            if (params.nodes > 1)
-            {
-                /* Set the params.min_cpsm in dist mem mode to 1 */
-                if (resPtr->cpsms >= 1)
-                {
-                    /* Extract the top PSM */
-                    hCell&& psm = resPtr->topK.getMax();
+    /* Distributed memory mode - Model partial Gumbel
+     * and transmit parameters to rx machine */
+    if (params.nodes > 1)
+    {
+        partRes *txArray = liBuff->packs;
 
-                    /* Put it in the list */
-                    CandidatePSMS[currSpecID + queries] = psm;
+        /* Set the params.min_cpsm in dist mem mode to 1 */
+        if (resPtr->cpsms >= 1)
+        {
+            /* Extract the top PSM */
+            hCell&& psm = resPtr->topK.getMax();
 
-                    resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+            /* Put it in the list */
+            CandidatePSMS[currSpecID + queries] = psm;
 
-                    status = expPtr->StoreIResults(resPtr, queries, liBuff);
+            resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
 
-                    /* Fill in the Tx array cells */
-                    txArray[queries].min  = resPtr->minhypscore;
-                    txArray[queries].max2 = resPtr->nexthypscore;
-                    txArray[queries].max  = psm.hyperscore;
-                    txArray[queries].N    = resPtr->cpsms;
-                    txArray[queries].qID  = currSpecID + queries;
-                }
-                else
-                {
-                    /* Extract the top result
-                     * and put it in the list */
-                    CandidatePSMS[currSpecID + queries] = 0;
-
-                    /* Get the handle to the txArr
-                     * Fill it up and move on */
-                    txArray[queries] = 0;
-                    txArray[queries].qID  = currSpecID + queries;
-                }
-            }
+            status = expPtr->StoreIResults(resPtr, queries, liBuff);
+
+            /* Fill in the Tx array cells */
+            txArray[queries].min  = resPtr->minhypscore;
+            txArray[queries].max2 = resPtr->nexthypscore;
+            txArray[queries].max  = psm.hyperscore;
+            txArray[queries].N    = resPtr->cpsms;
+            txArray[queries].qID  = currSpecID + queries;
+        }
+        else
+        {
+            /* Extract the top result
+             * and put it in the list */
+            CandidatePSMS[currSpecID + queries] = 0;
+
+            /* Get the handle to the txArr
+             * Fill it up and move on */
+            txArray[queries] = 0;
+            txArray[queries].qID  = currSpecID + queries;
+        }
+    }
 
-            /* Shared memory mode - Do complete
-             * modeling and print results */
-            else
+    /* Shared memory mode - Do complete
+     * modeling and print results */
+    else
+#else
+    UNUSED_PARAM(liBuff);
 #endif /* USE_MPI */
-            {
-                /* Check for minimum number of PSMs */
-                if (resPtr->cpsms >= params.min_cpsm)
-                {
-                    /* Extract the top PSM */
-                    hCell&& psm = resPtr->topK.getMax();
+    {
+        /* Check for minimum number of PSMs */
+        if (resPtr->cpsms >= params.min_cpsm)
+        {
+            /* Order the top PSMs by hyperscore */
+            resPtr->topK.sort();
+
+            /* Extract the top PSM */
+            hCell &psm = resPtr->topK[0];
 
-                    resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
+            resPtr->maxhypscore = (psm.hyperscore * 10 + 0.5);
 
-                    /* Compute expect score if there
-                     * are any candidate PSMs */
+            /* Compute expect score if there
+             * are any candidate PSMs */
 #ifdef TAILFIT
-                    status = expPtr->ModelTailFit(resPtr);
+            status = expPtr->ModelTailFit(resPtr);
 
-                    /* Linear Regression Parameters */
-                    double_t w = resPtr->mu;
-                    double_t b = resPtr->beta;
+            /* Linear Regression Parameters */
+            double_t w = resPtr->mu;
+            double_t b = resPtr->beta;
 
-                    w /= 1e6;
-                    b /= 1e6;
+            w /= 1e6;
+            b /= 1e6;
+#else
+            status = expPtr->ModelSurvivalFunction(resPtr);
+#endif /* TAILFIT */
 
-                    /* Estimate the log (s(x)); x = log(hyperscore) */
-                    double_t lgs_x = (w * resPtr->maxhypscore) + b;
+            for (int_t rank = 0; rank < resPtr->topK.size(); rank++)
+            {
+                hCell &rpsm = resPtr->topK[rank];
+                int_t hyp = (rpsm.hyperscore * 10 + 0.5);
 
-                    /* Compute the s(x) */
-                    double_t e_x = pow(10, lgs_x);
+#ifdef TAILFIT
+                /* Estimate the log (s(x)); x = log(hyperscore) */
+                double_t lgs_x = (w * hyp) + b;
 
-                    /* e(x) = n * s(x) */
-                    e_x *= resPtr->cpsms;
+                /* Compute the s(x) */
+                double_t e_x = pow(10, lgs_x);
+
+                /* e(x) = n * s(x) */
+                e_x *= resPtr->cpsms;
 
 #else
+                /* Model the survival function at the hyperscore
+                 * of the lower ranked PSMs */
+                if (rank > 0)
+                {
+                    resPtr->maxhypscore = hyp;
                     status = expPtr->ModelSurvivalFunction(resPtr);
+                }
 
-                    /* Extract e(x) = n * s(x) = mu * 1e6 */
-                    double_t e_x = resPtr->mu;
+                /* Extract e(x) = n * s(x) = mu * 1e6 */
+                double_t e_x = resPtr->mu;
 
-                    e_x /= 1e6;
+                e_x /= 1e6;
 
 #endif /* TAILFIT */
 
-                    /* Do not print any scores just yet */
-                    if (e_x < params.expect_max)
-                    {
-                        /* Printing the scores in OpenMP mode */
-                        status = DFile_PrintScore(index, currSpecID + queries, pmass, &psm, e_x, resPtr->cpsms);
-                    }
+                /* Do not print any scores just yet */
+                if (e_x < params.expect_max)
+                {
+                    /* Printing the scores in OpenMP mode */
+                    status = DFile_PrintScore(index, currSpecID + queries, pmass, &rpsm, e_x, resPtr->cpsms, rank + 1);
                 }
             }
-
-            /* Reset the results */
-            resPtr->reset();
         }
-#ifdef USE_MPI
-        if (params.nodes > 1)
-            liBuff->currptr = ss->numSpecs * Xsamples * sizeof(ushort_t);
-#endif // USE_MPI
     }
 
-    // Add a thread
-#ifdef USE_MPI
-    if (params.nodes > 1)
-        AddliBuff(liBuff);
-
-#endif // USE_MPI
+    /* Reset the results */
+    resPtr->reset();
 
     return status;
 }
@@ -1098,33 +1240,111 @@ status_t DSLIM_QuerySpectrum(Queries<spectype_t> *ss, Index *index, uint_t idxch
 #ifdef USE_MPI
 void AddliBuff(ebuffer *liBuff)
 {
-    sem_wait(&qfoutlock);
-    qfout->push(liBuff);
-    sem_post(&qfoutlock);
+    qfout->pushWait(liBuff);
 }
 #endif // USE_MPI
 
+/*
+ * FUNCTION: DSLIM_FilterCandidates
+ *
+ * DESCRIPTION: Call the scoring function for each peptide in
+ *              [minlimit, maxlimit] that shares at least minshp
+ *              ions with the query (in peptide order). Compares
+ *              32 (AVX-512) or 16 (AVX2) peptides per instruction
+ *              when the target supports it.
+ *
+ * INPUT:
+ * @bc      : b ion counts
+ * @yc      : y ion counts
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
+ * @minshp  : Minimum shared peaks
+ * @score   : Scoring function
+ *
+ * OUTPUT: none
+ */
+template <class func_t>
+static inline VOID DSLIM_FilterCandidates(const ushort_t *bc, const ushort_t *yc, int_t minlimit, int_t maxlimit,
+                                          ushort_t minshp, func_t &&score)
+{
+    int_t it = minlimit;
+
+#if defined (__AVX512BW__)
+    const __m512i vshp = _mm512_set1_epi16(minshp);
+
+    for (; it + 32 <= maxlimit + 1; it += 32)
+    {
+        __m512i shpk = _mm512_add_epi16(_mm512_loadu_si512((const VOID *)(bc + it)),
+                                        _mm512_loadu_si512((const VOID *)(yc + it)));
+
+        /* One bit per peptide */
+        uint_t mask = _mm512_cmpge_epu16_mask(shpk, vshp);
+
+        for (; mask; mask &= mask - 1)
+            score(it + __builtin_ctz(mask));
+    }
+#elif defined (__AVX2__)
+    const __m256i vshp = _mm256_set1_epi16(minshp);
+
+    for (; it + 16 <= maxlimit + 1; it += 16)
+    {
+        __m256i shpk = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(bc + it)),
+                                        _mm256_loadu_si256((const __m256i *)(yc + it)));
+
+        /* shpk >= minshp iff max(shpk, minshp) == shpk */
+        __m256i ge = _mm256_cmpeq_epi16(_mm256_max_epu16(shpk, vshp), shpk);
+
+        /* Two bits per peptide: keep the even ones */
+        uint_t mask = _mm256_movemask_epi8(ge) & 0x55555555;
+
+        for (; mask; mask &= mask - 1)
+            score(it + (__builtin_ctz(mask) >> 1));
+    }
+#endif // __AVX512BW__
+
+    /* Remaining peptides */
+    for (; it <= maxlimit; it++)
+    {
+        if ((ushort_t)(bc[it] + yc[it]) >= minshp)
+            score(it);
+    }
+}
+
 /*
  * FUNCTION: DSLIM_BinarySearch
  *
- * DESCRIPTION: The Binary Search Algorithm
+ * DESCRIPTION: Find the candidate peptides within the precursor
+ *              mass tolerance using the precursor mass directory
  *
  * INPUT:
+ * @index   : The SLM Index
+ * @precmass: Precursor mass
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
  *
  * OUTPUT
- * none
+ * @rv: true if the window has candidates
  */
 static BOOL DSLIM_BinarySearch(Index *index, float_t precmass, int_t &minlimit, int_t &maxlimit)
 {
     /* Get the float_t precursor mass */
     float_t pmass1 = precmass - params.dM;
     float_t pmass2 = precmass + params.dM;
-    pepEntry *entries = index->pepEntries;
+    float_t *mass = index->pepMass;
 
     BOOL rv = false;
 
-    uint_t min = 0;
-    uint_t max = index->lcltotCnt - 1;
+    int_t min = 0;
+    int_t max = (int_t) index->lcltotCnt - 1;
+
+    /* Empty index */
+    if (max < 0)
+    {
+        minlimit = 0;
+        maxlimit = -1;
+
+        return rv;
+    }
 
     if (params.dM < 0.0)
     {
@@ -1135,11 +1355,11 @@ static BOOL DSLIM_BinarySearch(Index *index, float_t precmass, int_t &minlimit,
     }
 
     /* Check for base case */
-    if (pmass1 < entries[min].Mass)
+    if (pmass1 < mass[min])
     {
         minlimit = min;
     }
-    else if (pmass1 > entries[max].Mass)
+    else if (pmass1 > mass[max])
     {
         minlimit = max;
         maxlimit = max;
@@ -1148,19 +1368,15 @@ static BOOL DSLIM_BinarySearch(Index *index, float_t precmass, int_t &minlimit,
     else
     {
         /* Find the minlimit here */
-        minlimit = DSLIM_BinFindMin(entries, pmass1, min, max);
+        minlimit = DSLIM_MassFindMin(index, pmass1);
     }
 
-    min = 0;
-    max = index->lcltotCnt - 1;
-
-
     /* Check for base case */
-    if (pmass2 > entries[max].Mass)
+    if (pmass2 > mass[max])
     {
         maxlimit = max;
     }
-    else if (pmass2 < entries[min].Mass)
+    else if (pmass2 < mass[min])
     {
         minlimit = min;
         maxlimit = min;
@@ -1169,92 +1385,59 @@ static BOOL DSLIM_BinarySearch(Index *index, float_t precmass, int_t &minlimit,
     else
     {
         /* Find the maxlimit here */
-        maxlimit = DSLIM_BinFindMax(entries, pmass2, min, max);
+        maxlimit = DSLIM_MassFindMax(index, pmass2);
     }
 
-    if (entries[maxlimit].Mass <= pmass2 && entries[minlimit].Mass >= pmass1)
+    if (mass[maxlimit] <= pmass2 && mass[minlimit] >= pmass1)
         rv = true;
 
     return rv;
 }
 
-
-static int_t DSLIM_BinFindMin(pepEntry *entries, float_t pmass1, int_t min, int_t max)
+/*
+ * FUNCTION: DSLIM_MassFindMin
+ *
+ * DESCRIPTION: First peptide with mass >= pmass1. Only the
+ *              peptides in the integer Dalton of pmass1 are
+ *              searched.
+ *
+ * INPUT:
+ * @index : The SLM Index
+ * @pmass1: Mass within the index mass range
+ *
+ * OUTPUT
+ * @pepid: Peptide index
+ */
+static inline int_t DSLIM_MassFindMin(Index *index, float_t pmass1)
 {
-    int_t half = (min + max)/2;
-
-    if (max - min < 20)
-    {
-        int_t current = min;
-
-        while (entries[current].Mass < pmass1)
-            current++;
-
-        return current;
-    }
-
-    if (pmass1 > entries[half].Mass)
-    {
-        min = half;
-        return DSLIM_BinFindMin(entries, pmass1, min, max);
-    }
-    else if (pmass1 < entries[half].Mass)
-    {
-        max = half;
-        return DSLIM_BinFindMin(entries, pmass1, min, max);
-    }
-
-    if (pmass1 == entries[half].Mass)
-    {
-        while (pmass1 == entries[half].Mass)
-            half--;
-
-        half++;
-    }
-
-    return half;
-
+    float_t *mass = index->pepMass;
+    int_t d = (int_t) std::floor(pmass1) - index->massLo;
 
+    return std::lower_bound(mass + index->massDir[d], mass + index->massDir[d + 1], pmass1) - mass;
 }
 
-static int_t DSLIM_BinFindMax(pepEntry *entries, float_t pmass2, int_t min, int_t max)
+/*
+ * FUNCTION: DSLIM_MassFindMax
+ *
+ * DESCRIPTION: Last peptide with mass <= pmass2. Only the
+ *              peptides in the integer Dalton of pmass2 are
+ *              searched.
+ *
+ * INPUT:
+ * @index : The SLM Index
+ * @pmass2: Mass within the index mass range
+ *
+ * OUTPUT
+ * @pepid: Peptide index
+ */
+static inline int_t DSLIM_MassFindMax(Index *index, float_t pmass2)
 {
-    int_t half = (min + max)/2;
-
-    if (max - min < 20)
-    {
-        int_t current = max;
-
-        while (entries[current].Mass > pmass2)
-            current--;
-
-        return current;
-    }
-
-    if (pmass2 > entries[half].Mass)
-    {
-        min = half;
-        return DSLIM_BinFindMax(entries, pmass2, min, max);
-    }
-    else if (pmass2 < entries[half].Mass)
-    {
-        max = half;
-        return DSLIM_BinFindMax(entries, pmass2, min, max);
-    }
-
-    if (pmass2 == entries[half].Mass)
-    {
-        half++;
-
-        while (pmass2 == entries[half].Mass)
-            half++;
-
-        half--;
-    }
-
-    return half;
+    float_t *mass = index->pepMass;
+    int_t d = (int_t) std::floor(pmass2) - index->massLo;
 
+    return std::upper_bound(mass + index->massDir[d], mass + index->massDir[d + 1], pmass2) - mass - 1;
 }
+
 /*
  * FUNCTION: DSLIM_IO_Threads_Entry
  *
@@ -1340,16 +1523,17 @@ VOID DSLIM_IO_Threads_Entry()
          *********************************************/
 
         /* Wait for a I/O request */
-        status = qPtrs->lockw_();
         sem_wait(&ioQlock);
 
-        /* Empty wait queue or Scheduler preemption signal raised  */
+        /* Scheduler preemption signal raised  */
         preempt = SchedHandle->checkPreempt();
 
-        if (qPtrs->isEmptyWaitQ() || preempt)
-        {
-            status = qPtrs->unlockw_();
+        /* Otherwise, get the I/O ptr from the wait queue */
+        ioPtr = (preempt) ? nullptr : qPtrs->getIOPtr();
 
+        /* Empty wait queue or preempted */
+        if (ioPtr == nullptr)
+        {
             status = ioQ->push(Query);
 
             sem_post(&ioQlock);
@@ -1360,17 +1544,15 @@ VOID DSLIM_IO_Threads_Entry()
 
         sem_post(&ioQlock);
 
-        /* Otherwise, get the I/O ptr from the wait queue */
-        ioPtr = qPtrs->getIOPtr();
-
-        status = qPtrs->unlockw_();
-
         /* Reset the ioPtr */
         ioPtr->reset();
 
         /* Extract a chunk and return the chunksize */
         status = Query->extractbatch<int>(QCHUNK, ioPtr, rem_spec);
-        
+
+        if (status != SLM_SUCCESS)
+            exit(status);
+
         // update remaining Query entries
         ioPtr->batchNum = Query->Curr_chunk();
         ioPtr->fileNum  = Query->getQfileIndex();
@@ -1418,42 +1600,219 @@ VOID DSLIM_IO_Threads_Entry()
         SchedHandle->takeControl();
 }
 
-#ifdef USE_MPI
-VOID DSLIM_FOut_Thread_Entry()
+/*
+ * FUNCTION: DSLIM_Prefetch_Thread_Entry
+ *
+ * DESCRIPTION: Entry function of the asynchronous batch loader.
+ *              Keeps up to params.prefetch batch reads of the
+ *              .pbin files in flight (io_uring or a read thread
+ *              pool) and moves the read batches into the ready
+ *              queue as they complete
+ *
+ * INPUT: none
+ *
+ * OUTPUT: none
+ */
+VOID DSLIM_Prefetch_Thread_Entry()
 {
-    int_t batchSize = 0;
-    ebuffer *lbuff = nullptr;
+    status_t status = SLM_SUCCESS;
+
+#if defined (USE_TIMEMORY)
+    thread_local prep_tuple_t prep_inst("preprocess");
+    prep_inst.start();
+#endif // USE_TIMEMORY
+
+    hcp::io::asyncreader reader(params.prefetch);
 
-    for (;;usleep(1))
+    // a batch being read
+    struct batchread
     {
-        sem_wait(&qfoutlock);
+        MSQuery *Query;
+        Queries<spectype_t> *ioPtr;
+        uint_t startspec;
+        uint_t endspec;
+        uint_t batchNum;
+        std::vector<char_t> bytes;
+    };
+
+    std::vector<batchread> reads(reader.capacity());
+    std::vector<int_t> freereads(reader.capacity());
+    std::iota(freereads.begin(), freereads.end(), 0);
+
+    // open files and their batches in flight
+    std::map<MSQuery *, std::pair<int_t, int_t>> files;
+
+    MSQuery *Query = nullptr;
+    int_t rem_spec = 0;
+    bool_t eSignal = false;
+
+    while (!scheduler_init) { usleep(1); }
 
-        if (qfout->isEmpty())
+    for (;status == SLM_SUCCESS;)
+    {
+        /* Issue reads while there are free slots and empty buffers */
+        while (!freereads.empty() && !eSignal)
         {
-            sem_post(&qfoutlock);
+            /* Get the next query file */
+            if (Query == nullptr)
+            {
+                sem_wait(&qfilelock);
+
+                if (!qfPtrs->isEmpty())
+                {
+                    Query = qfPtrs->front();
+                    qfPtrs->pop();
+                    rem_spec = Query->getQAcount();
+                }
+                else
+                    eSignal = true;
+
+                sem_post(&qfilelock);
+
+                if (eSignal)
+                    break;
+
+                /* Nothing to read */
+                if (rem_spec < 1)
+                {
+                    status = Query->DeinitQueryFile();
+
+                    delete Query;
+                    Query = nullptr;
+
+                    continue;
+                }
+
+                int_t fd = open(Query->getFilename().c_str(), O_RDONLY);
+
+                if (fd < 0)
+                {
+                    std::cerr << "Error opening file: " << Query->getFilename() << std::endl;
+                    exit(ERR_FILE_NOT_FOUND);
+                }
+
+                files[Query] = std::make_pair(fd, 0);
+            }
+
+            /* Get an empty buffer from the wait queue */
+            Queries<spectype_t> *ioPtr = qPtrs->getIOPtr();
+
+            if (ioPtr == nullptr)
+                break;
+
+            int_t slot = freereads.back();
+            freereads.pop_back();
+
+            auto &rd = reads[slot];
+            ull_t offset = 0, length = 0;
+
+            rd.Query = Query;
+            rd.ioPtr = ioPtr;
+
+            status = Query->reservebatch(QCHUNK, rd.startspec, rd.endspec, offset, length, rem_spec);
+
+            if (status != SLM_SUCCESS)
+                exit(status);
+
+            rd.batchNum = Query->Curr_chunk()++;
+
+            if (rd.bytes.size() < length)
+                rd.bytes.resize(length);
+
+            auto &file = files[Query];
+            file.second++;
 
-            if (exitSignal)
-                return;
+            reader.submit(file.first, rd.bytes.data(), length, offset, slot);
 
+            /* All batches of the file have been issued */
+            if (rem_spec < 1)
+                Query = nullptr;
+        }
+
+        if (reader.pending() == 0)
+        {
+            /* All batches loaded */
+            if (eSignal)
+                break;
+
+            /* Sleep until the search returns a buffer */
+            qPtrs->waitIO();
             continue;
         }
 
-        lbuff = qfout->front();
-        qfout->pop();
+        /* Move a read batch to the ready queue */
+        ull_t slot;
+        ssize_t res;
+
+        if (!reader.wait(slot, res) || res < 0)
+        {
+            std::cerr << "Error reading MS/MS batch: " << std::strerror((res < 0) ? -res : errno) << std::endl;
+            exit(ERR_FILE_ERROR);
+        }
+
+        auto &rd = reads[slot];
+        auto ioPtr = rd.ioPtr;
+
+        /* Reset the ioPtr */
+        ioPtr->reset();
+
+        status = rd.Query->readbatch(rd.bytes.data(), rd.startspec, rd.endspec, ioPtr);
+
+        if (status != SLM_SUCCESS)
+            exit(status);
+
+        ioPtr->batchNum = rd.batchNum;
+        ioPtr->fileNum  = rd.Query->getQfileIndex();
 
-        sem_post(&qfoutlock);
+        /* Lock the ready queue */
+        qPtrs->lockr_();
 
-        ofstream *fh = new ofstream;
-        string_t fn = params.workspace + "/" +
-                    std::to_string(lbuff->batchNum) +
-                    "_" + std::to_string(params.myid) + ".dat";
-        batchSize = lbuff->currptr / (Xsamples * sizeof(ushort_t));
-        fh->open(fn, ios::out | ios::binary);
-        fh->write((char_t *)lbuff->packs, batchSize * sizeof(partRes));
-        fh->write(lbuff->ibuff, lbuff->currptr * sizeof (char_t));
-        fh->close();
+#ifdef USE_MPI
+        if (params.nodes > 1)
+        {
+            /* Add an entry of the added buffer to the CommHandle */
+            status = CommHandle->AddBatch(ioPtr->batchNum, ioPtr->numSpecs, rd.Query->getQfileIndex());
+        }
+#endif /* USE_MPI */
 
-        delete lbuff;
+        /* Add available data to ready queue */
+        qPtrs->IODone(ioPtr);
+
+        /* Unlock the ready queue */
+        qPtrs->unlockr_();
+
+        freereads.push_back(slot);
+
+        /* Deinit the file once all its batches are loaded */
+        auto file = files.find(rd.Query);
+
+        if (--file->second.second == 0 && rd.Query != Query)
+        {
+            close(file->second.first);
+
+            status = rd.Query->DeinitQueryFile();
+
+            delete rd.Query;
+            files.erase(file);
+        }
+    }
+
+#if defined (USE_TIMEMORY)
+    prep_inst.stop();
+#endif // USE_TIMEMORY
+}
+
+#ifdef USE_MPI
+VOID DSLIM_FOut_Thread_Entry()
+{
+    ebuffer *lbuff = nullptr;
+
+    /* Sleep until a buffer is added or the queue is closed */
+    while (qfout->popWait(lbuff))
+    {
+        /* Send the partial results to the node combining the batch */
+        if (CommHandle->AddPartials(lbuff) != SLM_SUCCESS)
+            std::cerr << "ERROR: Failed to send the partial results @: " << params.myid << std::endl;
     }
 }
 #endif /* USE_MPI */
@@ -18,6 +18,7 @@
  */
 
 #include "dslim_score.h"
+#include "dslim_comm.h"
 #include "dslim_fileout.h"
 #include "cuda/superstep4/kernel.hpp"
 
@@ -26,7 +27,6 @@
 using namespace std;
 
 MPI_Datatype resultF;
-string_t fn;
 
 extern gParams params;
 extern VOID DSLIM_Score_Thread_Entry();
@@ -48,6 +48,9 @@ DSLIM_Score::DSLIM_Score()
     ePtr      = NULL;
     heapArray = NULL;
     index = NULL;
+    partials = NULL;
+    comm = NULL;
+    rxOffset = 0;
 
     /* Data size that I expect to
      * receive from other processes */
@@ -88,6 +91,9 @@ DSLIM_Score::DSLIM_Score(BData *bd)
     ePtr = bd->ePtr;
     heapArray = bd->heapArray;
     index = bd->index;
+    partials = bd->partials;
+    comm = bd->comm;
+    rxOffset = 0;
 
     /* Data size that I expect to
      * receive from other processes */
@@ -187,6 +193,20 @@ DSLIM_Score::~DSLIM_Score()
         RxValues = NULL;
     }
 
+    /* Stops receiving the partials */
+    if (comm != NULL)
+    {
+        delete comm;
+        comm = NULL;
+    }
+
+    /* Released by CombineResults */
+    if (partials != NULL)
+    {
+        delete[] partials;
+        partials = NULL;
+    }
+
     FreeDataTypes();
 
     nSpectra = 0;
@@ -202,48 +222,44 @@ status_t DSLIM_Score::CombineResults()
 
     /* Each node sent its sample */
     const int_t nSamples = params.nodes;;
-    auto startSpec= 0;
     ifstream *fhs = NULL;
     ebuffer  *iBuffs = NULL;
 
+    /* Partial results of the batch from each node */
+    std::vector<ebuffer *> sBuffs(nSamples, nullptr);
+
     if (this->myRXsize > 0)
     {
         fhs = new ifstream[nSamples];
         iBuffs = new ebuffer[nSamples];
     }
 
-    auto vbatch = params.myid;
+    /* Offsets of my batches in TxValues */
+    std::vector<int_t> startSpecs(this->nBatches + 1, 0);
+
+    for (auto batchNum = 0; batchNum < this->nBatches; batchNum++)
+        startSpecs[batchNum + 1] = startSpecs[batchNum] + sizeArray[batchNum];
 
-    for (auto batchNum = 0; batchNum < this->nBatches; batchNum++, vbatch += nSamples)
+    /* Combine the batches as their partials land */
+    for (auto done = 0; done < this->nBatches; done++)
     {
 #if defined (PROGRESS)
         if (params.myid == 0)
-            std::cout << "\rDONE:\t\t" << (batchNum * 100) /this->nBatches << "%";
+            std::cout << "\rDONE:\t\t" << (done * 100) /this->nBatches << "%";
 #endif // PROGRESS
-        auto bSize = sizeArray[batchNum];
+        auto batchNum = NextBatch(done);
 
-        for (int_t saa = 0; saa < nSamples; saa++)
+        if (batchNum < 0 || batchNum >= this->nBatches)
         {
-            fn = params.workspace + "/" + std::to_string(vbatch) + "_"
-                    + std::to_string(saa) + ".dat";
-
-            fhs[saa].open(fn, ios::in | ios::binary);
-
-            if (fhs[saa].is_open())
-            {
-                fhs[saa].read((char_t *)iBuffs[saa].packs, bSize * sizeof(partRes));
-                fhs[saa].read(iBuffs[saa].ibuff, bSize * Xsamples * sizeof(ushort_t));
+            status = ERR_INVLD_SIZE;
+            break;
+        }
 
-                if (fhs[saa].fail())
-                {
-                    status = ERR_FILE_NOT_FOUND;
-                    std::cout << "FATAL: File Read Failed" << std::endl;
-                    exit(status);
-                }
-            }
+        auto startSpec = startSpecs[batchNum];
+        auto bSize = sizeArray[batchNum];
 
-            fn.clear();
-        }
+        for (int_t saa = 0; saa < nSamples; saa++)
+            sBuffs[saa] = ReadPartials(batchNum, saa, iBuffs + saa, fhs[saa]);
 
 #ifdef USE_OMP
 #pragma omp parallel for schedule (dynamic, 4) num_threads(params.threads)
@@ -265,7 +281,7 @@ status_t DSLIM_Score::CombineResults()
             for (int_t sno = 0; sno < nSamples; sno++)
             {
                 /* Pointer to Result sample */
-                partRes *sResult = iBuffs[sno].packs + spec;
+                partRes *sResult = sBuffs[sno]->packs + spec;
 
                 if (*sResult == 0)
                     continue;
@@ -277,7 +293,7 @@ status_t DSLIM_Score::CombineResults()
                 if (sResult->N >= 1)
                 {
                     /* Reconstruct the partial histogram */
-                    expPtr->Reconstruct(&iBuffs[sno], spec, sResult);
+                    expPtr->Reconstruct(sBuffs[sno], spec, sResult);
 
                     /* Record the maxhypscore and its key */
                     if (sResult->max > 0 && sResult->max > maxhypscore)
@@ -306,7 +322,7 @@ status_t DSLIM_Score::CombineResults()
                 /* If the scores are good enough */
                 if (e_x < params.expect_max)
                 {
-                    partRes *ssResult = iBuffs[key].packs + spec;
+                    partRes *ssResult = sBuffs[key]->packs + spec;
 
                     psm->eValue = e_x * 1e6;
                     psm->specID = ssResult-> qID;
@@ -341,23 +357,9 @@ status_t DSLIM_Score::CombineResults()
             }
         }
 
-        /* Update the counters */
-        startSpec += sizeArray[batchNum];
-
-        /* Remove the files when no longer needed */
+        /* Release the partials (remove the files) when no longer needed */
         for (int_t saa = 0; saa < nSamples; saa++)
-        {
-            fn = params.workspace + "/" + std::to_string(vbatch) + "_" + std::to_string(saa)
-                    + ".dat";
-
-            if (fhs[saa].is_open())
-            {
-                fhs[saa].close();
-                std::remove((const char_t *) fn.c_str());
-            }
-
-            fn.clear();
-        }
+            ReleasePartials(batchNum, saa, fhs[saa]);
     }
 
     if (this->myRXsize > 0)
@@ -387,21 +389,128 @@ status_t DSLIM_Score::CombineResults()
 }
 
 
+/*
+ * FUNCTION: NextBatch
+ *
+ * DESCRIPTION: Get the next batch to combine: the first one
+ *              whose partials have landed from all nodes
+ *
+ * INPUT:
+ * @done: Number of batches combined so far
+ *
+ * OUTPUT:
+ * @batchNum: My batch number (position)
+ */
+int_t DSLIM_Score::NextBatch(int_t done)
+{
+    if (comm == NULL)
+        return done;
+
+    return comm->Wait4Batch();
+}
+
+/*
+ * FUNCTION: ReadPartials
+ *
+ * DESCRIPTION: Get the partial results of a node for one of my
+ *              batches: from memory if received over MPI, else
+ *              read them from the spilled workspace file
+ *
+ * INPUT:
+ * @batchNum: My batch number (position)
+ * @sample  : The node that searched the batch
+ * @fbuff   : Buffer to read a spilled file into
+ * @fh      : File handle for a spilled file
+ *
+ * OUTPUT:
+ * @ebuff: The partial results
+ */
+ebuffer *DSLIM_Score::ReadPartials(int_t batchNum, int_t sample, ebuffer *fbuff, std::ifstream &fh)
+{
+    auto nodes = params.nodes;
+
+    if (partials != NULL && partials[batchNum * nodes + sample] != NULL)
+        return partials[batchNum * nodes + sample];
+
+    auto bSize = sizeArray[batchNum];
+
+    fh.open(DSLIM_PartialsFile(params.myid + batchNum * nodes, sample), ios::in | ios::binary);
+
+    if (fh.is_open())
+    {
+        partHeader hdr;
+
+        fh.read((char_t *) &hdr, sizeof(partHeader));
+
+        /* Encoded histograms are never larger than the raw ones */
+        if (fh.fail() || hdr.bsize != bSize || hdr.nbytes < 0 || hdr.nbytes > bSize * Xsamples * (int_t) sizeof(ushort_t))
+        {
+            std::cout << "FATAL: Invalid partial results file" << std::endl;
+            exit(ERR_INVLD_SIZE);
+        }
+
+        fh.read((char_t *)fbuff->packs, bSize * sizeof(partRes));
+        fh.read(fbuff->ibuff, hdr.nbytes);
+
+        fbuff->currptr = hdr.nbytes;
+        fbuff->codec = (PartCodec_t) hdr.codec;
+
+        if (fh.fail())
+        {
+            std::cout << "FATAL: File Read Failed" << std::endl;
+            exit(ERR_FILE_NOT_FOUND);
+        }
+    }
+
+    return fbuff;
+}
+
+/*
+ * FUNCTION: ReleasePartials
+ *
+ * DESCRIPTION: Free the partial results of a node for one of
+ *              my batches or remove the spilled workspace file
+ *
+ * INPUT:
+ * @batchNum: My batch number (position)
+ * @sample  : The node that searched the batch
+ * @fh      : File handle of a spilled file
+ *
+ * OUTPUT: none
+ */
+VOID DSLIM_Score::ReleasePartials(int_t batchNum, int_t sample, std::ifstream &fh)
+{
+    auto nodes = params.nodes;
+
+    if (partials != NULL && partials[batchNum * nodes + sample] != NULL)
+    {
+        delete partials[batchNum * nodes + sample];
+        partials[batchNum * nodes + sample] = NULL;
+    }
+    else if (fh.is_open())
+    {
+        fh.close();
+        std::remove(DSLIM_PartialsFile(params.myid + batchNum * nodes, sample).c_str());
+    }
+}
+
 status_t DSLIM_Score::ScatterScores()
 {
     status_t status = SLM_SUCCESS;
 
     /* Get the number of nodes - 1 */
     int_t nodes   = params.nodes;
-    int_t cumulate = 0;
 
     /* MPI pointers */
     MPI_Request *txRqsts  = new MPI_Request [nodes];
     int_t         *txStats  = new int_t[nodes];
 
-    /* Fill the txStats with zeros - not available */
+    /* No request to myself (or nodes with no results) */
     for (int_t kk = 0; kk < nodes; kk++)
+    {
+        txRqsts[kk] = MPI_REQUEST_NULL;
         txStats[kk] = 1;
+    }
 
     /* Check if everything is in order */
     if (txRqsts != NULL && txStats != NULL)
@@ -409,80 +518,17 @@ status_t DSLIM_Score::ScatterScores()
     else
         status = ERR_INVLD_MEMORY;
 
+    /* The receivers have their requests posted */
     if (status == SLM_SUCCESS)
-    {
-        /* Wait 500ms between each loop */
-         for (int_t cumulate = 0; cumulate < nodes; usleep(500000))
-         {
-             cumulate = 0;
-
-             for (int_t ll = 0; ll < nodes; ll ++)
-             {
-                 /* Only check if not already received */
-                 if (txStats[ll] == 0 && ll != (int_t)params.myid)
-                 {
- #ifdef DIAGNOSE2
-                     std::cout << " MPI_Test@ " << params.myid << "Stat: "
-                          << txStats2[ll] << " ll: " << ll << std::endl;
- #endif /* DIAGNOSE2 */
-                     status = MPI_Test(txRqsts + ll, &txStats[ll], MPI_STATUS_IGNORE);
-
-                     /* Check if the results
-                      * have been sent
-                      */
-                     if (txStats[ll])
-                         cumulate++;
-                 }
-                 else
-                 {
-                     cumulate++;
-                 }
-             }
-         }
-
-    }
+        status = MPI_Waitall(nodes, txRqsts, MPI_STATUSES_IGNORE);
 
     /* Check if even I need to send anything? */
     if (status == SLM_SUCCESS && myRXsize != 0)
     {
-        /* Fill the txStats with zeros - not available */
-        for (int_t kk = 0; kk < nodes; kk++)
-            txStats[kk] = 1;
-
         status = TXResults(txRqsts, txStats);
 
         if (status == SLM_SUCCESS)
-        {
-            /* Wait 500ms between each loop */
-            for (; cumulate < nodes; usleep(500000))
-            {
-                /* Reset cumulate to 0 */
-                cumulate = 0;
-
-                for (int_t ll = 0; ll < nodes; ll++)
-                {
-                    /* Only check if not already received */
-                    if (txStats[ll] == 0 && ll != (int_t)params.myid)
-                    {
-#ifdef DIAGNOSE2
-                        std::cout << " MPI_Test@ " << params.myid << "Stat: "
-                             << txStats2[ll] << " ll: " << ll << std::endl;
-#endif /* DIAGNOSE2 */
-                        status = MPI_Test(txRqsts + ll, &txStats[ll], MPI_STATUS_IGNORE);
-
-                        /* Check if the results
-                         * have been sent
-                         */
-                        if (txStats[ll])
-                            cumulate++;
-                    }
-                    else
-                    {
-                        cumulate++;
-                    }
-                }
-            }
-        }
+            status = MPI_Waitall(nodes, txRqsts, MPI_STATUSES_IGNORE);
     }
 
     /* Deallocate the rxRqsts */
@@ -506,7 +552,7 @@ status_t DSLIM_Score::TXSizes(MPI_Request *txRqsts, int_t *txStats)
 {
     status_t status = SLM_SUCCESS;
 
-    for (uint_t kk = 0; kk < params.nodes; kk++, usleep(5000))
+    for (uint_t kk = 0; kk < params.nodes; kk++)
     {
         /* If myself then no RX */
         if (kk == params.myid)
@@ -578,7 +624,7 @@ status_t DSLIM_Score::TXResults(MPI_Request *txRqsts, int_t* txStats)
 
     int_t offset = 0;
 
-    for (uint_t kk = 0; kk < params.nodes; kk++, usleep(5000))
+    for (uint_t kk = 0; kk < params.nodes; kk++)
     {
         /* If myself then no RX */
         if (kk == params.myid || txSizes[kk] == 0)
@@ -609,40 +655,28 @@ status_t DSLIM_Score::TXResults(MPI_Request *txRqsts, int_t* txStats)
     return status;
 }
 
-status_t DSLIM_Score::RXResults(MPI_Request *rxRqsts, int_t *rxStats)
+status_t DSLIM_Score::RXResults(MPI_Request *rxRqsts, int_t node)
 {
     status_t status = SLM_SUCCESS;
 
-    int_t offset = 0;
-
-    for (uint_t kk = 0; kk < params.nodes; kk++)
-    {
-        /* If myself then no RX */
-        if (kk == params.myid || rxSizes[kk] == 0)
-        {
-            rxStats[kk] = 1;
-        }
-        else
-        {
+    /* Nothing to receive */
+    if (node == (int_t) params.myid || rxSizes[node] == 0)
+        return status;
 
 #ifdef DIAGNOSE2
-            std::cout << "RXSIZE: " << params.myid << " -> " << kk << " Size: "<< txSizes[ll] << std::endl;
+    std::cout << "RXSIZE: " << params.myid << " <- " << node << " Size: "<< rxSizes[node] << std::endl;
 #endif /* DIAGNOSE */
 
-            if (RxValues == NULL || rxRqsts == NULL || offset + rxSizes[kk] > nSpectra)
-            {
-                std::cout << "FATAL: RxValues failed @: " << params.myid << std::endl;
-                exit(-1);
-            }
-
-            /* Send an integer to all other machines */
-            status = MPI_Irecv(RxValues + offset, rxSizes[kk], resultF, kk, 0x1, MPI_COMM_WORLD, rxRqsts + kk);
+    if (RxValues == NULL || rxRqsts == NULL || rxOffset + rxSizes[node] > nSpectra)
+    {
+        std::cout << "FATAL: RxValues failed @: " << params.myid << std::endl;
+        exit(-1);
+    }
 
-            offset += rxSizes[kk];
+    /* Receive the results in the order the sizes land */
+    status = MPI_Irecv(RxValues + rxOffset, rxSizes[node], resultF, node, 0x1, MPI_COMM_WORLD, rxRqsts + node);
 
-            rxStats[kk] = 0;
-        }
-    }
+    rxOffset += rxSizes[node];
 
     return status;
 }
@@ -53,6 +53,8 @@ status_t DSLIM_CarryForward(Index *index, DSLIM_Comm *CommHandle, expeRT *ePtr,
         bdata->heapArray = CandidatePSMS;
         bdata->fileArray = CommHandle->fileArray;
         bdata->sizeArray = CommHandle->sizeArray;
+        bdata->partials  = CommHandle->partials;
+        bdata->comm      = CommHandle;
         bdata->nBatches  = CommHandle->nBatches;
         bdata->cPSMsize  = cpsmSize;
 
@@ -223,83 +225,47 @@ VOID DSLIM_Score_Thread_Entry()
     /* Get the number of nodes - 1 */
     int_t nodes   = params.nodes;
 
-    /* MPI pointers */
+    /* MPI pointers: the size receives [0, nodes)
+     * and the result receives [nodes, 2 * nodes) */
     MPI_Request *rxRqsts  = NULL;
     int_t         *rxStats  = NULL;
+    int_t         *indices  = NULL;
 
-    /* 2X per all other machines */
-    rxRqsts = new MPI_Request [nodes];
+    rxRqsts = new MPI_Request [2 * nodes];
     rxStats = new int_t[nodes];
+    indices = new int_t[2 * nodes];
 
-    /* Fill the rxStats with ones - available */
-    for (int_t kk = 0; kk < nodes; kk++)
-        rxStats[kk] = 1;
+    /* No requests yet */
+    for (int_t kk = 0; kk < 2 * nodes; kk++)
+        rxRqsts[kk] = MPI_REQUEST_NULL;
 
     /* Avoid race conditions by waiting for
      * ScoreHandle pointer to initialize */
     while (!score_init) { usleep(1); }
 
-    if (rxRqsts != NULL && rxStats != NULL)
-        ScoreHandle->RXSizes(rxRqsts, rxStats);
+    ScoreHandle->RXSizes(rxRqsts, rxStats);
 
-    /* Wait 500ms between each loop */
-    for (int_t cumulate = 0; cumulate < nodes; usleep(500000))
+    /* Progress the receives as they complete: post the results
+     * receive of a node as soon as its size lands. Back off in
+     * between so that the combine keeps all of its cores */
+    for (;;)
     {
-        cumulate = 0;
+        int_t outcount = 0;
 
-        for (int_t ll = 0; ll < nodes; ll++)
-        {
-            /* Only check if not already received */
-            if (rxStats[ll] == 0 && ll != (int_t) params.myid)
-            {
-                //std::cout << (void *)((MPI_Request*)(rxRqsts + ll)) << " rxRqsts@:" << params.myid << std::endl;
-                MPI_Test(rxRqsts + ll, &rxStats[ll], MPI_STATUS_IGNORE);
-
-                /* Check if the results
-                 * have been received
-                 */
-                if (rxStats[ll])
-                    cumulate++;
-
-            }
-            else
-            {
-                cumulate++;
-            }
-        }
-    }
-
-    /* Fill the rxStats with ones - available */
-    for (int_t kk = 0; kk < nodes; kk++)
-        rxStats[kk] = 1;
+        MPI_Testsome(2 * nodes, rxRqsts, &outcount, indices, MPI_STATUSES_IGNORE);
 
-    ScoreHandle->RXResults(rxRqsts, rxStats);
+        /* No active requests left */
+        if (outcount == MPI_UNDEFINED)
+            break;
 
-    /* Wait 500ms between each loop */
-    for (int_t cumulate = 0; cumulate < nodes; usleep(500000))
-    {
-        cumulate = 0;
-
-        for (int_t ll = 0; ll < nodes; ll++)
+        for (int_t ll = 0; ll < outcount; ll++)
         {
-            /* Only check if not already received */
-            if (rxStats[ll] == 0 && ll != (int_t) params.myid)
-            {
-                //std::cout << (void *)((MPI_Request*)(rxRqsts + ll)) << " rxRqsts@:" << params.myid << std::endl;
-                MPI_Test(rxRqsts + ll, &rxStats[ll], MPI_STATUS_IGNORE);
-
-                /* Check if the results
-                 * have been received
-                 */
-                if (rxStats[ll])
-                    cumulate++;
-
-            }
-            else
-            {
-                cumulate++;
-            }
+            if (indices[ll] < nodes)
+                ScoreHandle->RXResults(rxRqsts + nodes, indices[ll]);
         }
+
+        if (outcount == 0)
+            usleep(RX_WAITUS);
     }
 
     /* Deallocate the rxRqsts */
@@ -315,6 +281,9 @@ VOID DSLIM_Score_Thread_Entry()
         delete [] rxStats;
         rxStats = NULL;
     }
+
+    delete [] indices;
+    indices = NULL;
 }
 #endif /* USE_MPI */
 
@@ -24,6 +24,8 @@
 
 using namespace std;
 
+extern gParams params;
+
 // -------------------------------------------------------------------------------------------- //
 
 expeRT::expeRT()
@@ -797,40 +799,110 @@ status_t expeRT::StoreIResults(Results *rPtr, int_t spec, ebuffer *ofs)
 
 // -------------------------------------------------------------------------------------------- //
 
-status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR)
+/*
+ * FUNCTION: Encode
+ *
+ * DESCRIPTION: Encode the partial histograms of a batch in place
+ *              as a stream (kept raw if the stream is not smaller):
+ *
+ *              uint_t  offs[bsize + 1]   offsets of the spectra's codes
+ *              uchar_t codes[]           of the [min, max2] samples:
+ *
+ *              lossless: varint zigzag deltas of the samples
+ *
+ * INPUT:
+ * @ebs  : Partial results of a batch (raw)
+ * @bsize: Number of spectra in the batch
+ * @codec: The encoding
+ *
+ * OUTPUT:
+ * @status: status of execution
+ */
+status_t expeRT::Encode(ebuffer *ebs, int_t bsize, PartCodec_t codec)
 {
-    status_t status = SLM_SUCCESS;
+    if (ebs->codec != PartCodec_t::raw)
+        return ERR_INVLD_PARAM;
 
-    auto min  = fR->min;
-    auto max2 = fR->max2;
+    if (codec == PartCodec_t::raw)
+        return SLM_SUCCESS;
 
-    pN += fR->N;
+    const int_t rawsize = bsize * Xsamples * sizeof(ushort_t);
 
-    char_t *buffer = ebs->ibuff + (specno * (Xsamples * 2));
+    std::vector<uchar_t> codes((bsize + 1) * sizeof(uint_t));
 
-    for (auto jj = min; jj <= max2; jj++)
+    codes.reserve(rawsize);
+
+    auto putvarint = [&codes](uint_t val)
     {
-        ushort_t *val = (ushort_t*) (buffer + (jj - min) * 2);
+        for (; val >= 0x80; val >>= 7)
+            codes.push_back((uchar_t) (val | 0x80));
 
-        double_t val1 = (*val);
+        codes.push_back((uchar_t) val);
+    };
 
-        /* Decode from 65500 levels */
-        if (fR->N > 65500)
+    for (int_t spec = 0; spec < bsize; spec++)
+    {
+        partRes *fR = ebs->packs + spec;
+
+        uint_t offset = codes.size();
+        memcpy(codes.data() + spec * sizeof(uint_t), &offset, sizeof(offset));
+
+        /* Only the spectra with data are reconstructed */
+        if (fR->N < 1)
+            continue;
+
+        int_t base = spec * Xsamples * sizeof(ushort_t);
+        int_t width = fR->max2 - fR->min + 1;
+
+        for (int_t jj = 0, prev = 0; jj < width; jj++)
         {
-            val1 = (val1/65500) * fR->N;
+            int_t ptr = base + jj * sizeof(ushort_t);
+            ushort_t val = 0;
+
+            if (ptr + (int_t) sizeof(ushort_t) <= rawsize)
+                memcpy(&val, ebs->ibuff + ptr, sizeof(val));
+
+            /* zigzag: small deltas of either sign in few bits */
+            int_t delta = val - prev;
+
+            putvarint((delta < 0) ? ((uint_t) (-delta) << 1) - 1 : (uint_t) delta << 1);
+            prev = val;
         }
 
-        (*pdata)[jj] = (*pdata)[jj] + val1;
+        /* Not worth it */
+        if ((int_t) codes.size() >= rawsize)
+            return SLM_SUCCESS;
     }
 
-    return status;
+    uint_t offset = codes.size();
+    memcpy(codes.data() + bsize * sizeof(uint_t), &offset, sizeof(offset));
+
+    memcpy(ebs->ibuff, codes.data(), codes.size());
+    ebs->currptr = codes.size();
+    ebs->codec = codec;
+
+    return SLM_SUCCESS;
 }
 
 // -------------------------------------------------------------------------------------------- //
 
-#if defined (USE_GPU) && defined (USE_MPI)
-
-status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR, double *target)
+/*
+ * FUNCTION: Decode
+ *
+ * DESCRIPTION: Add the partial histogram of a spectrum
+ *              to the target (see Encode for the layout)
+ *
+ * INPUT:
+ * @ebs   : Partial results of a batch
+ * @specno: Spectrum in the batch
+ * @fR    : Its packed result
+ * @target: Histogram to add to
+ *
+ * OUTPUT:
+ * @status: status of execution
+ */
+template <class T>
+status_t expeRT::Decode(ebuffer *ebs, int_t specno, partRes *fR, T &target)
 {
     status_t status = SLM_SUCCESS;
 
@@ -839,13 +911,57 @@ status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR, double *ta
 
     pN += fR->N;
 
-    char_t *buffer = ebs->ibuff + (specno * (Xsamples * 2));
+    const uchar_t *codes = (const uchar_t *) ebs->ibuff;
+
+    auto getvarint = [&codes]()
+    {
+        uint_t val = 0;
+
+        for (int_t shift = 0; ; shift += 7)
+        {
+            uchar_t byte = *codes++;
+            val |= (uint_t) (byte & 0x7F) << shift;
+
+            if (!(byte & 0x80))
+                return val;
+        }
+    };
+
+    if (ebs->codec != PartCodec_t::raw)
+    {
+        uint_t offset = 0;
+        memcpy(&offset, codes + specno * sizeof(uint_t), sizeof(offset));
+        codes += offset;
+    }
+    else
+        codes += specno * (Xsamples * 2);
+
+    /* Previous sample (lossless) */
+    double_t prev = 0;
 
     for (auto jj = min; jj <= max2; jj++)
     {
-        ushort_t *val = (ushort_t*) (buffer + (jj - min) * 2);
+        double_t val1 = 0;
+
+        switch (ebs->codec)
+        {
+            case PartCodec_t::lossless:
+            {
+                uint_t zz = getvarint();
+
+                prev += (zz & 1) ? -(double_t) ((zz + 1) >> 1) : (double_t) (zz >> 1);
+                val1 = prev;
+                break;
+            }
 
-        double_t val1 = (*val);
+            default:
+            {
+                ushort_t val;
+                memcpy(&val, codes + (jj - min) * 2, sizeof(val));
+                val1 = val;
+                break;
+            }
+        }
 
         /* Decode from 65500 levels */
         if (fR->N > 65500)
@@ -859,6 +975,22 @@ status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR, double *ta
     return status;
 }
 
+// -------------------------------------------------------------------------------------------- //
+
+status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR)
+{
+    return Decode(ebs, specno, fR, *pdata);
+}
+
+// -------------------------------------------------------------------------------------------- //
+
+#if defined (USE_GPU) && defined (USE_MPI)
+
+status_t expeRT::Reconstruct(ebuffer *ebs, int_t specno, partRes *fR, double *target)
+{
+    return Decode(ebs, specno, fR, target);
+}
+
 #endif // USE_GPU && USE_MPI
 
 // -------------------------------------------------------------------------------------------- //
@@ -1072,38 +1204,49 @@ double_t expeRT::logWeibullFit(lwvector<double_t> *yy, int_t s, int_t e, int_t n
 
     beta_t = 4.0;
 
-    const darray y(yy->data(), yy->Size());
-    const darray X1(arange(s, e));
+    const double_t *y = yy->data();
+    const int_t n = std::min((int_t) yy->Size(), e - s + 1);
 
     for (auto i = 0; i < niter; i++)
     {
-        /* Gumbel distribution response */
-        darray h_x(alogWeibullResponse(mu_t, beta_t, s, e));
+        double_t d = 0;
+        double_t ee = 0;
 
-        /* Difference */
-        darray diff = y - h_x;
+        curerr = 0;
 
-        /* Current error */
-        curerr = MeanSqError(diff);
-
-        /* Check for break condition */
-        if (curerr < cutoff)
+        /* Gumbel distribution response, its error and the
+         * partial derivatives in one pass (no temporaries) */
+        for (auto k = 0; k < n; k++)
         {
-            break;
-        }
+            double_t z = (s + k - mu_t) / beta_t;
+            double_t ez = exp(-z);
 
-        /* Compute the partial derivatives */
-        darray b = -h_x/(beta_t);
-        darray c = (mu_t - X1)/beta_t - (mu_t-X1)/beta_t * exp((mu_t - X1)/beta_t);
+            double_t h_x = (1 / beta_t) * exp(-(z + ez));
 
-        b = b + b * c;
+            /* Difference */
+            double_t diff = y[k] - h_x;
 
-        auto d = (diff * b).sum();
+            curerr += diff * diff;
 
-        darray e = h_x/beta_t;
-        e = (e - e * exp((mu_t - X1)/beta_t));
+            /* Compute the partial derivatives */
+            double_t b = -h_x / beta_t;
+            double_t c = (-z) - (-z) * ez;
 
-        auto ee = (diff * e).sum();
+            b = b + b * c;
+
+            d += diff * b;
+
+            double_t ex = h_x / beta_t;
+            ex = (ex - ex * ez);
+
+            ee += diff * ex;
+        }
+
+        /* Check for break condition */
+        if (curerr < cutoff)
+        {
+            break;
+        }
 
         /* Update the mu and beta */
         mu_t   += lr * ee;
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+
+namespace hcp
+{
+namespace io
+{
+
+//
+// asynchronous positional file reads. Up to depth reads are kept in
+// flight using io_uring (if available at build and run time) or a
+// pool of threads doing blocking preads otherwise. Short reads are
+// completed internally, so a completed read either filled the whole
+// buffer or failed
+//
+class asyncreader
+{
+private:
+
+    // an in flight read
+    struct request
+    {
+        int_t    fd;
+        char_t  *buf;
+        size_t   len;
+        ull_t    off;
+        size_t   done;
+        ull_t    tag;
+    };
+
+    std::vector<request> slots;
+    std::vector<int_t>   freeslots;
+    uint_t               inflight;
+
+    // io_uring state
+    int_t     ringfd;
+    VOID     *sqring;
+    VOID     *cqring;
+    VOID     *sqes;
+    size_t    sqringsz;
+    size_t    cqringsz;
+    size_t    sqessz;
+    uint_t    tosubmit;
+    uint_t   *sqhead;
+    uint_t   *sqtail;
+    uint_t   *sqmask;
+    uint_t   *sqarray;
+    uint_t   *cqhead;
+    uint_t   *cqtail;
+    uint_t   *cqmask;
+    VOID     *cqes;
+
+    // thread pool state
+    std::vector<std::thread>                 pool;
+    std::deque<int_t>                        todo;
+    std::deque<std::pair<int_t, ssize_t>>    completed;
+    std::mutex                               poollock;
+    std::condition_variable                  todocv;
+    std::condition_variable                  donecv;
+    bool_t                                   exitSignal;
+
+    bool_t setupring(uint_t depth);
+    VOID   closering();
+    VOID   enqueue(int_t slot);
+    bool_t reap(int_t &slot, ssize_t &res);
+    VOID   worker();
+
+public:
+
+    asyncreader(uint_t depth);
+    ~asyncreader();
+
+    asyncreader(const asyncreader &) = delete;
+    asyncreader &operator=(const asyncreader &) = delete;
+
+    // queue a read of len bytes at off into buf. Returns
+    // false if depth reads are already in flight
+    bool_t submit(int_t fd, VOID *buf, size_t len, ull_t off, ull_t tag);
+
+    // wait for the next completed read. res is the number of bytes
+    // read (len) or -errno. Returns false if no read is in flight
+    // or (while reads are in flight) if the io_uring failed
+    bool_t wait(ull_t &tag, ssize_t &res);
+
+    uint_t pending() const { return inflight; }
+    uint_t capacity() const { return slots.size(); }
+    bool_t uring() const { return ringfd >= 0; }
+};
+
+} // namespace io
+} // namespace hcp
@@ -34,6 +34,9 @@
 
 #define NIBUFFS                            20
 
+/* Timeout (ms) of the search's wait for a loaded batch */
+#define IO_WAITMS                          10
+
 /* FUNCTION: DSLIM_Construct
  *
  * DESCRIPTION: Construct DSLIM chunks
@@ -51,6 +54,22 @@ status_t DSLIM_Construct(Index *index);
 int_t DSLIM_GenerateIndex(Index *index, uint_t key);
 
 status_t DSLIM_InitializeScorecard(Index *index, uint_t idxs);
+
+/*
+ * FUNCTION: DSLIM_ConstructMassDir
+ *
+ * DESCRIPTION: Construct the precursor mass directory: a
+ *              contiguous array of the peptide masses and the
+ *              first peptide at each integer Dalton
+ *
+ * INPUT:
+ * @index: The SLM Index (pepEntries sorted by mass)
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_ConstructMassDir(Index *index);
+
 /*
  * FUNCTION: DSLIM_AllocateMemory
  *
@@ -68,6 +87,8 @@ status_t DSLIM_AllocateMemory(Index *index);
 /*
  * FUNCTION: DSLIM_ConstructChunk
  *
+ * DESCRIPTION: Count ions per bin and construct DSLIM.bA
+ *
  * INPUT:
  * @threads:      Number of parallel threads
  * @chunk_number: Chunk Index
@@ -91,21 +112,6 @@ status_t DSLIM_ConstructChunk(uint_t threads, Index *index, uint_t chunk_number)
  */
 status_t DSLIM_SLMTransform(uint_t threads, Index *index, uint_t chunk_number);
 
-/*
- * FUNCTION: DSLIM_Optimize
- *
- * DESCRIPTION: Constructs SLIM Transform
- *
- * INPUT:
- * @threads     : Number of parallel threads
- * @index       : The SLM Index
- * @chunk_number: Chunk Index
- *
- * OUTPUT:
- * @status: Status of execution
- */
-status_t DSLIM_Optimize(Index *index, uint_t chunk_number);
-
 /*
  * FUNCTION: DSLIM_InitializeSC
  *
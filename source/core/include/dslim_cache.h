@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include "slm_dsts.h"
+#include "slmerr.h"
+
+/* Index cache file identification */
+#define IDXCACHE_MAGIC                     "HCPSIDX"
+#define IDXCACHE_VERSION                   2
+#define IDXCACHE_ALIGN                     64
+
+/*
+ * Header of the on-disk index file. All sections
+ * following the header are IDXCACHE_ALIGN aligned
+ * in the order: seqs, pepEntries, {bA, iA} x nChunks
+ */
+struct IndexHeader
+{
+    char_t  magic[8];
+    uint_t  version;
+    uint_t  hdrsize;
+
+    /* settings key */
+    ull_t   key;
+
+    /* database file identity */
+    ull_t   dbsize;
+    ull_t   dbmtime;
+
+    /* settings that the index depends on */
+    uint_t  peplen;
+    uint_t  maxz;
+    uint_t  scale;
+    uint_t  min_mass;
+    uint_t  max_mass;
+    uint_t  nodes;
+    uint_t  myid;
+    uint_t  policy;
+    uint_t  iseries;
+    uint_t  maxions;
+    uint_t  ionenc;
+
+    /* index sizes */
+    uint_t  pepCount;
+    uint_t  modCount;
+    uint_t  totalCount;
+    uint_t  lclpepCnt;
+    uint_t  lclmodCnt;
+    uint_t  lcltotCnt;
+    uint_t  nChunks;
+    uint_t  chunksize;
+    uint_t  lastchunksize;
+    uint_t  AAs;
+
+    /* total file size in bytes */
+    ull_t   filesize;
+};
+
+/*
+ * FUNCTION: DSLIM_LoadIndex
+ *
+ * DESCRIPTION: Memory map (read-only) a previously stored
+ *              index for the database file if its key and
+ *              the file identity match the current settings
+ *
+ * INPUT:
+ * @dbfile: Path to the database (.peps) file
+ * @index : Index to populate (pepIndex.peplen must be set)
+ *
+ * OUTPUT:
+ * @status: SLM_SUCCESS if loaded, error otherwise
+ */
+status_t DSLIM_LoadIndex(string_t &dbfile, Index *index);
+
+/*
+ * FUNCTION: DSLIM_StoreIndex
+ *
+ * DESCRIPTION: Write the constructed index to the index
+ *              cache directory for later runs to map
+ *
+ * INPUT:
+ * @dbfile: Path to the database (.peps) file
+ * @index : Constructed index
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_StoreIndex(string_t &dbfile, Index *index);
+
+/*
+ * FUNCTION: DSLIM_UnmapIndex
+ *
+ * DESCRIPTION: Unmap a memory mapped index
+ *
+ * INPUT:
+ * @index: Memory mapped index
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t DSLIM_UnmapIndex(Index *index);
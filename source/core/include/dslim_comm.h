@@ -20,9 +20,28 @@
 #pragma once
 
 #include "common.hpp"
+#include <atomic>
+#include <thread>
 #include "slm_dsts.h"
 #include "expeRT.h"
 #include "dslim.h"
+#include "lfqueue.h"
+
+/* MPI tag of the partial results */
+#define PARTIALS_TAG                       0x2
+
+/* Backoff (us) between probes for partial results */
+#define PARTIALS_WAITUS                    1000
+
+/* Header of a partial result message (and spilled file) */
+typedef struct _partHeader
+{
+    int_t batchNum;
+    int_t bsize;
+    int_t codec;
+    int_t nbytes;
+
+} partHeader;
 
 #ifdef USE_MPI
 
@@ -36,6 +55,26 @@ private:
 
     int_t myRXsize;
 
+    /* Batches that I combine */
+    int_t maxBatches;
+
+    /* Partial results of my batches by [batch / nodes][rank].
+     * NULL if not received (yet) or spilled to the workspace */
+    ebuffer **partials;
+
+    /* Memory held by the partials (bytes) */
+    std::atomic<ull_t> pmemory;
+
+    /* Partials landed per batch, and the batches
+     * whose partials from all nodes have landed */
+    std::atomic<int_t> *arrivals;
+    mpmcqueue<int_t>   *readyQ;
+
+    std::thread rx_thd;
+
+    status_t StorePartials(ebuffer *, int_t, int_t);
+    VOID     RXPartials();
+
 public:
 
     friend status_t DSLIM_CarryForward(Index *index, DSLIM_Comm *CommHandle, expeRT *ePtr, hCell *CandidatePSMS, int_t cpsmSize);
@@ -43,6 +82,12 @@ public:
     DSLIM_Comm(int_t);
     virtual ~DSLIM_Comm();
     status_t AddBatch(int_t, int_t, int_t);
+    status_t AddPartials(ebuffer *);
+    int_t    Wait4Batch();
+    status_t Wait4Partials();
 };
 
+/* Path of a spilled partial result */
+string_t DSLIM_PartialsFile(int_t batchNum, int_t rank);
+
 #endif /* USE_MPI */
\ No newline at end of file
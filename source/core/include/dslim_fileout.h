@@ -24,9 +24,19 @@
 #include "slm_dsts.h"
 #include "slmerr.h"
 
+/* Size of a PSM output buffer */
+#define FOUT_BUFSIZE                    MBYTES(1)
+
+/* Output buffers in flight per thread before it waits for the writer */
+#define FOUT_NBUFFS                     4
+
+/* Longest output line (excluding the file name and peptide) */
+#define FOUT_MAXLINE                    KBYTES(1)
+
 /* Function Definitions */
 status_t    DFile_PrintPartials(uint_t specid, Results *resPtr);
 status_t    DFile_PrintScore(Index *index, uint_t specid, 
-                             float_t pmass, hCell *psm, double_t e_x, uint_t npsms);
+                             float_t pmass, hCell *psm, double_t e_x, uint_t npsms,
+                             uint_t rank = 1);
 status_t    DFile_InitFiles();
 status_t    DFile_DeinitFiles();
\ No newline at end of file
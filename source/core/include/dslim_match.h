@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include "common.hpp"
+#include "slm_dsts.h"
+#include "ionenc.h"
+
+//
+// The fragment-ion matching kernel of the CPU search. Kept in a
+// header so that the matchbench tool times the same code
+//
+
+extern gParams params;
+
+/*
+ * FUNCTION: DSLIM_MatchIons
+ *
+ * DESCRIPTION: Match the query peaks to the fragment-ions of
+ *              the candidate peptides in an index chunk and
+ *              update the scorecard. The bins of a fragment
+ *              tolerance window are contiguous in iA and are
+ *              searched as one range unless the range is large
+ *              and the candidates are only a part of the chunk
+ *
+ * INPUT:
+ * @enc     : Ion ID encoding of the chunk
+ * @chunk   : The index chunk
+ * @npeps   : Number of peptides in the chunk
+ * @QAPtr   : Query spectrum peaks (m/z)
+ * @iPtr    : Query spectrum peak intensities
+ * @qspeclen: Number of query peaks
+ * @minlimit: First candidate peptide
+ * @maxlimit: Last candidate peptide
+ * @pchg    : Precursor charge
+ * @scPtr   : The scorecard
+ * @ntouched: Number of touched scorecard entries (sparse mode)
+ *
+ * OUTPUT: none
+ */
+template <class ionenc_t, bool_t sparse>
+static inline VOID DSLIM_MatchIons(const ionenc_t &enc, spmat_t *chunk, uint_t npeps, spectype_t *QAPtr, spectype_t *iPtr,
+                                   uint_t qspeclen, int_t minlimit, int_t maxlimit, int_t pchg, BYICount *scPtr,
+                                   uint_t &ntouched)
+{
+    const uint_t dF = params.dF;
+    const double_t maxmass = params.max_mass;
+    const uint_t scale = params.scale;
+    const bool_t fmerge = params.fmerge;
+
+    // tolerance ranges up to this many ions are filtered linearly
+    constexpr uint_t linspan = 64;
+
+    uint_t *bAPtr = chunk->bA;
+    uint_t *iAPtr = chunk->iA;
+
+    ushort_t *bc = scPtr->bc;
+    ushort_t *yc = scPtr->yc;
+    uint_t *ibc = scPtr->ibc;
+    uint_t *iyc = scPtr->iyc;
+    uint_t *touched = scPtr->touched;
+
+    /* First and last ion IDs of the candidates */
+    const uint_t minion = enc.first(minlimit);
+    const uint_t maxion = enc.last(maxlimit);
+
+    /* All ions in the chunk are candidates */
+    const bool_t allcands = (minlimit <= 0 && maxion >= enc.last(npeps - 1));
+
+#if !defined (MATCH_CHARGE)
+    UNUSED_PARAM(pchg);
+#endif // MATCH_CHARGE
+
+    /* Update the scorecard for a matched ion */
+    auto match = [&](uint_t raw, uint_t intn)
+    {
+        /* Calculate parent peptide ID */
+        int_t ppid = enc.pepid(raw);
+
+        /* Either 0 or 1 */
+        int_t isY = enc.isY(raw);
+        int_t isB = 1 - isY;
+
+#ifdef MATCH_CHARGE
+
+        // FIXME: Is this ichg computation and usage correct?
+        int_t ichg = enc.charge(raw);
+
+        // Check if the matched ion's charge is less than or equal to the precursor charge
+        isY *= (ichg <= pchg);
+        isB *= (ichg <= pchg);
+
+#endif // MATCH_CHARGE
+
+        /* Record the first touch of the entry */
+        if (sparse && !(bc[ppid] | yc[ppid]) && (isB | isY))
+            touched[ntouched++] = ppid;
+
+        /* Update */
+        bc[ppid] += isB;
+        ibc[ppid] += intn * isB;
+
+        yc[ppid] += isY;
+        iyc[ppid] += intn * isY;
+    };
+
+    /* Query all fragments in each spectrum */
+    for (uint_t k = 0; k < qspeclen; k++)
+    {
+        /* Do this to save mem boundedness */
+        auto qion = QAPtr[k];
+        uint_t intn = iPtr[k];
+
+        /* Check for any zeros
+         * Zero = Trivial query */
+        if (qion > dF && qion < ((maxmass * scale) - 1 - dF))
+        {
+            /* The ions of all bins in the tolerance window */
+            uint_t start = bAPtr[qion - dF];
+            uint_t end = bAPtr[qion + 1 + dF];
+
+            if (fmerge && allcands)
+            {
+                /* No clipping required */
+                for (auto ion = start; ion < end; ion++)
+                    match(iAPtr[ion], intn);
+            }
+            else if (fmerge && end - start <= linspan)
+            {
+                /* Clip each ion to the candidates */
+                for (auto ion = start; ion < end; ion++)
+                {
+                    uint_t raw = iAPtr[ion];
+
+                    if (raw - minion <= maxion - minion)
+                        match(raw, intn);
+                }
+            }
+            else
+            {
+                for (auto bin = qion - dF; bin < qion + 1 + dF; bin++)
+                {
+                    /* Locate iAPtr start and end */
+                    uint_t bstart = bAPtr[bin];
+                    uint_t bend = bAPtr[bin + 1];
+
+                    /* If no ions in the bin */
+                    if (bend - bstart < 1)
+                        continue;
+
+                    auto ptr = std::lower_bound(iAPtr + bstart, iAPtr + bend, minion);
+                    int_t stt = bstart + std::distance(iAPtr + bstart, ptr);
+
+                    ptr = std::upper_bound(iAPtr + stt, iAPtr + bend, maxion);
+                    int_t ends = stt + std::distance(iAPtr + stt, ptr) - 1;
+
+                    /* Loop through located iAions */
+                    for (auto ion = stt; ion <= ends; ion++)
+                        match(iAPtr[ion], intn);
+                }
+            }
+        }
+    }
+}
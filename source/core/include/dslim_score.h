@@ -29,6 +29,11 @@
 #include "utils.h"
 #include "expeRT.h"
 
+/* Backoff (us) between tests of the score receives */
+#define RX_WAITUS                          1000
+
+class DSLIM_Comm;
+
 typedef struct _BorrowedData
 {
     /* These pointers will be borrowed */
@@ -37,6 +42,8 @@ typedef struct _BorrowedData
     Index *index;
     int_t *sizeArray;
     int_t *fileArray;
+    ebuffer **partials;
+    DSLIM_Comm *comm;
 
     /* Dataset size */
     int_t cPSMsize;
@@ -49,6 +56,8 @@ typedef struct _BorrowedData
         index = NULL;
         sizeArray = NULL;
         fileArray = NULL;
+        partials = NULL;
+        comm = NULL;
         cPSMsize = 0;
         nBatches = 0;
     }
@@ -77,6 +86,16 @@ private:
     Index    *index;
     std::thread comm_thd;
 
+    /* Partial results of my batches by [batch][rank]
+     * (NULL: in the workspace files) */
+    ebuffer  **partials;
+
+    /* Receives the partials (owned) */
+    DSLIM_Comm *comm;
+
+    /* Next free entry in RxValues */
+    int_t       rxOffset;
+
     /* Data size that I expect to
      * receive from other processes */
     int_t      *rxSizes;
@@ -106,10 +125,14 @@ public:
     status_t   RXSizes(MPI_Request *, int_t *);
 
     status_t   TXResults(MPI_Request *, int_t*);
-    status_t   RXResults(MPI_Request *, int_t*);
+    status_t   RXResults(MPI_Request *, int_t);
 
     status_t   DisplayResults();
 
+    int_t      NextBatch(int_t);
+    ebuffer   *ReadPartials(int_t, int_t, ebuffer *, std::ifstream &);
+    VOID       ReleasePartials(int_t, int_t, std::ifstream &);
+
     status_t   Wait4RX();
 
     status_t   InitDataTypes();
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <array>
 #include <vector>
 #include <valarray>
 #include <algorithm>
@@ -106,6 +107,9 @@ private:
     template <class T>
     static inline int_t largmax(T &data, int_t i1, int_t i2, double_t value);
 
+    template <class T>
+    status_t Decode(ebuffer *, int_t, partRes *, T &);
+
     dvector vrange(int_t, int_t);
     darray  arange(int_t, int_t);
 
@@ -125,6 +129,9 @@ public:
 
     status_t Reconstruct(ebuffer *ebs, int_t specno, partRes *fR);
 
+    /* Encode the partial histograms of a batch (see PartCodec_t) */
+    static status_t Encode(ebuffer *ebs, int_t bsize, PartCodec_t codec);
+
     /* Add distibution data */
     status_t AddlogWeibull(int_t, double_t, double_t, int_t, int_t);
 
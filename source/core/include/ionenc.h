@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include "slm_dsts.h"
+
+namespace hcp
+{
+namespace dslim
+{
+
+//
+// Encodings of a (peptide, ion slot) pair in DSLIM.iA. The ion slots
+// of a peptide are laid out as generated by UTILS_GenerateSpectrum:
+// [b ions: maxz x (peplen-1)][y ions: maxz x (peplen-1)]
+//
+
+//
+// raw = pepid * speclen + slot
+// (used by the GPU kernels)
+//
+struct divenc
+{
+    uint_t speclen;
+    uint_t halfspeclen;
+    uint_t peplen_1;
+    uint_t maxz;
+
+    divenc(uint_t peplen, uint_t _maxz)
+    {
+        peplen_1 = peplen - 1;
+        maxz = _maxz;
+        halfspeclen = peplen_1 * maxz;
+        speclen = halfspeclen * iSERIES;
+    }
+
+    // encode an ion slot of a peptide
+    inline uint_t encode(uint_t pepid, uint_t slot) const { return pepid * speclen + slot; }
+
+    // first and last encoded values of a peptide
+    inline uint_t first(uint_t pepid) const { return pepid * speclen; }
+    inline uint_t last(uint_t pepid) const { return ((pepid + 1) * speclen) - 1; }
+
+    // decode the peptide, the y-ion flag and the ion charge
+    inline uint_t pepid(uint_t raw) const { return raw / speclen; }
+    inline uint_t isY(uint_t raw) const { return (raw % speclen) / halfspeclen; }
+    inline uint_t charge(uint_t raw) const { return (((raw % speclen) / peplen_1) % maxz) + 1; }
+};
+
+//
+// raw = pepid << shift | isY << halfshift | (slot % halfspeclen)
+// i.e. each ion series is padded to a power of two so that
+// decoding needs no integer division on the search path
+//
+struct shiftenc
+{
+    uint_t halfspeclen;
+    uint_t peplen_1;
+    uint_t halfshift;
+    uint_t shift;
+
+    shiftenc(uint_t peplen, uint_t maxz)
+    {
+        peplen_1 = peplen - 1;
+        halfspeclen = peplen_1 * maxz;
+
+        // smallest power of two >= halfspeclen
+        halfshift = 0;
+        while ((1u << halfshift) < halfspeclen)
+            halfshift++;
+
+        shift = halfshift + 1;
+    }
+
+    // encode an ion slot of a peptide
+    inline uint_t encode(uint_t pepid, uint_t slot) const
+    {
+        uint_t isy = (slot >= halfspeclen);
+        return (pepid << shift) | (isy << halfshift) | (slot - isy * halfspeclen);
+    }
+
+    // first and last encoded values of a peptide
+    inline uint_t first(uint_t pepid) const { return pepid << shift; }
+    inline uint_t last(uint_t pepid) const { return ((pepid + 1) << shift) - 1; }
+
+    // decode the peptide, the y-ion flag and the ion charge
+    inline uint_t pepid(uint_t raw) const { return raw >> shift; }
+    inline uint_t isY(uint_t raw) const { return (raw >> halfshift) & 0x1; }
+    inline uint_t charge(uint_t raw) const { return ((raw & ((1u << halfshift) - 1)) / peplen_1) + 1; }
+};
+
+} // namespace dslim
+} // namespace hcp
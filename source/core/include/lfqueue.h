@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include "common.hpp"
+#include "lwqueue.h"
+
+using namespace std;
+
+/* Cache line size (avoid false sharing of the ring indices) */
+#define LFQ_CACHELINE                     64
+
+//
+// Lock-free bounded MPMC queue (Dmitry Vyukov's ring buffer). Each
+// cell carries a sequence number that tells producers and consumers
+// whether the cell is free or filled for their position, so push
+// and pop are a single CAS on the tail or head index. Has the same
+// interface as lwqueue (the semaphore based queue) so either can be
+// used as the backend of lwbuff (see mpmcqueue below).
+//
+template <class T>
+class lfqueue
+{
+private:
+
+    struct cell
+    {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    cell  *arr;
+    size_t mask;
+    int_t  cap;
+
+    alignas(LFQ_CACHELINE) std::atomic<size_t> tail;
+    alignas(LFQ_CACHELINE) std::atomic<size_t> head;
+
+    /* Events for the blocking push/pop (see lwqueue) */
+    alignas(LFQ_CACHELINE) sem_t pushed;
+    sem_t popped;
+    std::atomic<BOOL> closed;
+
+    VOID init(int_t dcap)
+    {
+        /* Power of two (at least 2) ring. The capacity is rounded
+         * up to it: the cell sequence numbers enforce the ring size
+         * only, and a separate check against head would need it to
+         * be current and could fail a push into a free cell */
+        size_t sz = 2;
+
+        while (sz < (size_t) dcap)
+            sz <<= 1;
+
+        cap = (int_t) sz;
+        mask = sz - 1;
+        arr = new cell[sz];
+
+        for (size_t i = 0; i < sz; i++)
+            arr[i].seq.store(i, std::memory_order_relaxed);
+
+        tail.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+
+        sem_init(&pushed, 0, 0);
+        sem_init(&popped, 0, 0);
+        closed = false;
+    }
+
+public:
+
+    lfqueue()
+    {
+        init(DEF_CAPACITY);
+    }
+
+    lfqueue(int_t dcap)
+    {
+        init(dcap);
+    }
+
+    /* The lock flag is accepted for compatibility with lwqueue */
+    lfqueue(int_t dcap, BOOL sem)
+    {
+        UNUSED_PARAM(sem);
+        init(dcap);
+    }
+
+    lfqueue(const lfqueue &) = delete;
+    lfqueue &operator=(const lfqueue &) = delete;
+
+    virtual ~lfqueue()
+    {
+        delete[] arr;
+        arr = NULL;
+        cap = 0;
+
+        sem_destroy(&pushed);
+        sem_destroy(&popped);
+    }
+
+    status_t push(T elmnt)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        cell *c;
+
+        for (;;)
+        {
+            c = &arr[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+
+            /* Free cell for this position: claim it */
+            if (dif == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            /* Cell of the previous lap not yet consumed */
+            else if (dif < 0)
+                return ISFULL;
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+
+        c->data = elmnt;
+        c->seq.store(pos + 1, std::memory_order_release);
+
+        sem_post(&pushed);
+
+        return SLM_SUCCESS;
+    }
+
+    /* Get and remove the front element in one step */
+    status_t pop(T &elmnt)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        cell *c;
+
+        for (;;)
+        {
+            c = &arr[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+
+            /* Filled cell for this position: claim it */
+            if (dif == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            /* Not filled (yet) */
+            else if (dif < 0)
+                return ISEMPTY;
+            else
+                pos = head.load(std::memory_order_relaxed);
+        }
+
+        elmnt = c->data;
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+
+        sem_post(&popped);
+
+        return SLM_SUCCESS;
+    }
+
+    status_t pop()
+    {
+        T elmnt;
+
+        return pop(elmnt);
+    }
+
+    /* Front element. Only meaningful if the
+     * consumers are serialized by the caller */
+    T front()
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        cell *c = &arr[pos & mask];
+
+        if (c->seq.load(std::memory_order_acquire) == pos + 1)
+            return c->data;
+
+        return 0;
+    }
+
+    /* Number of elements (a snapshot under concurrency) */
+    int_t size()
+    {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+
+        return (t > h) ? (int_t) (t - h) : 0;
+    }
+
+    BOOL isEmpty()
+    {
+        return size() == 0;
+    }
+
+    BOOL isFull()
+    {
+        return size() >= cap;
+    }
+
+    /* Blocking push: waits while the queue is full */
+    status_t pushWait(T elmnt)
+    {
+        status_t status;
+
+        while ((status = push(elmnt)) == ISFULL)
+            lwqueue_waitevent(&popped, -1);
+
+        return status;
+    }
+
+    /* Blocking pop: waits while the queue is empty.
+     * Returns false once the queue is closed and drained */
+    BOOL popWait(T &elmnt)
+    {
+        for (;;)
+        {
+            if (pop(elmnt) == SLM_SUCCESS)
+                return true;
+
+            if (closed)
+            {
+                /* Drain pushes that raced with close */
+                if (pop(elmnt) == SLM_SUCCESS)
+                    return true;
+
+                /* Wake up the next waiter */
+                sem_post(&pushed);
+                return false;
+            }
+
+            lwqueue_waitevent(&pushed, -1);
+        }
+    }
+
+    /* Wake up the popWait callers once the queue drains */
+    VOID close()
+    {
+        closed = true;
+        sem_post(&pushed);
+    }
+
+    BOOL waitPush(int_t timeout_ms = -1)
+    {
+        return lwqueue_waitevent(&pushed, timeout_ms);
+    }
+
+    BOOL waitPop(int_t timeout_ms = -1)
+    {
+        return lwqueue_waitevent(&popped, timeout_ms);
+    }
+};
+
+//
+// Queue backend of lwbuff and the other contended queues: the
+// lock-free ring with -DUSE_LFQUEUE, else the semaphore queue
+//
+#if defined (USE_LFQUEUE)
+template <class T> using mpmcqueue = lfqueue<T>;
+#else
+template <class T> using mpmcqueue = lwqueue<T>;
+#endif // USE_LFQUEUE
@@ -21,6 +21,7 @@
 
 #include "common.hpp"
 #include "lwqueue.h"
+#include "lfqueue.h"
 #include <semaphore.h>
 
 using namespace std;
@@ -35,14 +36,17 @@ private:
     int_t cap;
     int_t thr_low;
     int_t thr_high;
+
+    /* The queue operations are thread safe. These
+     * only serialize the callers' compound updates */
     sem_t lockr;
     sem_t lockw;
 
     /* NOTE: The sizeof(readyQ) must be at least
      *       sizeof(workQ) + 1
      */
-    lwqueue<T*> *readyQ;
-    lwqueue<T*> *waitQ;
+    mpmcqueue<T*> *readyQ;
+    mpmcqueue<T*> *waitQ;
 
 public:
     lwbuff()
@@ -52,8 +56,8 @@ public:
         thr_low = cap/4;
         thr_high = cap - thr_low;
 
-        readyQ = new lwqueue<T *>(DEF_SIZE, false);
-        waitQ = new lwqueue<T *>(DEF_SIZE, false);
+        readyQ = new mpmcqueue<T *>(DEF_SIZE, true);
+        waitQ = new mpmcqueue<T *>(DEF_SIZE, true);
 
         sem_init(&lockr, 0, 1);
         sem_init(&lockw, 0, 1);
@@ -65,8 +69,8 @@ public:
         thr_low = lo;
         thr_high = hi;
 
-        readyQ = new lwqueue<T*>(dcap, false);
-        waitQ = new lwqueue<T*>(dcap, false);
+        readyQ = new mpmcqueue<T*>(dcap, true);
+        waitQ = new mpmcqueue<T*>(dcap, true);
 
         sem_init(&lockr, 0, 1);
         sem_init(&lockw, 0, 1);
@@ -113,28 +117,24 @@ public:
         waitQ->push(ptr);
     }
 
+    /* NULL if the wait queue is empty */
     T *getIOPtr()
     {
         T *rtn = NULL;
 
-        if (waitQ->size() > 0)
-        {
-            rtn = waitQ->front();
-            waitQ->pop();
-        }
+        if (waitQ->pop(rtn) != SLM_SUCCESS)
+            rtn = NULL;
 
         return rtn;
     }
 
+    /* NULL if the ready queue is empty */
     T *getWorkPtr()
     {
         T *rtn = NULL;
 
-        if (readyQ->size() > 0)
-        {
-            rtn = readyQ->front();
-            readyQ->pop();
-        }
+        if (readyQ->pop(rtn) != SLM_SUCCESS)
+            rtn = NULL;
 
         return rtn;
     }
@@ -151,6 +151,20 @@ public:
         return rtn;
     }
 
+    /* Wait (up to timeout_ms) for a buffer to be added
+     * to the ready queue. Call without holding lockr */
+    BOOL waitWork(int_t timeout_ms = -1)
+    {
+        return readyQ->waitPush(timeout_ms);
+    }
+
+    /* Wait (up to timeout_ms) for a buffer to be returned
+     * to the wait queue. Call without holding lockw */
+    BOOL waitIO(int_t timeout_ms = -1)
+    {
+        return waitQ->waitPush(timeout_ms);
+    }
+
     int_t len()
     {
         return cap;
@@ -21,6 +21,8 @@
 
 #include "common.hpp"
 #include <semaphore.h>
+#include <cerrno>
+#include <ctime>
 
 using namespace std;
 
@@ -28,6 +30,36 @@ using namespace std;
 #define ISFULL                           -1
 #define ISEMPTY                          -2
 
+/* Wait for a (semaphore) event. A negative timeout
+ * waits forever. Returns false on timeout */
+static inline BOOL lwqueue_waitevent(sem_t *ev, int_t timeout_ms)
+{
+    int_t ret;
+
+    if (timeout_ms < 0)
+    {
+        while ((ret = sem_wait(ev)) != 0 && errno == EINTR);
+
+        return ret == 0;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    while ((ret = sem_timedwait(ev, &ts)) != 0 && errno == EINTR);
+
+    return ret == 0;
+}
+
 template <class T>
 class lwqueue
 {
@@ -40,6 +72,21 @@ private:
     sem_t lock;
     BOOL isSem;
 
+    /* Events for the blocking push/pop: posted on every
+     * push (pushed) and pop (popped). A waiter re-checks
+     * the queue after each event so stale events (e.g.
+     * from the non-blocking calls) only cost a recheck */
+    sem_t pushed;
+    sem_t popped;
+    BOOL  closed;
+
+    VOID initEvents()
+    {
+        sem_init(&pushed, 0, 0);
+        sem_init(&popped, 0, 0);
+        closed = false;
+    }
+
 public:
 
     lwqueue()
@@ -49,6 +96,7 @@ public:
         filled = 0;
         head = 0;
         tail = -1;
+        initEvents();
         sem_init(&lock, 0, 1);
         isSem = true;
     }
@@ -60,6 +108,7 @@ public:
         filled = 0;
         head = 0;
         tail = -1;
+        initEvents();
         sem_init(&lock, 0, 1);
         isSem = true;
     }
@@ -71,6 +120,7 @@ public:
         filled = 0;
         head = 0;
         tail = -1;
+        initEvents();
 
         if (sem == true)
         {
@@ -90,6 +140,7 @@ public:
         filled = 0;
         head = 0;
         tail = -1;
+        initEvents();
         if (sem)
         {
             sem_init(&lock, 0, 1);
@@ -108,6 +159,7 @@ public:
         filled = sz;
         head = 0;
         tail = sz - 1;
+        initEvents();
 
         if (sem)
         {
@@ -134,6 +186,9 @@ public:
             sem_destroy(&lock);
             isSem = false;
         }
+
+        sem_destroy(&pushed);
+        sem_destroy(&popped);
     }
 
     inline int_t plusOne(int_t idx)
@@ -168,6 +223,9 @@ public:
         if (isSem)
             sem_post (&lock);
 
+        if (status == SLM_SUCCESS)
+            sem_post(&pushed);
+
         return status;
     }
 
@@ -192,9 +250,117 @@ public:
         if (isSem)
             sem_post (&lock);
 
+        if (status == SLM_SUCCESS)
+            sem_post(&popped);
+
         return status;
     }
 
+    /* Get and remove the front element in one step */
+    status_t pop(T &elmnt)
+    {
+        status_t status;
+
+        if (isSem)
+            sem_wait (&lock);
+
+        if (filled > 0)
+        {
+            elmnt = arr[head];
+            head = plusOne(head);
+            filled--;
+            status = SLM_SUCCESS;
+        }
+        else
+        {
+            status = ISEMPTY;
+        }
+
+        if (isSem)
+            sem_post (&lock);
+
+        if (status == SLM_SUCCESS)
+            sem_post(&popped);
+
+        return status;
+    }
+
+    /* Blocking push: waits while the queue is full.
+     * Only for the queues with the internal lock */
+    status_t pushWait(T elmnt)
+    {
+        status_t status;
+
+        while ((status = push(elmnt)) == ISFULL)
+            lwqueue_waitevent(&popped, -1);
+
+        return status;
+    }
+
+    /* Blocking pop: waits while the queue is empty. Returns
+     * false once the queue is closed and drained. Only for
+     * the queues with the internal lock */
+    BOOL popWait(T &elmnt)
+    {
+        for (;;)
+        {
+            sem_wait(&lock);
+
+            if (filled > 0)
+            {
+                elmnt = arr[head];
+                head = plusOne(head);
+                filled--;
+
+                sem_post(&lock);
+                sem_post(&popped);
+
+                return true;
+            }
+
+            BOOL done = closed;
+
+            sem_post(&lock);
+
+            if (done)
+            {
+                /* Wake up the next waiter */
+                sem_post(&pushed);
+                return false;
+            }
+
+            lwqueue_waitevent(&pushed, -1);
+        }
+    }
+
+    /* Wake up the popWait callers once the queue drains */
+    VOID close()
+    {
+        if (isSem)
+            sem_wait (&lock);
+
+        closed = true;
+
+        if (isSem)
+            sem_post (&lock);
+
+        sem_post(&pushed);
+    }
+
+    /* Wait (up to timeout_ms) for a push or a pop. For the
+     * queues guarded by an external lock: check the queue
+     * under the lock, release it, then wait. Returns false
+     * on timeout */
+    BOOL waitPush(int_t timeout_ms = -1)
+    {
+        return lwqueue_waitevent(&pushed, timeout_ms);
+    }
+
+    BOOL waitPop(int_t timeout_ms = -1)
+    {
+        return lwqueue_waitevent(&popped, timeout_ms);
+    }
+
     BOOL isEmpty()
     {
         BOOL res = false;
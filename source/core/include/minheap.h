@@ -113,13 +113,17 @@ int minHeap<T>::insert(T &element)
         return increase_key(0, element);
     }
 
-    array[size++] = element;
+    int pos = size++;
 
-    for (int i = (size - 1) / 2; i >= 0; i--)
+    /* Sift the new element up */
+    while (pos > 0 && element < array[(pos - 1) / 2])
     {
-        heapify(i);
+        array[pos] = array[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
     }
 
+    array[pos] = element;
+
     return 0;
 }
 
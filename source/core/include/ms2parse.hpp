@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "common.hpp"
+
+#if __has_include(<charconv>)
+#include <charconv>
+#endif // __has_include(<charconv>)
+
+/* block size of the MS2 line reader */
+#define MS2_BLOCKSIZE                   MBYTES(4)
+
+namespace hcp
+{
+namespace ms2
+{
+
+//
+// supported query (MS/MS data) file formats
+//
+enum class format_t
+{
+    MS2,
+    MGF,
+    MZML,
+    UNKNOWN
+};
+
+//
+// format of a query file from its (case insensitive) extension
+//
+static inline format_t getformat(const string_t &fname)
+{
+    auto pos = fname.find_last_of('.');
+
+    if (pos == string_t::npos)
+        return format_t::UNKNOWN;
+
+    string_t ext = fname.substr(pos + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](uchar_t c) { return std::tolower(c); });
+
+    if (ext == "ms2")
+        return format_t::MS2;
+    else if (ext == "mgf")
+        return format_t::MGF;
+    else if (ext == "mzml")
+        return format_t::MZML;
+
+    return format_t::UNKNOWN;
+}
+
+//
+// line reader for (multi-GB) MS2 text files. The file is read
+// in large blocks and the lines are located with memchr. Lines
+// are returned as views into the block buffer (without the line
+// ending) and stay valid until the next call to getline.
+//
+class linereader
+{
+private:
+    int_t      fd;
+    char_t    *buf;
+    size_t     cap;
+    size_t     beg;
+    size_t     end;
+    bool_t     eof;
+
+    // move the unread tail to the front and read the next block
+    bool_t refill()
+    {
+        if (beg > 0)
+        {
+            std::memmove(buf, buf + beg, end - beg);
+            end -= beg;
+            beg = 0;
+        }
+
+        // a line longer than the buffer: grow it
+        if (end == cap)
+        {
+            char_t *nbuf = new char_t[2 * cap];
+            std::memcpy(nbuf, buf, end);
+            delete[] buf;
+            buf = nbuf;
+            cap *= 2;
+        }
+
+        ssize_t nread;
+
+        do
+        {
+            nread = ::read(fd, buf + end, cap - end);
+        } while (nread < 0 && errno == EINTR);
+
+        if (nread <= 0)
+        {
+            eof = true;
+            return false;
+        }
+
+        end += nread;
+
+        return true;
+    }
+
+public:
+
+    linereader() : fd(-1), buf(nullptr), cap(0), beg(0), end(0), eof(true) {}
+
+    linereader(const string_t &fname) : linereader() { open(fname); }
+
+    ~linereader() { close(); }
+
+    linereader(const linereader &) = delete;
+    linereader &operator=(const linereader &) = delete;
+
+    bool_t open(const string_t &fname)
+    {
+        close();
+
+        fd = ::open(fname.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            return false;
+
+#if defined (POSIX_FADV_SEQUENTIAL)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif // POSIX_FADV_SEQUENTIAL
+
+        cap = MS2_BLOCKSIZE;
+        buf = new char_t[cap];
+        beg = end = 0;
+        eof = false;
+
+        return true;
+    }
+
+    VOID close()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+
+        if (buf != nullptr)
+        {
+            delete[] buf;
+            buf = nullptr;
+        }
+
+        cap = beg = end = 0;
+        eof = true;
+    }
+
+    bool_t is_open() const { return fd >= 0; }
+
+    //
+    // get the next line. Returns false when
+    // there are no more lines in the file
+    //
+    bool_t getline(std::string_view &line)
+    {
+        if (buf == nullptr)
+            return false;
+
+        size_t scanned = beg;
+
+        while (true)
+        {
+            auto nl = (char_t *) std::memchr(buf + scanned, '\n', end - scanned);
+
+            if (nl != nullptr)
+            {
+                size_t len = nl - (buf + beg);
+
+                // strip the carriage return of CRLF files
+                if (len > 0 && buf[beg + len - 1] == '\r')
+                    len--;
+
+                line = std::string_view(buf + beg, len);
+                beg = (nl - buf) + 1;
+
+                return true;
+            }
+
+            // the unread tail has no line ending
+            size_t tail = end - beg;
+
+            // nothing left to read: return the last unterminated line
+            if (eof || !refill())
+            {
+                if (beg == end)
+                    return false;
+
+                size_t len = end - beg;
+
+                if (buf[beg + len - 1] == '\r')
+                    len--;
+
+                line = std::string_view(buf + beg, len);
+                beg = end;
+
+                return true;
+            }
+
+            // refill moved the unread tail to the front
+            scanned = tail;
+        }
+    }
+};
+
+//
+// get the next line of an in-memory block (without the line
+// ending) and advance the block past it. Returns false when
+// the block is exhausted
+//
+static inline bool_t nextline(std::string_view &block, std::string_view &line)
+{
+    if (block.empty())
+        return false;
+
+    auto nl = (const char_t *) std::memchr(block.data(), '\n', block.size());
+    size_t len = (nl != nullptr) ? nl - block.data() : block.size();
+
+    line = block.substr(0, len);
+    block.remove_prefix(std::min(len + 1, block.size()));
+
+    // strip the carriage return of CRLF files
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+
+    return true;
+}
+
+//
+// next token of line delimited by any of delims (strtok semantics:
+// leading delimiters are skipped). line is advanced past the token
+//
+static inline std::string_view token(std::string_view &line, const char_t *delims = " \t")
+{
+    size_t b = line.find_first_not_of(delims);
+
+    if (b == std::string_view::npos)
+    {
+        line = std::string_view();
+        return line;
+    }
+
+    size_t e = line.find_first_of(delims, b);
+
+    if (e == std::string_view::npos)
+        e = line.size();
+
+    auto tok = line.substr(b, e - b);
+    line.remove_prefix(e);
+
+    return tok;
+}
+
+//
+// convert a token to a number. Like atof/atoi, the longest valid
+// prefix is converted and an invalid token yields zero. An empty
+// (missing) token yields the default value
+//
+template <typename T>
+static inline T tonum(std::string_view tok, T def)
+{
+    if (tok.empty())
+        return def;
+
+    if (tok[0] == '+')
+        tok.remove_prefix(1);
+
+    T val = 0;
+
+#if defined (__cpp_lib_to_chars)
+    if (std::from_chars(tok.data(), tok.data() + tok.size(), val).ec != std::errc())
+        val = 0;
+#else
+    // floating-point from_chars needs GCC 11. Tokens are not
+    // NUL-terminated, so copy them before strtod/strtoll
+    char_t buf[64];
+    char_t *end = nullptr;
+    size_t len = std::min(tok.size(), sizeof(buf) - 1);
+
+    std::memcpy(buf, tok.data(), len);
+    buf[len] = '\0';
+
+    errno = 0;
+
+    if constexpr (std::is_floating_point<T>::value)
+        val = (T) std::strtod(buf, &end);
+    else if constexpr (std::is_unsigned<T>::value)
+    {
+        auto num = std::strtoull(buf, &end, 10);
+        val = (T) num;
+
+        if (buf[0] == '-' || (decltype(num)) val != num)
+            errno = ERANGE;
+    }
+    else
+    {
+        auto num = std::strtoll(buf, &end, 10);
+        val = (T) num;
+
+        if ((decltype(num)) val != num)
+            errno = ERANGE;
+    }
+
+    // same failures as from_chars: no digits, leading space, out of range
+    if (errno == ERANGE || end == buf || std::isspace((uchar_t) buf[0]))
+        val = 0;
+#endif // __cpp_lib_to_chars
+
+    return val;
+}
+
+//
+// value of the attribute name="value" in an XML start tag
+//
+static inline std::string_view attribute(std::string_view tag, std::string_view name)
+{
+    size_t pos = 0;
+
+    while ((pos = tag.find(name, pos)) != std::string_view::npos)
+    {
+        size_t vpos = pos + name.size();
+
+        // whole attribute names only
+        if (pos > 0 && std::isspace((uchar_t) tag[pos - 1]) && vpos + 1 < tag.size() &&
+            tag[vpos] == '=' && tag[vpos + 1] == '"')
+        {
+            vpos += 2;
+            size_t vend = tag.find('"', vpos);
+
+            if (vend == std::string_view::npos)
+                break;
+
+            return tag.substr(vpos, vend - vpos);
+        }
+
+        pos = vpos;
+    }
+
+    return std::string_view();
+}
+
+//
+// decode base64 text (whitespace is skipped). Returns
+// false if the text contains an invalid character
+//
+static inline bool_t b64decode(std::string_view text, std::vector<uchar_t> &out)
+{
+    static const auto lut = []()
+    {
+        std::array<int8_t, 256> tbl;
+        tbl.fill(-1);
+
+        const char_t *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        for (int_t i = 0; i < 64; i++)
+            tbl[(uchar_t) alphabet[i]] = i;
+
+        return tbl;
+    }();
+
+    out.clear();
+    out.reserve((text.size() / 4) * 3);
+
+    uint_t acc = 0;
+    int_t nbits = 0;
+
+    for (uchar_t c : text)
+    {
+        if (c == '=')
+            break;
+
+        if (std::isspace(c))
+            continue;
+
+        int_t v = lut[c];
+
+        if (v < 0)
+            return false;
+
+        acc = (acc << 6) | v;
+        nbits += 6;
+
+        if (nbits >= 8)
+        {
+            nbits -= 8;
+            out.push_back((acc >> nbits) & 0xFF);
+        }
+    }
+
+    return true;
+}
+
+} // namespace ms2
+} // namespace hcp
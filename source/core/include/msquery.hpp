@@ -23,6 +23,7 @@
 #include "common.hpp"
 #include "utils.h"
 #include "hicops_mpi.hpp"
+#include "ms2parse.hpp"
 
 /* Spectrum */
 template <typename T>
@@ -99,7 +100,44 @@ struct _info
 
 };
 
+/* Preprocessed spectra (.pbin) file identification */
+#define PBIN_MAGIC                     "HCPSPBN"
+#define PBIN_VERSION                   3
+#define PBIN_HASHSPAN                  MBYTES(1)
+
+/*
+ * Header of a .pbin file. The spectrum records follow the header
+ * and the (nspecs + 1) byte offsets of the records (the last one
+ * marks the end of the records) are stored at offtab
+ */
+struct PBINHeader
+{
+    char_t  magic[8];
+    uint_t  version;
+    uint_t  hdrsize;
+
+    /* source MS2 file identity */
+    ull_t   srcsize;
+    ull_t   srcmtime;
+    ull_t   srchash;
+
+    /* settings that the spectra depend on */
+    uint_t  scale;
+    int_t   base_int;
+    int_t   min_int;
+    uint_t  qalen;
+    uint_t  spectype;
+
+    /* spectrum records */
+    uint_t  nspecs;
+    uint_t  maxslen;
+    ull_t   offtab;
+};
+
 using info_t = _info;
+
+/* preprocessed spectra of a range of an MS2 file */
+struct PBINBatch;
 using spectrum_t = _Spectrum<spectype_t>;
 
 class MSQuery
@@ -110,46 +148,69 @@ protected:
     uint_t running_count;
     uint_t curr_chunk;
     info_t info;
-    std::ifstream *qfile;
+    hcp::ms2::linereader *qfile;
     uint_t qfileIndex;
+    char_t *qmap;                  // read-only mapping of the .pbin file
+    ull_t qmapsize;
+    const ull_t *qoffs;            // byte offset of each spectrum in qmap
     string_t MS2file;
     spectrum_t spectrum;
     bool_t m_isinit;
 
-    static std::array<int, 2> convertAndprepMS2bin(string_t *filename);
+    static std::array<int, 2> convertAndprepMS2bin(string_t *filename, int_t nthreads = 1);
+    static VOID prepMS2range(std::string_view block, PBINBatch &batch);
+    static VOID prepMGFrange(std::string_view block, PBINBatch &batch);
+    static VOID prepMZMLrange(std::string_view block, PBINBatch &batch);
+    static VOID addspectrum(PBINBatch &batch, std::vector<spectype_t> &mzs, std::vector<spectype_t> &intns);
     static std::array<int, 2> readMS2file(string_t *filename);
 
     void readMS2spectrum();
+
+    status_t mapBINfile();
+    void unmapBINfile();
     
     template <typename T>
-    void readBINbatch(int, int, Queries<T> *);
+    status_t readBINbatch(int, int, Queries<T> *, const char_t *data = nullptr);
 
     template <typename T>
     status_t pickpeaks(Queries<T> *);
     
     template <typename T>
-    static status_t pickpeaks(std::vector<T> &, std::vector<T> &, int &, int, T *, T *);
+    static int_t selectpeaks(T *, T *, int_t, T *, T *);
 
 public:
 
     MSQuery();
     ~MSQuery();
+
+    /* Owns the .pbin mapping and the file stream */
+    MSQuery(const MSQuery &) = delete;
+    MSQuery &operator=(const MSQuery &) = delete;
+
     uint_t getQAcount();
-    status_t initialize(string_t *, int_t);
+    status_t initialize(string_t *, int_t, int_t nthreads = 1);
     void vinitialize(string_t *, int_t);
-    static bool init_index(const std::vector<string_t> &);
+    bool_t cacheinit(string_t *, int_t);
+    static status_t init_index(int_t);
     static status_t write_index();
     static status_t read_index(info_t *, int);
+    static status_t BINheader(const string_t &, PBINHeader &);
+    static bool_t verifyBINfile(const string_t &, PBINHeader *hdr = nullptr);
     status_t archive(int_t);
 
     template <typename T>
     status_t extractbatch(uint_t, Queries<T> *, int_t &);
 
+    status_t reservebatch(uint_t, uint_t &, uint_t &, ull_t &, ull_t &, int_t &);
+
+    template <typename T>
+    status_t readbatch(const char_t *, uint_t, uint_t, Queries<T> *);
+
     void setFilename(string_t &);
+    const string_t &getFilename();
     status_t DeinitQueryFile();
     BOOL isDeInit();
     uint_t getQfileIndex();
-    MSQuery &operator=(const MSQuery &);
     MSQuery &operator=(const int_t &);
 
     uint_t& Curr_chunk();
@@ -158,6 +219,6 @@ public:
 
     bool_t isinit();
 
-    static void flushBinaryFile(string_t *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close = false);
+    static void flushBinaryFile(string_t *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close = false, int_t maxslen = 0);
 
 };
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include "common.hpp"
+
+#if __has_include(<charconv>)
+#include <charconv>
+#endif // __has_include(<charconv>)
+
+//
+// Binary columnar PSM result file (.psmb)
+//
+//  header  : psm::header
+//  blocks  : up to PSMB_BLOCKROWS PSMs each: psm::block followed by
+//            the columns in column_t order. Each column is an array
+//            of nrows fixed width values padded to 8 bytes
+//  footer  : ull_t  blocks[nblocks]        block offsets
+//            ull_t  nfiles
+//            ull_t  fileoffs[nfiles + 1]   query file names
+//            char_t files[]                (padded to 8 bytes)
+//            ull_t  npeps
+//            ull_t  pepoffs[npeps + 1]     peptide sequences
+//            char_t peps[]                 (padded to 8 bytes)
+//            float_t masses[npeps]         peptide masses
+//  trailer : psm::trailer
+//
+// The PEPID column is a code into the peptide dictionary of the
+// file, the FILEID column an index into the query file names.
+// All values are in the native (little endian) byte order.
+//
+
+#define PSMB_MAGIC                       "HCPSMB1"
+#define PSMB_VERSION                     1
+
+/* PSMs in a block */
+#define PSMB_BLOCKROWS                   32768
+
+namespace hcp
+{
+namespace psm
+{
+
+// columns of a block in order
+enum column_t
+{
+    SPECID,         // uint_t   (scan_num - 1)
+    FILEID,         // ushort_t
+    CHARGE,         // uchar_t
+    PMASS,          // float_t
+    RTIME,          // float_t
+    PEPID,          // uint_t
+    SHARED,         // ushort_t
+    TOTAL,          // ushort_t
+    HYPERSCORE,     // float_t
+    EVALUE,         // double_t
+    NHITS,          // uint_t
+    RANK,           // ushort_t
+    NCOLS
+};
+
+static constexpr size_t colwidth[NCOLS] = {4, 2, 1, 4, 4, 4, 2, 2, 4, 8, 4, 2};
+
+static inline constexpr size_t pad8(size_t sz) { return (sz + 7) & ~((size_t) 7); }
+
+struct header
+{
+    char_t  magic[8];
+    uint_t  version;
+    uint_t  ncols;
+};
+
+struct block
+{
+    uint_t  nrows;
+    uint_t  reserved;
+};
+
+struct trailer
+{
+    ull_t   footer;
+    ull_t   nblocks;
+    char_t  magic[8];
+};
+
+//
+// append a field to a text buffer. Numbers are formatted like
+// std::to_string (%d, %f) without temporaries
+//
+static inline char_t *put(char_t *ptr, char_t *end, const char_t *str, size_t len)
+{
+    UNUSED_PARAM(end);
+    std::memcpy(ptr, str, len);
+    return ptr + len;
+}
+
+template <typename T>
+static inline char_t *put(char_t *ptr, char_t *end, T val)
+{
+#if defined (__cpp_lib_to_chars)
+    if constexpr (std::is_floating_point<T>::value)
+        return std::to_chars(ptr, end, (double_t) val, std::chars_format::fixed, 6).ptr;
+    else
+        return std::to_chars(ptr, end, val).ptr;
+#else
+    // floating-point to_chars needs GCC 11
+    int_t len = 0;
+
+    if constexpr (std::is_floating_point<T>::value)
+        len = std::snprintf(ptr, end - ptr, "%f", (double_t) val);
+    else if constexpr (std::is_unsigned<T>::value)
+        len = std::snprintf(ptr, end - ptr, "%llu", (ull_t) val);
+    else
+        len = std::snprintf(ptr, end - ptr, "%lld", (longlong_t) val);
+
+    return ptr + std::min<ptrdiff_t>(std::max(len, 0), end - ptr);
+#endif // __cpp_lib_to_chars
+}
+
+//
+// read-only (mmap) view of a .psmb file
+//
+class reader
+{
+private:
+    char_t        *base;
+    size_t         size;
+    const ull_t   *blockoffs;
+    ull_t          nblocks;
+    const ull_t   *fileoffs;
+    const char_t  *files;
+    ull_t          nfiles;
+    const ull_t   *pepoffs;
+    const char_t  *peps;
+    const float_t *masses;
+    ull_t          npeps;
+
+    bool_t valid(const VOID *ptr, size_t len) const
+    {
+        auto p = (const char_t *) ptr;
+        return p >= base && len <= size && p - base <= (ptrdiff_t) (size - len);
+    }
+
+    bool_t footer(const trailer *trl)
+    {
+        if (trl->footer > size)
+            return false;
+
+        const char_t *ptr = base + trl->footer;
+
+        nblocks = trl->nblocks;
+        blockoffs = (const ull_t *) ptr;
+
+        if (nblocks > size || !valid(blockoffs, (nblocks + 1) * sizeof(ull_t)))
+            return false;
+
+        ptr += nblocks * sizeof(ull_t);
+        nfiles = *(const ull_t *) ptr;
+        fileoffs = (const ull_t *) ptr + 1;
+
+        if (nfiles > size || !valid(fileoffs, (nfiles + 1) * sizeof(ull_t)))
+            return false;
+
+        files = (const char_t *) (fileoffs + nfiles + 1);
+        ptr = files + pad8(fileoffs[nfiles]);
+
+        if (!valid(files, fileoffs[nfiles]) || !valid(ptr, sizeof(ull_t)))
+            return false;
+
+        npeps = *(const ull_t *) ptr;
+        pepoffs = (const ull_t *) ptr + 1;
+
+        if (npeps > size || !valid(pepoffs, (npeps + 1) * sizeof(ull_t)))
+            return false;
+
+        peps = (const char_t *) (pepoffs + npeps + 1);
+        masses = (const float_t *) (peps + pad8(pepoffs[npeps]));
+
+        if (!valid(peps, pepoffs[npeps]) || !valid(masses, npeps * sizeof(float_t)))
+            return false;
+
+        for (ull_t f = 0; f < nfiles; f++)
+            if (fileoffs[f] > fileoffs[f + 1] || fileoffs[f + 1] > fileoffs[nfiles])
+                return false;
+
+        for (ull_t p = 0; p < npeps; p++)
+            if (pepoffs[p] > pepoffs[p + 1] || pepoffs[p + 1] > pepoffs[npeps])
+                return false;
+
+        // the blocks lie within the file
+        for (ull_t b = 0; b < nblocks; b++)
+        {
+            if (blockoffs[b] > size || !valid(base + blockoffs[b], sizeof(block)))
+                return false;
+
+            size_t len = sizeof(block);
+            auto nrows = rows(b);
+
+            for (int_t c = 0; c < NCOLS; c++)
+                len += pad8(colwidth[c] * nrows);
+
+            if (!valid(base + blockoffs[b], len))
+                return false;
+        }
+
+        return true;
+    }
+
+public:
+
+    reader() : base(nullptr), size(0), nblocks(0), nfiles(0), npeps(0) {}
+
+    ~reader() { close(); }
+
+    reader(const reader &) = delete;
+    reader &operator=(const reader &) = delete;
+
+    VOID close()
+    {
+        if (base != nullptr)
+            munmap(base, size);
+
+        base = nullptr;
+        size = nblocks = nfiles = npeps = 0;
+    }
+
+    // map the file and check its layout. Returns false if
+    // the file is not a (complete) .psmb file
+    bool_t open(const string_t &fname)
+    {
+        close();
+
+        int_t fd = ::open(fname.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) (sizeof(header) + sizeof(trailer)))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size = st.st_size;
+        base = (char_t *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+        ::close(fd);
+
+        if (base == MAP_FAILED)
+        {
+            base = nullptr;
+            return false;
+        }
+
+        auto hdr = (const header *) base;
+        auto trl = (const trailer *) (base + size - sizeof(trailer));
+
+        if (std::memcmp(hdr->magic, PSMB_MAGIC, sizeof(hdr->magic)) || hdr->version != PSMB_VERSION ||
+            hdr->ncols != NCOLS || std::memcmp(trl->magic, PSMB_MAGIC, sizeof(trl->magic)))
+        {
+            close();
+            return false;
+        }
+
+        // walk the footer
+        if (!footer(trl))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    ull_t numblocks() const { return nblocks; }
+    ull_t numfiles() const { return nfiles; }
+    ull_t numpeps() const { return npeps; }
+
+    uint_t rows(ull_t b) const { return ((const block *) (base + blockoffs[b]))->nrows; }
+
+    // column col of block b (an array of rows(b) values)
+    template <typename T>
+    const T *column(ull_t b, column_t col) const
+    {
+        auto nrows = rows(b);
+        const char_t *ptr = base + blockoffs[b] + sizeof(block);
+
+        for (int_t c = 0; c < col; c++)
+            ptr += pad8(colwidth[c] * nrows);
+
+        return (const T *) ptr;
+    }
+
+    std::string_view file(ull_t f) const { return std::string_view(files + fileoffs[f], fileoffs[f + 1] - fileoffs[f]); }
+    std::string_view peptide(ull_t p) const { return std::string_view(peps + pepoffs[p], pepoffs[p + 1] - pepoffs[p]); }
+    float_t mass(ull_t p) const { return masses[p]; }
+};
+
+} // namespace psm
+} // namespace hcp
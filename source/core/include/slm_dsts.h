@@ -21,12 +21,15 @@
 
 #include "common.hpp"
 #include "config.hpp"
-#include "minheap.h"
+#include "topk.h"
 #include <cstring>
 
 /* Types of modifications allowed by SLM_Mods     */
 #define MAX_MOD_TYPES                        15
 
+/* Widest precursor window (+-Da) searched with fmerge */
+#define FMERGE_MAXDM                         25.0
+
 /************************* Common DSTs ************************/
 
 /* Add distribution policies */
@@ -38,6 +41,30 @@ typedef enum _DistPolicy
 
 } DistPolicy_t;
 
+/* PSM output file formats */
+typedef enum _OutFormat
+{
+    tsv,       /* tab separated text                  */
+    psmb,      /* binary columnar (see psmfile.hpp)   */
+
+} OutFormat_t;
+
+/* Encodings of the partial result histograms (ebuffer::ibuff) */
+typedef enum _PartCodec
+{
+    raw,       /* Xsamples ushort_t slots per spectrum     */
+    lossless,  /* zigzag varint deltas of the curve region */
+
+} PartCodec_t;
+
+/* Encodings of the ion IDs in DSLIM.iA */
+typedef enum _IonEnc
+{
+    divide,    /* pepid * speclen + slot                 */
+    shiftmask, /* pepid << shift | power of 2 padded slot */
+
+} IonEnc_t;
+
 typedef struct _SLM_varAA
 {
     AA     residues[5]   ; /* Modified AA residues in this modification - Upto 4 */
@@ -285,7 +312,8 @@ typedef struct _pepEntry
 /*
  * Structure to store the sum of matched b and y ions and
  * their summed intensities for a given experimental spectrum
- * against all the candidate peptides.
+ * against all the candidate peptides. The CPU search keeps
+ * the same fields as separate arrays (see BYICount).
  */
 struct BYC
 {
@@ -326,6 +354,16 @@ typedef struct _Index
     PepSeqs     pepIndex;
     pepEntry *pepEntries;
     spmat_t    *ionIndex;
+    IonEnc_t      ionenc;
+
+    /* Precursor mass directory */
+    float_t    *pepMass;    /* Peptide masses (contiguous) */
+    uint_t     *massDir;    /* First peptide at each integer Dalton */
+    int_t        massLo;    /* Integer Dalton of massDir[0] */
+
+    /* Memory mapped index file (if loaded from the index cache) */
+    VOID       *idxmap;
+    ull_t   idxmapsize;
 
     _Index()
     {
@@ -342,6 +380,14 @@ typedef struct _Index
 
         pepEntries = NULL;
         ionIndex = NULL;
+        ionenc = IonEnc_t::divide;
+
+        pepMass = NULL;
+        massDir = NULL;
+        massLo = 0;
+
+        idxmap = NULL;
+        idxmapsize = 0;
     }
 } Index;
 
@@ -368,6 +414,10 @@ enum FileType_t {
     uint_t nodes;
     uint_t myid;
     uint_t spadmem;
+    uint_t qtile;
+    uint_t spwindow;
+    uint_t prefetch;
+    uint_t partmem;
 
     uint_t min_mass;
     uint_t max_mass;
@@ -380,6 +430,7 @@ enum FileType_t {
     bool_t reindex;
     bool_t nocache;
     bool_t gpuindex;
+    bool_t fmerge;
 
     double_t dM;
     double_t res;
@@ -388,12 +439,16 @@ enum FileType_t {
     string_t dbpath;
     string_t datapath;
     string_t workspace;
-    const string_t dataext = ".ms2";
+    string_t idxcache;
 
     string_t modconditions;
 
     DistPolicy_t policy;
 
+    OutFormat_t outfmt;
+
+    PartCodec_t partcodec;
+
     FileType_t filetype;
 
     SLM_vMods vModInfo;
@@ -406,7 +461,7 @@ enum FileType_t {
         min_len = 6;
         max_len = 40;
         maxz = 3;
-        topmatches = 10;
+        topmatches = 1;
         scale = 100;
         expect_max = 20;
         min_shp = 4;
@@ -420,12 +475,19 @@ enum FileType_t {
         nodes = 1;
         myid = 0;
         spadmem = 2048;
+        qtile = 0;
+        spwindow = 65536;
+        prefetch = 4;
+        partmem = 4096;
         min_mass = 500;
         max_mass = 5000;
         dF = 0;
         dM = 500.0;
+        fmerge = (dM <= FMERGE_MAXDM);
         res = 0.01;
         policy = DistPolicy_t::cyclic;
+        outfmt = OutFormat_t::tsv;
+        partcodec = PartCodec_t::lossless;
         filetype = FileType_t::PBIN;
     }
 
@@ -484,20 +546,27 @@ enum FileType_t {
         printVar(reindex);
         printVar(nocache);
         printVar(gpuindex);
+        printVar(fmerge);
         printVar(min_int);
         printVar(nodes);
         printVar(myid);
         printVar(spadmem);
+        printVar(qtile);
+        printVar(spwindow);
+        printVar(prefetch);
+        printVar(partmem);
         printVar(min_mass);
         printVar(max_mass);
         printVar(dF);
         printVar(dM);
         printVar(res);
         printVar(policy);
+        printVar(outfmt);
+        printVar(partcodec);
         printVar(dbpath);
         printVar(datapath);
         printVar(workspace);
-        printVar(dataext);
+        printVar(idxcache);
         printVar(filetype);
 
         printVar(modconditions);
@@ -795,9 +864,8 @@ typedef struct _Results
     /* Number of candidate PSMs (n) */
     uint_t cpsms;
 
-    /* Min heap to keep track of top
-     */
-    minHeap<hCell> topK;
+    /* Top-K (params.topmatches) PSMs */
+    hcp::utils::topk<hCell> topK;
 
     /* The y ~ logWeibull(X, mu, beta)
      * for data fit
@@ -954,12 +1022,22 @@ typedef struct _partResult
 
 typedef struct _BYICount
 {
-    BYC     *byc;       /* Both counts */
-    Results  res;
+    ushort_t *bc;       /* b ion counts */
+    ushort_t *yc;       /* y ion counts */
+    uint_t   *ibc;      /* b ion intensities */
+    uint_t   *iyc;      /* y ion intensities */
+    Results   res;
+    Results  *tres;     /* Results per spectrum in a tile */
+    uint_t   *touched;  /* Scorecard entries touched by a query */
 
     _BYICount()
     {
-        byc = NULL;
+        bc = NULL;
+        yc = NULL;
+        ibc = NULL;
+        iyc = NULL;
+        tres = NULL;
+        touched = NULL;
     }
 
 } BYICount;
@@ -1017,6 +1095,9 @@ typedef struct _ebuffer
     int_t batchNum;
     BOOL isDone;
 
+    /* Encoding of ibuff (see expeRT::Encode) */
+    PartCodec_t codec;
+
     _ebuffer()
     {
         packs = new partRes[QCHUNK];
@@ -1024,6 +1105,18 @@ typedef struct _ebuffer
         currptr = 0;
         batchNum = -1;
         isDone = true;
+        codec = PartCodec_t::raw;
+    }
+
+    /* Exactly sized for received partial results */
+    _ebuffer(int_t npacks, int_t nbytes)
+    {
+        packs = new partRes[npacks];
+        ibuff = new char_t[nbytes];
+        currptr = nbytes;
+        batchNum = -1;
+        isDone = true;
+        codec = PartCodec_t::raw;
     }
 
     ~_ebuffer()
@@ -1043,6 +1136,7 @@ typedef struct _ebuffer
         currptr = 0;
         batchNum = -1;
         isDone = true;
+        codec = PartCodec_t::raw;
     }
 
 } ebuffer;
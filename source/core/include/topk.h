@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2022  Muhammad Haseeb, and Fahad Saeed
+ * Florida International University, Miami, FL
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+
+namespace hcp
+{
+namespace utils
+{
+
+//
+// fixed capacity container of the K records with the highest
+// scores. The scores are kept in a separate lane so that the
+// rejection test and the search for the record to evict only
+// touch floats. A record is written (by the caller) only after
+// its score has been admitted.
+//
+template <class T>
+class topk
+{
+private:
+    int_t      capacity;
+    int_t      count;
+
+    // slot and score of the lowest record (when full)
+    int_t      minpos;
+    float_t    minscore;
+
+    float_t   *scores;
+    T         *cells;
+
+    // locate the lowest record
+    inline VOID update_min()
+    {
+        minpos = 0;
+        minscore = scores[0];
+
+        for (int_t i = 1; i < count; i++)
+        {
+            if (scores[i] < minscore)
+            {
+                minscore = scores[i];
+                minpos = i;
+            }
+        }
+    }
+
+public:
+
+    topk()
+    {
+        capacity = 0;
+        count = 0;
+        minpos = 0;
+        minscore = 0;
+        scores = nullptr;
+        cells = nullptr;
+    }
+
+    ~topk()
+    {
+        if (scores != nullptr)
+            delete[] scores;
+
+        if (cells != nullptr)
+            delete[] cells;
+
+        scores = nullptr;
+        cells = nullptr;
+    }
+
+    // allocate K (at least 1) records
+    VOID init(int_t _capacity)
+    {
+        capacity = std::max(1, _capacity);
+        count = 0;
+        scores = new float_t[capacity];
+        cells = new T[capacity];
+    }
+
+    VOID reset() { count = 0; }
+
+    int_t size() const { return count; }
+
+    int_t get_capacity() const { return capacity; }
+
+    // true if a record with this score would be kept
+    inline bool_t admits(float_t score) const { return count < capacity || score > minscore; }
+
+    //
+    // admit a score and return the slot to write its record to,
+    // or nullptr if the score is not in the top-K. Ties with the
+    // lowest record keep the record that was inserted first.
+    //
+    inline T *insert(float_t score)
+    {
+        int_t pos;
+
+        if (count < capacity)
+        {
+            pos = count++;
+            scores[pos] = score;
+
+            if (count == capacity)
+                update_min();
+        }
+        else if (score > minscore)
+        {
+            pos = minpos;
+            scores[pos] = score;
+
+            update_min();
+        }
+        else
+            return nullptr;
+
+        return cells + pos;
+    }
+
+    // the record with the highest score (first inserted on ties)
+    T getMax() const
+    {
+        if (count < 1)
+            return T();
+
+        int_t maxpos = 0;
+
+        for (int_t i = 1; i < count; i++)
+        {
+            if (scores[i] > scores[maxpos])
+                maxpos = i;
+        }
+
+        return cells[maxpos];
+    }
+
+    // order the records by decreasing score (stable)
+    VOID sort()
+    {
+        for (int_t i = 1; i < count; i++)
+        {
+            float_t score = scores[i];
+            T cell = cells[i];
+
+            int_t j = i - 1;
+
+            for (; j >= 0 && scores[j] < score; j--)
+            {
+                scores[j + 1] = scores[j];
+                cells[j + 1] = cells[j];
+            }
+
+            scores[j + 1] = score;
+            cells[j + 1] = cell;
+        }
+
+        if (count == capacity)
+            update_min();
+    }
+
+    T &operator[](int_t i) { return cells[i]; }
+};
+
+} // namespace utils
+} // namespace hcp
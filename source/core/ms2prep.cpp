@@ -110,24 +110,48 @@ status_t initialize(lwqueue<MSQuery *>** qfPtrs, int_t& nBatches, int_t& dssize)
         for (auto lptr = ptrs; lptr < ptrs + nfiles; lptr++)
             *lptr = new MSQuery;
 
-        // get local partition size
-        auto pfiles = hcp::mpi::getPartitionSize(nfiles);
+        // initialize the files with current .pbin files from them
+        std::vector<int_t> cached(nfiles);
 
-        // initialize the MSQuery index
-        bool summaryExists = MSQuery::init_index(queryfiles);
+#ifdef USE_OMP
+#pragma omp parallel for schedule (dynamic, 1) num_threads(params.threads)
+#endif/* _OPENMP */
+        for (auto fid = 0; fid < nfiles; fid++)
+            cached[fid] = ptrs[fid]->cacheinit(&queryfiles[fid], fid);
+
+        // new or changed files to preprocess
+        std::vector<int_t> stale;
+
+        for (auto fid = 0; fid < nfiles; fid++)
+            if (!cached[fid])
+                stale.push_back(fid);
+
+        if (params.myid == 0)
+            std::cout << "MS/MS files to preprocess: " << stale.size() << " of " << nfiles << std::endl;
+
+        // get local partition size (of the files to preprocess)
+        int_t nstale = stale.size();
+        auto pfiles = hcp::mpi::getPartitionSize(nstale);
+
+        // open the MSQuery index to update their entries
+        if (nstale > 0)
+        {
+            MSQuery::init_index(nfiles);
 
-        // if pfiles > 0 and !summaryExists
-        if (pfiles && !summaryExists)
+            // keep the entries of the cached files current as well
+            for (int_t fid = params.myid; fid < nfiles; fid += params.nodes)
+                if (cached[fid])
+                    ptrs[fid]->archive(fid);
+        }
+
+        if (pfiles)
         {
             // fill the vector with locally processed MS2 file indices
+            // (the files to preprocess in cyclic order)
             std::vector<int_t> ms2local(pfiles);
 
-            // first element is params.myid
-            ms2local[0] = params.myid;
-
-            // rest of the files in cyclic order
-            std::generate(std::begin(ms2local) + 1, std::end(ms2local),
-                          [n=params.myid] () mutable { return n += params.nodes; });
+            for (auto fid = 0; fid < pfiles; fid++)
+                ms2local[fid] = stale[params.myid + fid * params.nodes];
 
 #if defined(USE_GPU)
 
@@ -215,22 +239,34 @@ status_t initialize(lwqueue<MSQuery *>** qfPtrs, int_t& nBatches, int_t& dssize)
             wThreads.clear();
 
 #else
+            // split the threads across the files and then
+            // across the spectra of each file
+            int_t fthreads = std::max(1, std::min(pfiles, cputhreads));
+            int_t sthreads = std::max(1, cputhreads / fthreads);
+
 #ifdef USE_OMP
-#pragma omp parallel for schedule (dynamic, 1)
+            int_t levels = omp_get_max_active_levels();
+            omp_set_max_active_levels(std::max(levels, 2));
+
+#pragma omp parallel for schedule (dynamic, 1) num_threads(fthreads)
 #endif/* _OPENMP */
             for (auto fid = 0; fid < pfiles; fid++)
             {
                 auto loc_fid = ms2local[fid];
-                ptrs[loc_fid]->initialize(&queryfiles[loc_fid], loc_fid);
+                ptrs[loc_fid]->initialize(&queryfiles[loc_fid], loc_fid, sthreads);
 #ifdef USE_MPI
                 if (params.nodes > 1)
                     ptrs[loc_fid]->archive(loc_fid);
 #endif // USE_MPI
             }
 
+#ifdef USE_OMP
+            omp_set_max_active_levels(levels);
+#endif/* _OPENMP */
+
 #endif // defined(USE_GPU)
 
-            // in case of one node, we need to write in order
+            // in case of one node, archive the entries here
             if (params.nodes == 1)
             {
                 for (auto fid = 0; fid < pfiles; fid++)
@@ -253,8 +289,8 @@ status_t initialize(lwqueue<MSQuery *>** qfPtrs, int_t& nBatches, int_t& dssize)
         // Synchronize global data summary
         //
 
-        // if more than one nodes or summary file exists
-        if (params.nodes > 1 || summaryExists)
+        // the files preprocessed by the other nodes
+        if (params.nodes > 1 && nstale > 0)
         {
             info_t *findex = new info_t[nfiles];
 
@@ -16,31 +16,51 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  *
  */
-#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
 #include "msquery.hpp"
 #include "cuda/superstep2/kernel.hpp"
 
+#if defined (USE_ZLIB)
+#include <zlib.h>
+#endif // USE_ZLIB
+
 using namespace std;
 
 #define BIN_BATCHSIZE               50000
 #define TEMPVECTOR_SIZE             KBYTES(20)
 
+/* bounds of the MS2 file ranges preprocessed in parallel */
+#define MS2_MINRANGE                MBYTES(1)
+#define MS2_MAXRANGE                MBYTES(64)
+
+/* per spectrum header in .pbin: prec_mz, z, rtime, len */
+#define PBIN_SPECHDR                (2 * sizeof(float) + 2 * sizeof(int))
+
 extern gParams params;
 
 #if defined(USE_MPI)
 // MPI datatype for info_t
 MPI_Datatype MPI_info;
 // handle for summary.dbprep file
-MPI_File mpi_fh;
+MPI_File mpi_fh = MPI_FILE_NULL;
 
 #endif // USE_MPI
 
 // handle for summary.dbprep file
-std::ofstream *fh;
+std::fstream *fh = nullptr;
+std::mutex fhlock;
 
 MSQuery::MSQuery()
 {
     qfile = nullptr;
+    qmap = nullptr;
+    qmapsize = 0;
+    qoffs = nullptr;
     currPtr = 0;
     curr_chunk = 0;
     running_count = 0;
@@ -62,6 +82,8 @@ MSQuery::~MSQuery()
         qfile = NULL;
     }
 
+    unmapBINfile();
+
     if (params.filetype == gParams::FileType_t::MS2)
         spectrum.deallocate();
 
@@ -76,23 +98,20 @@ MSQuery::~MSQuery()
 //
 std::array<int, 2> MSQuery::readMS2file(string *filename)
 {
-    /* Get a new ifstream object and open file */
-    ifstream *qqfile = new ifstream(*filename);
+    hcp::ms2::linereader qqfile(*filename);
 
     int_t largestspec = 0;
     int_t count = 0;
     int_t specsize = 0;
+
     /* Check if file opened */
-    if (qqfile->is_open() /*&& status =SLM_SUCCESS*/)
+    if (qqfile.is_open())
     {
-        string_t line;
+        std::string_view line;
 
         /* While we still have lines in MS2 file */
-        while (!qqfile->eof())
+        while (qqfile.getline(line))
         {
-            /* Read one line */
-            getline(*qqfile, line);
-
             /* Empty line */
             if (line.empty())
             {
@@ -120,12 +139,6 @@ std::array<int, 2> MSQuery::readMS2file(string *filename)
 
         // check if the last spectrum in the file is the largest
         largestspec = max(specsize, largestspec);
-
-        /* Close the file */
-        qqfile->close();
-
-        delete qqfile;
-
     }
     else
         cout << "Error: Unable to open qqfile: " << *filename << endl;
@@ -135,16 +148,373 @@ std::array<int, 2> MSQuery::readMS2file(string *filename)
     return std::array<int, 2>{count, largestspec};
 }
 
-std::array<int, 2> MSQuery::convertAndprepMS2bin(string *filename)
+/*
+ * FUNCTION: selectpeaks
+ *
+ * DESCRIPTION: Normalize a raw spectrum to params.base_int and pick
+ *              (at most QALEN of) its most intense peaks that pass
+ *              params.min_int. The peaks are written in ascending
+ *              order of intensity, i.e. the order of the tail of a
+ *              full key-value sort on the intensities.
+ *
+ * INPUT:
+ * @intns : Raw peak intensities
+ * @mzs   : Raw peak m/z values
+ * @len   : Number of raw peaks
+ * @ointns: Output intensities (QALEN capacity)
+ * @omzs  : Output m/z values (QALEN capacity)
+ *
+ * OUTPUT:
+ * @npeaks: Number of peaks written
+ */
+template <typename T>
+int_t MSQuery::selectpeaks(T *intns, T *mzs, int_t len, T *ointns, T *omzs)
 {
-    int_t largestspec = 0;
-    int_t count = 0;
-    int_t globalcount = 0;
-    int_t specsize = 0;
+    // (raw intensity, m/z) of the peaks that pass the threshold
+    static thread_local std::vector<std::pair<T, T>> cands;
+
+    if (len <= 0)
+        return 0;
+
+    int_t maxpos = std::max_element(intns, intns + len) - intns;
+
+    // intensity normalization applied
+    double_t factor = ((double_t) params.base_int / intns[maxpos]);
+
+    // filter out intensities < params.min_int after normalization
+    T l_min_int = params.min_int;
+
+    cands.resize(len);
+    int_t ncands = 0;
+
+    // the normalization is monotonic, so the threshold
+    // can be applied before selecting the top peaks
+    for (int_t j = 0; j < len; j++)
+    {
+        T nint = intns[j] * factor;
+
+        cands[ncands] = std::make_pair(intns[j], mzs[j]);
+        ncands += (nint >= l_min_int || j == maxpos);
+    }
+
+    auto byintn = [](const std::pair<T, T> &a, const std::pair<T, T> &b) { return a.first < b.first; };
+
+    auto first = cands.begin();
+    auto last = cands.begin() + ncands;
+
+    // keep the QALEN most intense peaks at the end
+    if (ncands > QALEN)
+    {
+        first = last - QALEN;
+        std::nth_element(cands.begin(), first, last, byintn);
+    }
+
+    std::sort(first, last, byintn);
+
+    int_t npeaks = last - first;
+
+    for (int_t j = 0; j < npeaks; j++)
+    {
+        ointns[j] = first[j].first * factor;
+        omzs[j] = first[j].second;
+    }
+
+    /* Set the highest peak to base intensity */
+    ointns[npeaks - 1] = params.base_int;
+
+    return npeaks;
+}
+
+/*
+ * FUNCTION: BINheader
+ *
+ * DESCRIPTION: Fill the expected .pbin header (source file
+ *              identity and settings) for an MS2 file. The
+ *              content hash covers the first and the last
+ *              PBIN_HASHSPAN bytes of the MS2 file
+ *
+ * INPUT:
+ * @ms2file: Path to the source MS2 file
+ * @hdr    : Header to fill
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t MSQuery::BINheader(const string_t &ms2file, PBINHeader &hdr)
+{
+    struct stat st;
+
+    std::memset(&hdr, 0x0, sizeof(PBINHeader));
+
+    std::strncpy(hdr.magic, PBIN_MAGIC, sizeof(hdr.magic));
+    hdr.version  = PBIN_VERSION;
+    hdr.hdrsize  = sizeof(PBINHeader);
+
+    hdr.scale    = params.scale;
+    hdr.base_int = params.base_int;
+    hdr.min_int  = params.min_int;
+    hdr.qalen    = QALEN;
+    hdr.spectype = sizeof(spectype_t);
+
+    int fd = open(ms2file.c_str(), O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    hdr.srcsize  = (ull_t) st.st_size;
+    hdr.srcmtime = (ull_t) st.st_mtim.tv_sec * 1000000000ULL + (ull_t) st.st_mtim.tv_nsec;
+
+    // 64-bit FNV-1a of the head and the tail of the file
+    std::vector<uchar_t> sbuf(PBIN_HASHSPAN);
+    ull_t hash = 0xcbf29ce484222325ULL;
+
+    ull_t tailoff = (hdr.srcsize > PBIN_HASHSPAN) ? hdr.srcsize - PBIN_HASHSPAN : 0;
+
+    for (ull_t off : {(ull_t) 0, tailoff})
+    {
+        ssize_t nread = pread(fd, sbuf.data(), PBIN_HASHSPAN, off);
+
+        for (ssize_t i = 0; i < nread; i++)
+        {
+            hash ^= sbuf[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    close(fd);
+
+    hdr.srchash = hash;
+
+    return SLM_SUCCESS;
+}
+
+/*
+ * FUNCTION: verifyBINfile
+ *
+ * DESCRIPTION: Check if the .pbin file of an MS2 file is complete
+ *              and was generated from the current MS2 file using
+ *              the current settings
+ *
+ * INPUT:
+ * @ms2file: Path to the source MS2 file
+ * @hdr    : Header of the .pbin file if valid (optional)
+ *
+ * OUTPUT:
+ * @valid: true if the .pbin file can be reused
+ */
+bool_t MSQuery::verifyBINfile(const string_t &ms2file, PBINHeader *hdr)
+{
+    PBINHeader expected;
+    PBINHeader fhdr;
+    struct stat st;
+
+    if (BINheader(ms2file, expected) != SLM_SUCCESS)
+        return false;
+
+    string_t fname = ms2file + ".pbin";
+
+    if (stat(fname.c_str(), &st) != 0 || (ull_t) st.st_size < sizeof(PBINHeader))
+        return false;
 
-    char_t *Zsave;
-    char_t *Isave;
+    ifstream pfile(fname, ios::in | ios::binary);
 
+    if (!pfile.read((char_t *) &fhdr, sizeof(PBINHeader)))
+        return false;
+
+    // the offset table is written last
+    bool_t complete = fhdr.offtab >= sizeof(PBINHeader) &&
+                      fhdr.offtab + (fhdr.nspecs + 1) * sizeof(ull_t) == (ull_t) st.st_size;
+
+    bool_t valid = complete &&
+                   !std::strncmp(fhdr.magic, expected.magic, sizeof(fhdr.magic)) &&
+                   fhdr.version  == expected.version  && fhdr.hdrsize  == expected.hdrsize  &&
+                   fhdr.srcsize  == expected.srcsize  && fhdr.srcmtime == expected.srcmtime &&
+                   fhdr.srchash  == expected.srchash  && fhdr.scale    == expected.scale    &&
+                   fhdr.base_int == expected.base_int && fhdr.min_int  == expected.min_int  &&
+                   fhdr.qalen    == expected.qalen    && fhdr.spectype == expected.spectype;
+
+    if (valid && hdr != nullptr)
+        *hdr = fhdr;
+
+    return valid;
+}
+
+//
+// preprocessed spectra of a range of an MS2 file
+//
+struct PBINBatch
+{
+    std::vector<spectype_t> mzs;
+    std::vector<spectype_t> intns;
+    std::vector<float>      rtimes;
+    std::vector<float>      prec_mz;
+    std::vector<int>        z;
+    std::vector<int>        lens;
+    int_t                   largestspec = 0;
+};
+
+//
+// writer of .pbin files: spectrum records are appended in
+// batches and the offset table and header are written on close
+//
+class PBINWriter
+{
+private:
+    std::ofstream       qbFile;
+    string_t            ms2file;
+    std::vector<ull_t>  offsets;
+    ull_t               curroff = 0;
+
+public:
+
+    bool_t is_open() { return qbFile.is_open(); }
+
+    VOID open(const string_t &filename)
+    {
+        ms2file = filename;
+        qbFile.open(ms2file + ".pbin", ios::binary);
+
+        // reserve the header, it is written on close
+        PBINHeader hdr;
+        std::memset(&hdr, 0x0, sizeof(PBINHeader));
+        qbFile.write((char *)&hdr, sizeof(PBINHeader));
+
+        offsets.clear();
+        curroff = sizeof(PBINHeader);
+    }
+
+    VOID write(const spectype_t *m_mzs, const spectype_t *m_intns, const float *rtimes, const float *prec_mz, const int *z, const int *lens, int count)
+    {
+        int ind = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            qbFile.write((char *)&prec_mz[i], sizeof(float));
+            qbFile.write((char *)&z[i], sizeof(int));
+            qbFile.write((char *)&rtimes[i], sizeof(float));
+            qbFile.write((char *)&lens[i], sizeof(int));
+
+            qbFile.write((char *)&m_mzs[ind], sizeof(spectype_t) * lens[i]);
+            qbFile.write((char *)&m_intns[ind], sizeof(spectype_t) * lens[i]);
+
+            offsets.push_back(curroff);
+            curroff += PBIN_SPECHDR + 2 * sizeof(spectype_t) * lens[i];
+
+            ind += lens[i];
+        }
+    }
+
+    VOID close(int_t maxslen = 0)
+    {
+        if (qbFile.is_open())
+        {
+            PBINHeader hdr;
+            MSQuery::BINheader(ms2file, hdr);
+
+            // largest (raw) spectrum size
+            hdr.maxslen = maxslen;
+
+            // 8-byte align the offset table
+            ull_t pad = (sizeof(ull_t) - (curroff % sizeof(ull_t))) % sizeof(ull_t);
+            ull_t zero = 0;
+            qbFile.write((char *)&zero, pad);
+
+            hdr.nspecs = offsets.size();
+            hdr.offtab = curroff + pad;
+
+            // sentinel: end of the last record
+            offsets.push_back(curroff);
+            qbFile.write((char *)offsets.data(), sizeof(ull_t) * offsets.size());
+
+            qbFile.seekp(0);
+            qbFile.write((char *)&hdr, sizeof(PBINHeader));
+        }
+
+        qbFile.flush();
+        qbFile.close();
+
+        offsets.clear();
+        offsets.shrink_to_fit();
+    }
+};
+
+/*
+ * FUNCTION: addspectrum
+ *
+ * DESCRIPTION: Pick the peaks of a raw spectrum and append them to
+ *              the batch. The precursor information of the spectrum
+ *              must already be in the batch
+ *
+ * INPUT:
+ * @batch: Preprocessed spectra
+ * @mzs  : Raw peak m/z values (cleared on return)
+ * @intns: Raw peak intensities (cleared on return)
+ *
+ * OUTPUT: none
+ */
+VOID MSQuery::addspectrum(PBINBatch &batch, std::vector<spectype_t> &mzs, std::vector<spectype_t> &intns)
+{
+    int_t specsize = mzs.size();
+
+    // largest spectrum size
+    batch.largestspec = max(specsize, batch.largestspec);
+
+    int_t m_idx = batch.mzs.size();
+    batch.mzs.resize(m_idx + QALEN);
+    batch.intns.resize(m_idx + QALEN);
+
+    int_t npeaks = 0;
+
+    if (specsize > 0)
+        npeaks = selectpeaks(intns.data(), mzs.data(), specsize, batch.intns.data() + m_idx, batch.mzs.data() + m_idx);
+    else
+        std::cerr << "Spectrum size is zero" << endl;
+
+    batch.mzs.resize(m_idx + npeaks);
+    batch.intns.resize(m_idx + npeaks);
+    batch.lens.push_back(npeaks);
+
+    mzs.clear();
+    intns.clear();
+}
+
+//
+// append a raw peak (integrized if spectype_t is int)
+//
+static inline VOID MSQuery_AddPeak(std::vector<spectype_t> &mzs, std::vector<spectype_t> &intns, double_t mz, double_t intn)
+{
+    if constexpr (std::is_same<int, spectype_t>::value)
+    {
+        mzs.push_back(mz * params.scale);
+        intns.push_back(intn * YAXISMULTIPLIER);
+    }
+    else
+    {
+        mzs.push_back(mz);
+        intns.push_back(intn);
+    }
+}
+
+/*
+ * FUNCTION: prepMS2range
+ *
+ * DESCRIPTION: Parse and preprocess the spectra of a range of an
+ *              MS2 file. The range must start at an S line (or at
+ *              the beginning of the file) and end before an S line
+ *
+ * INPUT:
+ * @block: The range of the MS2 file
+ * @batch: Preprocessed spectra of the range
+ *
+ * OUTPUT: none
+ */
+VOID MSQuery::prepMS2range(std::string_view block, PBINBatch &batch)
+{
     std::vector<spectype_t> mzs;
     std::vector<spectype_t> intns;
 
@@ -152,313 +522,513 @@ std::array<int, 2> MSQuery::convertAndprepMS2bin(string *filename)
     mzs.reserve(TEMPVECTOR_SIZE);
     intns.reserve(TEMPVECTOR_SIZE);
 
-    spectype_t *m_mzs = new int[BIN_BATCHSIZE * QALEN];
-    spectype_t *m_intns = new spectype_t[BIN_BATCHSIZE * QALEN];
-
-    int    m_idx = 0;
+    std::string_view line;
+    bool_t isOpen = false;
 
-    float *rtimes = new float[2 * BIN_BATCHSIZE];
-    float *prec_mz = rtimes + BIN_BATCHSIZE;
+    while (hcp::ms2::nextline(block, line))
+    {
+        if (line.empty() || line[0] == 'H' || line[0] == 'D')
+        {
+            continue;
+        }
+        /* Scan: (S) */
+        else if (line[0] == 'S')
+        {
+            if (isOpen)
+                addspectrum(batch, mzs, intns);
 
-    int *z = new int[2 * BIN_BATCHSIZE];
-    int *lens = z + BIN_BATCHSIZE;
+            isOpen = true;
 
-    /* Get a new ifstream object and open file */
-    ifstream *qqfile = new ifstream(*filename);
+            // defaults if the Z or I lines are missing
+            batch.z.push_back(1);
+            batch.prec_mz.push_back(0.01);
+            batch.rtimes.push_back(0.0);
+        }
+        else if (!isOpen)
+        {
+            continue;
+        }
+        else if (line[0] == 'Z')
+        {
+            hcp::ms2::token(line);
 
-    /* Check if file opened */
-    if (qqfile->is_open())
-    {
-        string_t line;
-        bool isFirst = true;
+            int_t charge = hcp::ms2::tonum<int_t>(hcp::ms2::token(line), 1);
 
-        /* While we still have lines in MS2 file */
-        while (!qqfile->eof())
+            batch.z.back() = MAX(1, charge);
+            batch.prec_mz.back() = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+        }
+        else if (line[0] == 'I')
         {
-            /* Read one line */
-            getline(*qqfile, line);
+            hcp::ms2::token(line);
 
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
+            if (hcp::ms2::token(line) == "RTime")
             {
-                continue;
+                double_t rtime = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.0);
+                batch.rtimes.back() = MAX(0.0, rtime);
             }
-            /* Scan: (S) */
-            else if (line[0] == 'S')
-            {
-                if (!isFirst)
-                {
-                    // largest spectrum size
-                    largestspec = max(specsize, largestspec);
-
-                    // specsize will update here
-                    MSQuery::pickpeaks(mzs, intns, specsize, m_idx, m_intns, m_mzs);
-
-                    // write the updated specsize
-                    lens[count] = specsize;
-                    m_idx += specsize;
-
-                    count++;
-                    globalcount++;
-
-                    // if the buffer is full, then dump to file
-                    if (count == BIN_BATCHSIZE)
-                    {
-                        // flush to the binary file
-                        MSQuery::flushBinaryFile(filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count);
-
-                        count = 0;
-                        m_idx = 0;
-                    }
-                }
-                else
-                    isFirst = false;
+        }
+        /* MS/MS data: [m/z] [int] */
+        else
+        {
+            /* Split line into two DOUBLEs */
+            double_t mz = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+            double_t intn = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
 
-                specsize = 0;
+            MSQuery_AddPeak(mzs, intns, mz, intn);
+        }
+    }
 
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Zsave);
-                mh = strtok_r(NULL, " \t", &Zsave);
-                string_t val = "1";
+    // process the last spectrum in the range
+    if (isOpen)
+        addspectrum(batch, mzs, intns);
+}
 
-                if (mh != NULL)
-                    val = string_t(mh);
+/*
+ * FUNCTION: prepMGFrange
+ *
+ * DESCRIPTION: Parse and preprocess the spectra (BEGIN IONS ..
+ *              END IONS) of a range of an MGF file. The precursor
+ *              m/z (PEPMASS) is converted to the [M+H]+ mass used
+ *              by the MS2 Z lines and RTINSECONDS to minutes
+ *
+ * INPUT:
+ * @block: The range of the MGF file
+ * @batch: Preprocessed spectra of the range
+ *
+ * OUTPUT: none
+ */
+VOID MSQuery::prepMGFrange(std::string_view block, PBINBatch &batch)
+{
+    std::vector<spectype_t> mzs;
+    std::vector<spectype_t> intns;
 
-                z[count] = MAX(1, std::atoi(val.c_str()));
+    mzs.reserve(TEMPVECTOR_SIZE);
+    intns.reserve(TEMPVECTOR_SIZE);
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &Zsave);
+    std::string_view line;
+    bool_t isOpen = false;
 
-                if (mh != NULL)
-                    val = string_t(mh);
+    double_t pepmz = 0;
+    double_t rtime = 0;
+    int_t charge = 0;
 
-                prec_mz[count] = std::atof(val.c_str());
-            }
-            else if (line[0] == 'I')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
-
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
-
-                    rtimes[count] = MAX(0.0, std::atof(val.c_str()));
-                }
-            }
-            /* MS/MS data: [m/z] [int] */
-            else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
-
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &Zsave);
-                char_t *intn1 = strtok_r(NULL, " ", &Zsave);
-                string_t mz = "0.01";
-                string_t intn = "0.01";
-
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
-
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
-
-                // integrize the values if spectype_t is int
-                if constexpr (std::is_same<int, spectype_t>::value)
-                {
-                    mzs.push_back(std::move(std::atof(mz.c_str()) * params.scale));
-                    intns.push_back(std::move(std::atof(intn.c_str()) * YAXISMULTIPLIER));
-                }
-                else
-                {
-                    mzs.push_back(std::move(std::atof(mz.c_str())));
-                    intns.push_back(std::move(std::atof(intn.c_str())));
-                }
-
-                // increment the spectrum size
-                specsize++;
-            }
+    while (hcp::ms2::nextline(block, line))
+    {
+        if (line.empty() || line[0] == '#' || line[0] == ';' || line[0] == '!')
+        {
+            continue;
         }
+        else if (line.compare(0, 10, "BEGIN IONS") == 0)
+        {
+            isOpen = true;
+            pepmz = 0;
+            rtime = 0;
+            charge = 0;
 
-        //
-        // process the last spectrum in the file here
-        //
-        largestspec = max(specsize, largestspec);
+            mzs.clear();
+            intns.clear();
+        }
+        else if (!isOpen)
+        {
+            continue;
+        }
+        else if (line.compare(0, 8, "END IONS") == 0)
+        {
+            // unknown charge is treated as 1+
+            int_t z = MAX(1, charge);
 
-        // specsize will update here
-        MSQuery::pickpeaks(mzs, intns, specsize, m_idx, m_intns, m_mzs);
+            batch.z.push_back(z);
+            batch.prec_mz.push_back((pepmz - PROTON) * z + PROTON);
+            batch.rtimes.push_back(MAX(0.0, rtime));
 
-        // update lens and counts
-        lens[count] = specsize;
-        m_idx += specsize;
+            addspectrum(batch, mzs, intns);
 
-        count++;
-        globalcount++;
+            isOpen = false;
+        }
+        /* MS/MS data: [m/z] [int] (optional [charge]) */
+        else if (std::isdigit((uchar_t) line[0]) || line[0] == '.')
+        {
+            double_t mz = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+            double_t intn = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
 
-        // flush the last batch to the file
-        MSQuery::flushBinaryFile(filename, m_mzs, m_intns, rtimes, prec_mz, z, lens, count, true);
+            MSQuery_AddPeak(mzs, intns, mz, intn);
+        }
+        /* KEY=value */
+        else
+        {
+            auto eq = line.find('=');
+
+            if (eq == std::string_view::npos)
+                continue;
 
-        /* Close the file */
-        qqfile->close();
+            auto key = line.substr(0, eq);
+            auto val = line.substr(eq + 1);
 
-        delete qqfile;
+            if (key == "PEPMASS")
+                pepmz = hcp::ms2::tonum<double_t>(hcp::ms2::token(val), 0.0);
+            // e.g. 2+ or 2+ and 3+: the first one is used
+            else if (key == "CHARGE")
+                charge = hcp::ms2::tonum<int_t>(hcp::ms2::token(val), 0);
+            else if (key == "RTINSECONDS")
+                rtime = hcp::ms2::tonum<double_t>(hcp::ms2::token(val), 0.0) / 60.0;
+        }
     }
-    else
-        cout << "Error: Unable to open qqfile: " << *filename << endl;
+}
 
-    largestspec = max(specsize, largestspec);
+//
+// decode an mzML binaryDataArray into doubles
+//
+static bool_t MSQuery_DecodeArray(std::string_view bda, uint_t length, std::vector<double_t> &values, int_t &kind)
+{
+    static thread_local std::vector<uchar_t> raw;
+    static thread_local std::vector<uchar_t> inflated;
 
-    // delete the temp arrays
-    delete[] m_mzs;
-    delete[] rtimes;
-    delete[] z;
+    int_t width = 8;
+    bool_t zlib = false;
+    bool_t supported = true;
 
-    // return global count and largest spectrum length
-    return std::array<int, 2>{globalcount, largestspec};
+    kind = 0;
+
+    // array flags
+    for (size_t pos = bda.find("<cvParam"); pos != std::string_view::npos; pos = bda.find("<cvParam", pos + 1))
+    {
+        auto tag = bda.substr(pos, bda.find('>', pos) - pos);
+        auto acc = hcp::ms2::attribute(tag, "accession");
+
+        if (acc == "MS:1000521")
+            width = 4;
+        else if (acc == "MS:1000523")
+            width = 8;
+        else if (acc == "MS:1000574")
+            zlib = true;
+        else if (acc == "MS:1000514")
+            kind = 1;
+        else if (acc == "MS:1000515")
+            kind = 2;
+        // other compressions (e.g. numpress)
+        else if (acc == "MS:1002312" || acc == "MS:1002313" || acc == "MS:1002314" ||
+                 acc == "MS:1002746" || acc == "MS:1002747" || acc == "MS:1002748")
+            supported = false;
+    }
+
+    if (!supported || kind == 0)
+        return supported;
+
+    size_t b = bda.find("<binary>");
+    size_t e = bda.find("</binary>");
+
+    if (b == std::string_view::npos || e == std::string_view::npos || e < b)
+        return false;
+
+    if (!hcp::ms2::b64decode(bda.substr(b + 8, e - b - 8), raw))
+        return false;
+
+    const uchar_t *bytes = raw.data();
+    size_t nbytes = raw.size();
+
+    if (zlib)
+    {
+#if defined (USE_ZLIB)
+        uLongf outlen = (uLongf) length * width;
+        inflated.resize(outlen);
+
+        if (outlen > 0 && uncompress(inflated.data(), &outlen, raw.data(), raw.size()) != Z_OK)
+            return false;
+
+        bytes = inflated.data();
+        nbytes = outlen;
+#else
+        return false;
+#endif // USE_ZLIB
+    }
+
+    size_t n = nbytes / width;
+    values.resize(n);
+
+    // mzML binary arrays are little-endian
+    for (size_t i = 0; i < n; i++)
+    {
+        if (width == 4)
+        {
+            float f;
+            std::memcpy(&f, bytes + i * 4, 4);
+            values[i] = f;
+        }
+        else
+            std::memcpy(&values[i], bytes + i * 8, 8);
+    }
 
+    return true;
 }
 
-template<typename T>
-status_t MSQuery::pickpeaks(std::vector<T> &mzs, std::vector<T> &intns, int &specsize, int m_idx, T *m_intns, T *m_mzs)
+/*
+ * FUNCTION: prepMZMLrange
+ *
+ * DESCRIPTION: Parse and preprocess the MS2 spectra (<spectrum> ..
+ *              </spectrum>) of a range of an mzML file. The binary
+ *              arrays (32/64-bit, uncompressed or zlib) are decoded
+ *              in place. The selected ion m/z is converted to the
+ *              [M+H]+ mass used by the MS2 Z lines and the scan
+ *              start time to minutes
+ *
+ * INPUT:
+ * @block: The range of the mzML file
+ * @batch: Preprocessed spectra of the range
+ *
+ * OUTPUT: none
+ */
+VOID MSQuery::prepMZMLrange(std::string_view block, PBINBatch &batch)
 {
-    int_t SpectrumSize = specsize;
+    std::vector<spectype_t> mzs;
+    std::vector<spectype_t> intns;
+
+    std::vector<double_t> mzarr;
+    std::vector<double_t> intarr;
+    std::vector<double_t> values;
 
-    auto intnArr = m_intns + m_idx;
-    auto mzArr = m_mzs + m_idx;
+    size_t b;
 
-    if (SpectrumSize > 0)
+    while ((b = block.find("<spectrum ")) != std::string_view::npos)
     {
-        KeyVal_Parallel<T, T>(intns.data(), mzs.data(), (uint_t)SpectrumSize, 1);
+        size_t e = block.find("</spectrum>", b);
 
-        // intensity normalization applied
-        double factor = ((double_t) params.base_int / intns[SpectrumSize - 1]);
+        if (e == std::string_view::npos)
+            break;
 
-        // filter out intensities > params.min_int (or 1% of base peak)
-        auto l_min_int = params.min_int; //0.01 * dIntArr[SpectrumSize - 1];
+        auto spec = block.substr(b, e - b);
+        block.remove_prefix(e + 11);
 
-        // TODO: choose either one and discard the other code for intensity normalization
+        auto stag = spec.substr(0, spec.find('>'));
+        uint_t length = hcp::ms2::tonum<uint_t>(hcp::ms2::attribute(stag, "defaultArrayLength"), 0);
 
-#if 1 // NON-STD code
+        // spectrum level cvParams precede the binary arrays
+        size_t arrpos = spec.find("<binaryDataArrayList");
+        auto head = spec.substr(0, arrpos);
 
-        /* Set the highest peak to base intensity */
-        intns[SpectrumSize - 1] = params.base_int;
-        int newspeclen = 1;
+        int_t level = 2;
+        int_t charge = 0;
+        double_t pepmz = 0;
+        double_t rtime = 0;
 
-        /* Scale the rest of the peaks to the base peak */
-        for (int_t j = SpectrumSize - 2; j >= (SpectrumSize - QALEN) && j >= 0; j--)
+        for (size_t pos = head.find("<cvParam"); pos != std::string_view::npos; pos = head.find("<cvParam", pos + 1))
         {
-            intns[j] *= factor;
+            auto tag = head.substr(pos, head.find('>', pos) - pos);
+            auto acc = hcp::ms2::attribute(tag, "accession");
+            auto val = hcp::ms2::attribute(tag, "value");
+
+            if (acc == "MS:1000511")
+                level = hcp::ms2::tonum<int_t>(val, 2);
+            else if (acc == "MS:1000744")
+                pepmz = hcp::ms2::tonum<double_t>(val, 0.0);
+            else if (acc == "MS:1000041")
+                charge = hcp::ms2::tonum<int_t>(val, 0);
+            else if (acc == "MS:1000016")
+            {
+                rtime = hcp::ms2::tonum<double_t>(val, 0.0);
 
-            if (intns[j] >= l_min_int)
-                newspeclen++;
-            // since sorted in ascending order. TODO: Check if this is correct
-            else
-                break;
+                // seconds to minutes
+                if (hcp::ms2::attribute(tag, "unitAccession") == "UO:0000010")
+                    rtime /= 60.0;
+            }
         }
-#else
-        // STL-based code for intensity normalization
 
-        // beginning position of noramlization region
-        auto bpos = intns.begin();
+        // only the MS/MS spectra
+        if (level != 2 || arrpos == std::string_view::npos)
+            continue;
 
-        if (SpectrumSize > QALEN)
-            bpos = intns.end() - QALEN;
+        mzarr.clear();
+        intarr.clear();
 
-        // apply normalization
-        std::for_each(bpos, intns.end(), [&](T &x) { x *= factor; });
+        bool_t valid = true;
+        auto arrays = spec.substr(arrpos);
 
-        // find the position of the peak > min_int
-        auto p_beg = std::lower_bound(bpos, intns.end(), l_min_int);
-        int newspeclen = std::distance(p_beg, intns.end());
+        for (size_t pos = arrays.find("<binaryDataArray "); pos != std::string_view::npos; pos = arrays.find("<binaryDataArray ", pos + 1))
+        {
+            size_t end = arrays.find("</binaryDataArray>", pos);
 
-#endif // STL code
+            if (end == std::string_view::npos)
+                break;
 
-        /* Check the size of spectrum */
-        if (newspeclen >= QALEN)
-        {
-            /* Copy the last QALEN elements to expSpecs */
-            std::copy(mzs.end() - QALEN, mzs.end(), mzArr);
-            std::copy(intns.end() - QALEN, intns.end(), intnArr);
+            int_t kind = 0;
 
-            // if larger than QALEN then only write the last QALEN elements and set the new length
-            newspeclen = QALEN;
+            if (!MSQuery_DecodeArray(arrays.substr(pos, end - pos), length, values, kind))
+            {
+                valid = false;
+                break;
+            }
+
+            if (kind == 1)
+                mzarr.swap(values);
+            else if (kind == 2)
+                intarr.swap(values);
         }
-        else
+
+        if (!valid || mzarr.size() != intarr.size())
         {
-            /* Copy the last QALEN elements to expSpecs */
-            std::copy(mzs.end() - newspeclen, mzs.end(), mzArr);
-            std::copy(intns.end() - newspeclen, intns.end(), intnArr);
+            static std::atomic<bool_t> warned(false);
+
+            if (!warned.exchange(true))
+                std::cerr << "Warning: skipping mzML spectra with unsupported or invalid binary arrays" << endl;
+
+            continue;
         }
 
-            // assign the new length to specsize
-            specsize = newspeclen;
+        int_t z = MAX(1, charge);
+
+        batch.z.push_back(z);
+        batch.prec_mz.push_back((pepmz - PROTON) * z + PROTON);
+        batch.rtimes.push_back(MAX(0.0, rtime));
+
+        for (size_t i = 0; i < mzarr.size(); i++)
+            MSQuery_AddPeak(mzs, intns, mzarr[i], intarr[i]);
+
+        addspectrum(batch, mzs, intns);
     }
-    else
+}
+
+/*
+ * FUNCTION: convertAndprepMS2bin
+ *
+ * DESCRIPTION: Preprocess an MS2, MGF or mzML file into its .pbin
+ *              file. The file is split into ranges at spectrum
+ *              boundaries which are preprocessed in parallel and
+ *              written to the .pbin file in order
+ *
+ * INPUT:
+ * @filename: Path to the MS2, MGF or mzML file
+ * @nthreads: Number of threads to preprocess the file with
+ *
+ * OUTPUT:
+ * @vals: Number of spectra and the largest spectrum size
+ */
+std::array<int, 2> MSQuery::convertAndprepMS2bin(string *filename, int_t nthreads)
+{
+    int_t largestspec = 0;
+    int_t globalcount = 0;
+
+    struct stat st;
+    void *base = MAP_FAILED;
+
+    int fd = open(filename->c_str(), O_RDONLY);
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (fd >= 0)
+        close(fd);
+
+    if (base == MAP_FAILED)
     {
-        std::cerr << "Spectrum size is zero" << endl;
-        //std::fill(intns.begin(), intns.end(), 0);
+        cout << "Error: Unable to open qqfile: " << *filename << endl;
+        return std::array<int, 2>{0, 0};
     }
 
-    mzs.clear();
-    intns.clear();
+    const char_t *data = (const char_t *) base;
+    size_t size = st.st_size;
 
-    return SLM_SUCCESS;
-}
+    madvise(base, size, MADV_SEQUENTIAL);
 
-void MSQuery::flushBinaryFile(string *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close)
-{
-    static thread_local bool_t isNewFile = true;
-    static thread_local std::ofstream qbFile;
+    // range size: a few ranges per thread
+    size_t rsize = std::clamp<size_t>(size / (4 * nthreads), MS2_MINRANGE, MS2_MAXRANGE);
+
+    // spectrum parser and the marker that a spectrum starts
+    // at: ranges are only split at the beginning of a spectrum
+    auto format = hcp::ms2::getformat(*filename);
 
-    if (isNewFile)
+    VOID (*prepRange)(std::string_view, PBINBatch &) = prepMS2range;
+    std::string_view marker = "\nS";
+    size_t skip = 1;
+
+    if (format == hcp::ms2::format_t::MGF)
+    {
+        prepRange = prepMGFrange;
+        marker = "\nBEGIN IONS";
+    }
+    else if (format == hcp::ms2::format_t::MZML)
     {
-        qbFile.open(*filename + ".pbin", ios::binary);
-        isNewFile = false;
+        prepRange = prepMZMLrange;
+        marker = "<spectrum ";
+        skip = 0;
     }
 
-    if (qbFile.is_open())
+    std::string_view file(data, size);
+    std::vector<size_t> bounds = {0};
+
+    for (size_t off = rsize; off < size; off += rsize)
     {
-        int ind = 0;
+        off = std::max(off, bounds.back() + 1);
 
-        for (int i = 0; i < count; i++)
-        {
-            qbFile.write((char *)&prec_mz[i], sizeof(float));
-            qbFile.write((char *)&z[i], sizeof(int));
-            qbFile.write((char *)&rtimes[i], sizeof(float));
-            qbFile.write((char *)&lens[i], sizeof(int));
+        size_t pos = file.find(marker, off - 1);
+
+        if (pos == std::string_view::npos)
+            break;
+
+        off = pos + skip;
+        bounds.push_back(off);
+    }
+
+    bounds.push_back(size);
+
+    int_t nranges = bounds.size() - 1;
+
+    PBINWriter writer;
+    writer.open(*filename);
+
+    if (!writer.is_open())
+        std::cerr << "Could not open file " << *filename << ".pbin" << std::endl;
+
+#ifdef USE_OMP
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(nthreads)
+#endif /* USE_OMP */
+    for (int_t r = 0; r < nranges; r++)
+    {
+        PBINBatch batch;
+
+        prepRange(std::string_view(data + bounds[r], bounds[r+1] - bounds[r]), batch);
 
-            qbFile.write((char *)&m_mzs[ind], sizeof(spectype_t) * lens[i]);
-            qbFile.write((char *)&m_intns[ind], sizeof(spectype_t) * lens[i]);
+        // release the pages of the parsed range
+        ull_t lo = (bounds[r] + sysconf(_SC_PAGESIZE) - 1) & ~((ull_t) sysconf(_SC_PAGESIZE) - 1);
+        ull_t hi = bounds[r+1] & ~((ull_t) sysconf(_SC_PAGESIZE) - 1);
 
-            ind += lens[i];
+        if (hi > lo)
+            madvise((char_t *) base + lo, hi - lo, MADV_DONTNEED);
+
+        // write the ranges in order
+#ifdef USE_OMP
+#pragma omp ordered
+#endif /* USE_OMP */
+        {
+            if (writer.is_open())
+                writer.write(batch.mzs.data(), batch.intns.data(), batch.rtimes.data(), batch.prec_mz.data(),
+                             batch.z.data(), batch.lens.data(), batch.lens.size());
+
+            globalcount += batch.lens.size();
+            largestspec = max(batch.largestspec, largestspec);
         }
     }
+
+    writer.close(largestspec);
+
+    munmap(base, size);
+
+    // return global count and largest spectrum length
+    return std::array<int, 2>{globalcount, largestspec};
+}
+
+void MSQuery::flushBinaryFile(string *filename, spectype_t *m_mzs, spectype_t *m_intns, float *rtimes, float *prec_mz, int *z, int *lens, int count, bool close, int_t maxslen)
+{
+    static thread_local PBINWriter writer;
+
+    if (!writer.is_open())
+        writer.open(*filename);
+
+    if (writer.is_open())
+        writer.write(m_mzs, m_intns, rtimes, prec_mz, z, lens, count);
     else
-        std::cerr << "Could not open file " << filename << ".pbin" << std::endl;
+        std::cerr << "Could not open file " << *filename << ".pbin" << std::endl;
 
     if (close)
-    {
-        qbFile.flush();
-        qbFile.close();
-        isNewFile = true;
-    }
+        writer.close(maxslen);
 }
 
 /*
@@ -468,16 +1038,25 @@ void MSQuery::flushBinaryFile(string *filename, spectype_t *m_mzs, spectype_t *m
  *
  * INPUT:
  * @filename : Path to query file
+ * @fno      : Index of the query file
+ * @nthreads : Number of threads to preprocess the file with
  *
  * OUTPUT:
  * @status: Status of execution
  */
-status_t MSQuery::initialize(string_t *filename, int_t fno)
+status_t MSQuery::initialize(string_t *filename, int_t fno, int_t nthreads)
 {
     status_t status = SLM_SUCCESS;
 
+    // MGF and mzML files are only read through the .pbin files
+    if (params.filetype == gParams::FileType_t::MS2 && hcp::ms2::getformat(*filename) != hcp::ms2::format_t::MS2)
+    {
+        std::cerr << "Error: --nocache requires MS2 files: " << *filename << std::endl;
+        return ERR_INVLD_PARAM;
+    }
+
     // FIXME condition at which it will depend
-    auto vals = (params.filetype == gParams::FileType_t::PBIN)? convertAndprepMS2bin(filename): readMS2file(filename);
+    auto vals = (params.filetype == gParams::FileType_t::PBIN)? convertAndprepMS2bin(filename, nthreads): readMS2file(filename);
 
     auto largestspec = vals[1];
     auto globalcount = vals[0];
@@ -513,6 +1092,8 @@ status_t MSQuery::initialize(string_t *filename, int_t fno)
 
 void MSQuery::setFilename(string_t &filename) { this->MS2file = filename; }
 
+const string_t &MSQuery::getFilename() { return this->MS2file; }
+
 //
 // info initialized at remote process, initialize rest here
 //
@@ -536,72 +1117,44 @@ void MSQuery::vinitialize(string_t *filename, int_t fno)
     m_isinit = true;
 }
 
-//
-// initialize the binary MS2 file index if needed
-//
-bool MSQuery::init_index(const std::vector<string_t> &queryfiles)
+/*
+ * FUNCTION: cacheinit
+ *
+ * DESCRIPTION: Initialize the structures from the current .pbin
+ *              file of the query file (if any) without reading
+ *              the spectra. The file information is taken from
+ *              the .pbin header
+ *
+ * INPUT:
+ * @filename : Path to query file
+ * @fno      : Index of the query file
+ *
+ * OUTPUT:
+ * @cached: true if initialized from the .pbin file
+ */
+bool_t MSQuery::cacheinit(string_t *filename, int_t fno)
 {
-    bool summaryExists = false;
-
-    string_t fname = params.datapath + "/summary.dbprep";
+    PBINHeader hdr;
 
-    // function to check if a file exists
-    auto fileexists = [](const string_t &fname) -> bool
-    {
-    // COMPILER VERSION GCC 9.1.0+ required
-#if __GNUC__ > 9 || (__GNUC__ == 9 && (__GNUC_MINOR__ >= 1))
-        // COMPILER VERSION GCC 9.1.0+ required for std::filesystem calls
-        auto ret = std::filesystem::exists(fname);
-#else
-        ifstream file(fname);
-        auto ret = file.good();
-        file.close();
-#endif // GNUC VERSION
+    if (params.filetype != gParams::FileType_t::PBIN || params.reindex || !verifyBINfile(*filename, &hdr))
+        return false;
 
-        return ret;
-    };
-
-    // function to verify PBIN files
-    auto verifypbinfiles = [&]()
-    {
-        // check for all .pbin files
-        auto dir = opendir(params.datapath.c_str());
-        dirent* pdir;
-        std::vector<string_t> pbinfiles;
+    info = info_t(hdr.maxslen, std::ceil(((double) hdr.nspecs / QCHUNK)), hdr.nspecs);
 
-        // check if opened
-        if (dir != nullptr)
-        {
-            while ((pdir = readdir(dir)) != nullptr)
-            {
-                string_t cfile(pdir->d_name);
-                cfile = cfile.substr(cfile.find_last_of("."));
-                // Add the matching files
-                if (cfile.find(".pbin") != std::string::npos)
-                    pbinfiles.push_back(params.datapath + '/' + pdir->d_name);
-            }
-        }
-        else
-            return false;
+    vinitialize(filename, fno);
 
-        if (pbinfiles.size() == queryfiles.size())
-        {
-            // check if all files exist
-            for (auto &ms2file : queryfiles)
-            {
-                string_t tempfile = ms2file + ".pbin";
-                if (std::find(pbinfiles.begin(), pbinfiles.end(), tempfile) == pbinfiles.end())
-                    return false;
-            }
-        }
-        else
-            return false;
+    return true;
+}
 
-        return true;
-    };
+//
+// open the MS2 index (summary.dbprep) of nfiles entries to update
+// the entries of the (re)preprocessed files in place
+//
+status_t MSQuery::init_index(int_t nfiles)
+{
+    status_t status = SLM_SUCCESS;
 
-    // check if file exists
-    bool exists = !params.reindex && fileexists(fname) && verifypbinfiles();
+    string_t fname = params.datapath + "/summary.dbprep";
 
 #if defined (USE_MPI)
     if (!params.useGPU)
@@ -615,38 +1168,35 @@ bool MSQuery::init_index(const std::vector<string_t> &queryfiles)
 
         // make sure all processes have the same file
         hcp::mpi::barrier();
-    }
-#endif // USE_MPI
 
-    // if the file does not exist, create it
-    if (!exists)
-    {
-        // set reindex = true
-        params.reindex = true;
+        // the entries are written in place (at the file indices)
+        status = MPI_File_open(MPI_COMM_WORLD, fname.c_str(), (MPI_MODE_CREATE | MPI_MODE_WRONLY), MPI_INFO_NULL, &mpi_fh);
 
-#if defined (USE_MPI)
+        // drop the entries of removed files
+        if (status == MPI_SUCCESS)
+            status = MPI_File_set_size(mpi_fh, nfiles * sizeof(info_t));
 
-        if ( !params.useGPU)
-        {
-            // open the file as ofstream file
-            status_t err = MPI_File_open(MPI_COMM_WORLD, fname.c_str(), (MPI_MODE_CREATE | MPI_MODE_WRONLY), MPI_INFO_NULL, &mpi_fh);
-            return exists;
-        }
+        return status;
+    }
 #endif // USE_MPI
 
-        fh = new ofstream;
-        fh->open(fname, ios::out | ios::binary);
+    // create the file if needed and drop the entries of removed files
+    {
+        ofstream create(fname, ios::app | ios::binary);
+    }
 
-        // if unable to open fh
-        if (!fh)
-        {
-            std::cerr << "Error opening file: " << fname << std::endl;
-            exit (-1);
-        }
+    int_t err = truncate(fname.c_str(), nfiles * sizeof(info_t));
+
+    fh = new fstream(fname, ios::in | ios::out | ios::binary);
 
+    // if unable to open fh
+    if (err != 0 || !fh->is_open())
+    {
+        std::cerr << "Error opening file: " << fname << std::endl;
+        exit (-1);
     }
 
-    return exists;
+    return status;
 }
 
 status_t MSQuery::write_index()
@@ -654,6 +1204,10 @@ status_t MSQuery::write_index()
 #ifdef USE_MPI
     if (!params.useGPU)
     {
+        // not opened if all .pbin files were current
+        if (mpi_fh == MPI_FILE_NULL)
+            return SLM_SUCCESS;
+
         return MPI_File_close(&mpi_fh);
     }
 #endif // USE_MPI
@@ -714,7 +1268,10 @@ status_t MSQuery::archive(int_t index)
         return MPI_File_write_at(mpi_fh, sizeof(info_t)*(index), &info, 1, MPI_info, MPI_STATUS_IGNORE);
 #endif // USE_MPI
 
-    // fh advances with every write/read
+    // entry at the file index
+    std::lock_guard<std::mutex> lock(fhlock);
+
+    fh->seekp(sizeof(info_t) * index);
     fh->write((char_t *)&info, sizeof(info_t));
 
     return status;
@@ -746,21 +1303,30 @@ status_t MSQuery::extractbatch(uint_t count, Queries<T> *expSpecs, int_t &rem)
     expSpecs->numSpecs = count;
     expSpecs->idx[0] = 0; //Set starting point to zero.
 
-    if (qfile == NULL || qfile->is_open() == false)
+    if (params.filetype == gParams::FileType_t::PBIN)
     {
-        /* Get a new ifstream object and open file */
-        qfile = new ifstream;
+        /* Map the binary file and index its spectra once */
+        if (qmap == nullptr)
+            status = mapBINfile();
 
-        // Open file as bin or simple text
-        (params.filetype == gParams::FileType_t::PBIN)? qfile->open(MS2file, ios::in | ios::binary) : qfile->open(MS2file, ios::in);
+        if (status == SLM_SUCCESS)
+            status = readBINbatch<T>(startspec, endspec, expSpecs);
+        else
+        {
+            std::cerr << "Error opening file: " << MS2file << std::endl;
+            exit(status);
+        }
     }
-
-    /* Check if file opened */
-    if (qfile->is_open() /*&& status =SLM_SUCCESS*/)
+    else
     {
-        if (params.filetype == gParams::FileType_t::PBIN)
-            readBINbatch<T>(startspec, endspec, expSpecs);
-        else
+        if (qfile == NULL || qfile->is_open() == false)
+        {
+            /* Get a new line reader and open file */
+            qfile = new hcp::ms2::linereader(MS2file);
+        }
+
+        /* Check if file opened */
+        if (qfile->is_open())
         {
             for (uint_t spec = startspec; spec < endspec; spec++)
             {
@@ -768,12 +1334,12 @@ status_t MSQuery::extractbatch(uint_t count, Queries<T> *expSpecs, int_t &rem)
                 status = pickpeaks(expSpecs);
             }
         }
-    }
-    else
-    {
-        std::cerr << "Error opening file: " << MS2file << std::endl;
-        status = ERR_FILE_NOT_FOUND;
-        exit(ERR_FILE_NOT_FOUND);
+        else
+        {
+            std::cerr << "Error opening file: " << MS2file << std::endl;
+            status = ERR_FILE_NOT_FOUND;
+            exit(ERR_FILE_NOT_FOUND);
+        }
     }
 
     //if (status == SLM_SUCCESS)
@@ -788,249 +1354,282 @@ status_t MSQuery::extractbatch(uint_t count, Queries<T> *expSpecs, int_t &rem)
     return status;
 }
 
-template <typename T>
-void MSQuery::readBINbatch(int startspec, int endspec, Queries<T> *expSpecs)
+/*
+ * FUNCTION: mapBINfile
+ *
+ * DESCRIPTION: Memory map (read-only) the .pbin file and locate
+ *              the byte offset table of its spectra
+ *
+ * INPUT: none
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t MSQuery::mapBINfile()
 {
-    auto prec_mz = expSpecs->precurse;
-    auto z = expSpecs->charges;
-    auto rtimes = expSpecs->rtimes;
-    auto lens = expSpecs->idx;
-    auto m_mzs = expSpecs->moz;
-    auto m_intns = expSpecs->intensity;
+    struct stat st;
 
-    int ind = 0;
+    int fd = open(MS2file.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return ERR_FILE_NOT_FOUND;
 
-    if (qfile->is_open())
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        // temporary spectrum length variable
-        int_t clen = 0;
+        close(fd);
+        return ERR_INVLD_SIZE;
+    }
 
-        // lens[0] must be 0
-        lens[0] = 0;
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-        auto count = (endspec - startspec);
+    // the mapping holds its own reference to the file
+    close(fd);
 
-        // FIXME: are loop limits correct?
-        for (int i = 0; i < count; i++)
-        {
-            qfile->read((char *)&prec_mz[i], sizeof(float));
-            qfile->read((char *)&z[i], sizeof(int));
-            qfile->read((char *)&rtimes[i], sizeof(float));
-            qfile->read((char *)&clen, sizeof(int));
+    if (base == MAP_FAILED)
+        return ERR_BAD_MEM_ALLOC;
+
+    // spectra are consumed front to back
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
 
-            qfile->read((char *)&m_mzs[ind], sizeof(T) * clen);
-            qfile->read((char *)&m_intns[ind], sizeof(T) * clen);
+    qmap = (char_t *) base;
+    qmapsize = st.st_size;
 
-            ind += clen;
-            lens[i+1] = lens[i] + clen;
+    // check the header and locate the offset table
+    const PBINHeader *hdr = (const PBINHeader *) qmap;
 
+    bool_t valid = qmapsize >= sizeof(PBINHeader) &&
+                   !std::strncmp(hdr->magic, PBIN_MAGIC, sizeof(hdr->magic)) &&
+                   hdr->version == PBIN_VERSION && hdr->hdrsize == sizeof(PBINHeader) &&
+                   hdr->spectype == sizeof(spectype_t) && hdr->offtab % sizeof(ull_t) == 0 &&
+                   hdr->offtab + (hdr->nspecs + 1) * sizeof(ull_t) <= qmapsize;
+
+    if (valid)
+    {
+        const ull_t *offs = (const ull_t *) (qmap + hdr->offtab);
+
+        // every record lies between the header and the offset
+        // table and holds its header and at most QALEN peaks
+        valid = offs[0] >= sizeof(PBINHeader) && offs[hdr->nspecs] <= hdr->offtab;
+
+        for (uint_t i = 0; valid && i < hdr->nspecs; i++)
+        {
+            ull_t reclen = offs[i + 1] - offs[i];
+
+            valid = offs[i + 1] >= offs[i] + PBIN_SPECHDR &&
+                    (reclen - PBIN_SPECHDR) % (2 * sizeof(spectype_t)) == 0 &&
+                    (reclen - PBIN_SPECHDR) / (2 * sizeof(spectype_t)) <= QALEN;
         }
     }
 
-    // set the total number of peaks
-    expSpecs->numPeaks = ind;
+    if (!valid || hdr->nspecs < info.QAcount)
+    {
+        std::cerr << "Error: " << MS2file << " is not a valid PBIN v" << PBIN_VERSION
+                  << " file with " << info.QAcount << " spectra" << std::endl;
+
+        unmapBINfile();
+        return ERR_INVLD_SIZE;
+    }
+
+    qoffs = (const ull_t *) (qmap + hdr->offtab);
+
+    return SLM_SUCCESS;
 }
 
-VOID MSQuery::readMS2spectrum()
+void MSQuery::unmapBINfile()
 {
-    string_t line;
-    uint_t speclen = 0;
-    char_t *saveptr;
-    char_t *Isave;
+    if (qmap != nullptr)
+    {
+        munmap(qmap, qmapsize);
+        qmap = nullptr;
+        qmapsize = 0;
+    }
+
+    qoffs = nullptr;
+}
+
+/*
+ * FUNCTION: reservebatch
+ *
+ * DESCRIPTION: Reserve the next batch of spectra of the .pbin file
+ *              for an asynchronous read and get its byte range. The
+ *              read data is then extracted with readbatch
+ *
+ * INPUT:
+ * @count    : Maximum number of spectra in the batch
+ * @startspec: First spectrum of the batch
+ * @endspec  : One past the last spectrum of the batch
+ * @offset   : Byte offset of the batch in the .pbin file
+ * @length   : Byte length of the batch
+ * @rem      : Number of remaining spectra after the batch
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+status_t MSQuery::reservebatch(uint_t count, uint_t &startspec, uint_t &endspec, ull_t &offset, ull_t &length, int_t &rem)
+{
+    status_t status = SLM_SUCCESS;
+
+    /* Map the binary file for its offset table */
+    if (qmap == nullptr)
+        status = mapBINfile();
 
-    /* Check if this is the first spectrum in file */
-    if (currPtr == 0)
+    if (status != SLM_SUCCESS)
     {
-        BOOL scan = false;
+        std::cerr << "Error opening file: " << MS2file << std::endl;
+        return status;
+    }
 
-        while (!qfile->eof())
-        {
-            /* Read one line */
-            getline(*qfile, line);
+    /* half open interval [startspec, endspec) */
+    startspec = running_count;
+    endspec = std::min(running_count + count, info.QAcount);
 
-            /* Empty line */
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
-            {
-                continue;
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &saveptr);
-                mh = strtok_r(NULL, " \t", &saveptr);
-                string_t val = "1";
+    offset = qoffs[startspec];
+    length = qoffs[endspec] - qoffs[startspec];
+
+    running_count = endspec;
+    rem = info.QAcount - running_count;
+
+    return status;
+}
 
-                if (mh != NULL)
-                    val = string_t(mh);
+/*
+ * FUNCTION: readbatch
+ *
+ * DESCRIPTION: Extract a batch reserved with reservebatch from
+ *              its bytes read from the .pbin file
+ *
+ * INPUT:
+ * @data     : Bytes of the batch
+ * @startspec: First spectrum of the batch
+ * @endspec  : One past the last spectrum of the batch
+ * @expSpecs : Queries buffer to fill
+ *
+ * OUTPUT:
+ * @status: Status of execution
+ */
+template <typename T>
+status_t MSQuery::readbatch(const char_t *data, uint_t startspec, uint_t endspec, Queries<T> *expSpecs)
+{
+    expSpecs->numSpecs = endspec - startspec;
+    expSpecs->idx[0] = 0;
 
-                spectrum.Z = std::atoi(val.c_str());
+    return readBINbatch<T>(startspec, endspec, expSpecs, data);
+}
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &saveptr);
+template <typename T>
+status_t MSQuery::readBINbatch(int startspec, int endspec, Queries<T> *expSpecs, const char_t *data)
+{
+    auto prec_mz = expSpecs->precurse;
+    auto z = expSpecs->charges;
+    auto rtimes = expSpecs->rtimes;
+    auto lens = expSpecs->idx;
+    auto m_mzs = expSpecs->moz;
+    auto m_intns = expSpecs->intensity;
 
-                if (mh != NULL)
-                    val = string_t(mh);
+    int ind = 0;
 
-                spectrum.prec_mz = (double_t)std::atof(val.c_str());
-            }
-            else if (line[0] == 'I')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
-
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
-
-                    spectrum.rtime = (double_t)std::atof(val.c_str());
-                }
-            }
-            else if (line[0] == 'S')
-            {
-                if (scan == true)
-                {
-                    spectrum.SpectrumSize = speclen;
-                    break;
-                }
-                else
-                    scan = true;
-            }
-            /* Values */
-            else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
+    // lens[0] must be 0
+    lens[0] = 0;
 
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &saveptr);
-                char_t *intn1 = strtok_r(NULL, " ", &saveptr);
-                string_t mz = "0.01";
-                string_t intn = "0.01";
+    auto count = (endspec - startspec);
 
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
+    // read from the mapping or the (already read) bytes of the batch
+    const char_t *base = (data != nullptr) ? data : qmap + qoffs[startspec];
 
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
+    for (int i = 0; i < count; i++)
+    {
+        // spectrum header followed by its m/z and intensity arrays
+        const char_t *sptr = base + (qoffs[startspec + i] - qoffs[startspec]);
+        int_t clen;
 
-                spectrum.mz[speclen] = (uint_t)((double_t)std::atof(mz.c_str()) * params.scale);
-                spectrum.intn[speclen] = (uint_t)((double_t)std::atof(intn.c_str()) * YAXISMULTIPLIER);
+        std::memcpy(&prec_mz[i], sptr, sizeof(float));
+        std::memcpy(&z[i], sptr + sizeof(float), sizeof(int));
+        std::memcpy(&rtimes[i], sptr + sizeof(float) + sizeof(int), sizeof(float));
+        std::memcpy(&clen, sptr + 3 * sizeof(int), sizeof(int));
 
-                speclen++;
-            }
+        // the peaks must fill the record (checked in mapBINfile)
+        if ((ull_t) clen * 2 * sizeof(T) + PBIN_SPECHDR != qoffs[startspec + i + 1] - qoffs[startspec + i])
+        {
+            std::cerr << "Error: corrupt spectrum " << startspec + i << " in " << MS2file << std::endl;
+            return ERR_INVLD_SIZE;
         }
 
-        spectrum.SpectrumSize = speclen;
+        sptr += PBIN_SPECHDR;
+
+        std::memcpy(&m_mzs[ind], sptr, sizeof(T) * clen);
+        std::memcpy(&m_intns[ind], sptr + sizeof(T) * clen, sizeof(T) * clen);
+
+        ind += clen;
+        lens[i+1] = lens[i] + clen;
     }
-    /* Not the first spectrum in file */
-    else
+
+    // release the pages of the consumed spectra
+    if (data == nullptr)
     {
-        while (!qfile->eof())
-        {
-            /* Read one line */
-            getline(*qfile, line);
+        ull_t lo = qoffs[startspec] & ~((ull_t) sysconf(_SC_PAGESIZE) - 1);
+        ull_t hi = qoffs[endspec] & ~((ull_t) sysconf(_SC_PAGESIZE) - 1);
 
-            /* Empty line */
-            if (line.empty() || line[0] == 'H' || line[0] == 'D')
-            {
-                continue;
-            }
-            else if (line[0] == 'Z')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &saveptr);
-                mh = strtok_r(NULL, " \t", &saveptr);
-                string_t val = "1";
+        if (hi > lo)
+            madvise(qmap + lo, hi - lo, MADV_DONTNEED);
+    }
+
+    // set the total number of peaks
+    expSpecs->numPeaks = ind;
 
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
+    return SLM_SUCCESS;
+}
 
-                spectrum.Z = std::atoi(val.c_str());
+VOID MSQuery::readMS2spectrum()
+{
+    std::string_view line;
+    uint_t speclen = 0;
 
-                val = "0.01";
-                mh = strtok_r(NULL, " \t", &saveptr);
+    /* The first S line of the file opens (not closes) the spectrum */
+    BOOL scan = (currPtr != 0);
 
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
+    while (qfile->getline(line))
+    {
+        /* Empty line */
+        if (line.empty() || line[0] == 'H' || line[0] == 'D')
+        {
+            continue;
+        }
+        else if (line[0] == 'Z')
+        {
+            hcp::ms2::token(line);
 
-                spectrum.prec_mz = (double_t)std::atof(val.c_str());
+            spectrum.Z = hcp::ms2::tonum<int_t>(hcp::ms2::token(line), 1);
+            spectrum.prec_mz = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+        }
+        else if (line[0] == 'I')
+        {
+            hcp::ms2::token(line);
 
-            }
-            else if (line[0] == 'I')
-            {
-                char_t *mh = strtok_r((char_t *) line.c_str(), " \t", &Isave);
-                mh = strtok_r(NULL, " \t", &Isave);
-                string_t val = "";
-
-                if (mh != NULL)
-                {
-                    val = string_t(mh);
-                }
-
-                if (val.compare("RTime") == 0)
-                {
-                    val = "0.00";
-                    mh = strtok_r(NULL, " \t", &Isave);
-
-                    if (mh != NULL)
-                    {
-                        val = string_t(mh);
-                    }
-
-                    spectrum.rtime = (double_t)std::atof(val.c_str());
-                }
-            }
-            else if (line[0] == 'S')
-            {
-                spectrum.SpectrumSize = speclen;
+            if (hcp::ms2::token(line) == "RTime")
+                spectrum.rtime = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.0);
+        }
+        else if (line[0] == 'S')
+        {
+            if (scan == true)
                 break;
-            }
-            /* Values */
             else
-            {
-                /* Split line into two DOUBLEs
-                 * using space as delimiter */
-                char_t *mz1 = strtok_r((char_t *) line.c_str(), " ", &saveptr);
-                char_t *intn1 = strtok_r(NULL, " ", &saveptr);
-
-                string_t mz = "0.0";
-                string_t intn = "0.0";
-
-                if (mz1 != NULL)
-                {
-                    mz = string_t(mz1);
-                }
-                if (intn1 != NULL)
-                {
-                    intn = string_t(intn1);
-                }
-
-                spectrum.mz[speclen] = (uint_t)((double_t)std::atof(mz.c_str()) * params.scale);
-                spectrum.intn[speclen] = (uint_t)((double_t)std::atof(intn.c_str()) * YAXISMULTIPLIER);
-
-                speclen++;
-            }
+                scan = true;
         }
+        /* Values */
+        else
+        {
+            /* Split line into two DOUBLEs */
+            double_t mz = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+            double_t intn = hcp::ms2::tonum<double_t>(hcp::ms2::token(line), 0.01);
+
+            spectrum.mz[speclen] = (uint_t)(mz * params.scale);
+            spectrum.intn[speclen] = (uint_t)(intn * YAXISMULTIPLIER);
 
-        spectrum.SpectrumSize = speclen;
+            speclen++;
+        }
     }
+
+    spectrum.SpectrumSize = speclen;
 }
 
 template <typename T>
@@ -1045,53 +1644,14 @@ status_t MSQuery::pickpeaks(Queries<T> *expSpecs)
     expSpecs->charges[currPtr - running_count] = MAX(1, spectrum.Z);
     expSpecs->rtimes[currPtr - running_count] = MAX(0.0, spectrum.rtime);
 
-    KeyVal_Parallel<T, T>(dIntArr, mzArray, (uint_t)SpectrumSize, 1);
-
-    uint_t speclen = 0;
-    double_t factor = 0;
-
-    if (SpectrumSize > 0)
-    {
-        factor = ((double_t) params.base_int / dIntArr[SpectrumSize - 1]);
-
-        /* Set the highest peak to base intensity */
-        dIntArr[SpectrumSize - 1] = params.base_int;
-        speclen = 1;
-
-        uint_t l_min_int = params.min_int; //0.01 * dIntArr[SpectrumSize - 1];
-
-        /* Scale the rest of the peaks to the base peak */
-        for (int_t j = SpectrumSize - 2; j >= (SpectrumSize - QALEN) && j >= 0; j--)
-        {
-            dIntArr[j] *= factor;
-
-            if (dIntArr[j] >= l_min_int)
-            {
-                speclen++;
-            }
-        }
-    }
-
     /* Update the indices */
     uint_t offset = expSpecs->idx[currPtr - running_count];
 
+    uint_t speclen = selectpeaks(dIntArr, mzArray, SpectrumSize, &expSpecs->intensity[offset], &expSpecs->moz[offset]);
+
     // subtract running_count to get local index of expSpecs
     expSpecs->idx[currPtr - running_count + 1] = expSpecs->idx[currPtr - running_count] + speclen;
 
-    /* Check the size of spectrum */
-    if (speclen >= QALEN)
-    {
-        /* Copy the last QALEN elements to expSpecs */
-        std::memcpy(&expSpecs->moz[offset], (mzArray + SpectrumSize - QALEN), (QALEN * sizeof(T)));
-        std::memcpy(&expSpecs->intensity[offset], (dIntArr + SpectrumSize - QALEN), (QALEN * sizeof(T)));
-    }
-    else
-    {
-        /* Copy the last speclen items to expSpecs */
-        std::memcpy(&expSpecs->moz[offset], (mzArray + SpectrumSize - speclen), (speclen * sizeof(T)));
-        std::memcpy(&expSpecs->intensity[offset], (dIntArr + SpectrumSize - speclen), (speclen * sizeof(T)));
-    }
-
     expSpecs->numPeaks += speclen;
 
     // increase the number of spectra read
@@ -1118,6 +1678,8 @@ status_t MSQuery::DeinitQueryFile()
         qfile = NULL;
     }
 
+    unmapBINfile();
+
     if (params.filetype == gParams::FileType_t::MS2)
         spectrum.deallocate();
 
@@ -1129,25 +1691,9 @@ status_t MSQuery::DeinitQueryFile()
     return SLM_SUCCESS;
 }
 
-BOOL MSQuery::isDeInit() { return ((qfile == NULL) && (info.QAcount == 0)); }
-
-/* Operator Overload - To copy to and from the work queue */
-MSQuery& MSQuery::operator=(const MSQuery &rhs)
-{
-    this->MS2file = rhs.MS2file;
-    this->info.QAcount = rhs.info.QAcount;
-    this->currPtr = rhs.currPtr;
-    this->curr_chunk = rhs.curr_chunk;
-    this->info.maxslen = rhs.info.maxslen;
-    this->info.nqchunks = rhs.info.nqchunks;
-    this->qfile = rhs.qfile;
-    this->running_count = rhs.running_count;
-    this->spectrum = rhs.spectrum;
-    this->qfileIndex = rhs.qfileIndex;
-
-    return *this;
-}
+BOOL MSQuery::isDeInit() { return ((qfile == NULL) && (qmap == nullptr) && (info.QAcount == 0)); }
 
+/* Operator Overload - Reset the counters */
 MSQuery& MSQuery::operator=(const int_t &rhs)
 {
     this->info.QAcount = rhs;
@@ -1177,5 +1723,4 @@ bool_t MSQuery::isinit() { return m_isinit; }
 
 // explicitly instantiate extractbatch with spectype_t to ensure correct instantiation
 template status_t MSQuery::extractbatch<spectype_t>(uint_t, Queries<spectype_t> *, int_t &);
-
-template status_t MSQuery::pickpeaks<spectype_t>(std::vector<spectype_t> &mzs, std::vector<spectype_t> &intns, int &specsize, int m_idx, spectype_t *m_intns, spectype_t *m_mzs);
+template status_t MSQuery::readbatch<spectype_t>(const char_t *, uint_t, uint_t, Queries<spectype_t> *);
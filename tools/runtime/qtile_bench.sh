@@ -0,0 +1,76 @@
+#!@BASH_EXECUTABLE@
+#
+# Query tiling (--qtile) comparison on a dataset
+# Copyrights(C) 2022 PCDS Laboratory
+# Muhammad Haseeb, and Fahad Saeed
+# School of Computing and Information Sciences
+# Florida International University (FIU), Miami, FL
+# Email: {mhaseeb, fsaeed}@fiu.edu
+#
+# Runs hicops with --qtile 0 (one spectrum at a time) and the given
+# tile size, reports the search times and checks that both produce
+# the same PSMs. The rows are compared sorted: tiling changes the order
+# in which spectra finish, so the row order within and across the
+# per-thread TSVs is not the same.
+#
+
+# print usage
+function usage() {
+    echo "USAGE: qtile_bench <hicops> <database> <dataset> [qtile = 64] [threads = 1] [runs = 3]"
+    echo "e.g. : qtile_bench ./hicops samples/sample_db samples/sample_data"
+}
+
+# if no input params
+if [ -z "$3" ] || [ "$1" = -h ]; then
+    usage
+    exit 0
+fi
+
+HICOPS=${1}
+DB=${2}
+DATA=${3}
+QTILE=${4:-64}
+THREADS=${5:-1}
+RUNS=${6:-3}
+
+TMP=$(mktemp -d)
+trap "rm -rf ${TMP}" EXIT
+
+# run hicops with the given tile size, print the search time
+function search() {
+    local ws=${TMP}/qtile${1}_${2}
+
+    ${HICOPS} --db ${DB} --dat ${DATA} -w ${ws} -t ${THREADS} --qtile ${1} > ${ws}.log 2>&1
+
+    if [ $? -ne 0 ]; then
+        echo "ERROR: hicops failed, see below" >&2
+        tail -20 ${ws}.log >&2
+        exit 1
+    fi
+
+    grep "Cumulative Search Time" ${ws}.log | awk '{print $4}' | tr -d 's'
+}
+
+printf "%8s %16s %16s\n" "run" "qtile=0 (s)" "qtile=${QTILE} (s)"
+
+for i in $(seq 1 ${RUNS})
+do
+    t0=$(search 0 ${i}) || exit 1
+    tq=$(search ${QTILE} ${i}) || exit 1
+
+    printf "%8d %16s %16s\n" ${i} ${t0} ${tq}
+done
+
+# same PSMs, ignoring the row order and the header lines
+for q in 0 ${QTILE}
+do
+    cat ${TMP}/qtile${q}_1/*.tsv | grep -v "^file" | sort > ${TMP}/qtile${q}.rows
+done
+
+if cmp -s ${TMP}/qtile0.rows ${TMP}/qtile${QTILE}.rows; then
+    echo "SUCCESS: same $(wc -l < ${TMP}/qtile0.rows) PSMs (row order differs)"
+else
+    echo "ERROR: the PSMs differ"
+    diff ${TMP}/qtile0.rows ${TMP}/qtile${QTILE}.rows | head -20
+    exit 1
+fi